@@ -0,0 +1,196 @@
+// Micro-benchmarks for Arena and the GameObject hierarchy operations, at
+// sizes from 1K to 1M items, with a varying share of holes (removed items,
+// scattered at random). Standalone; on Linux:
+//
+//	g++ -std=c++14 -O2 -DNDEBUG -I../Sisu ArenaBenchmarks.cpp -o arenabench
+//	./arenabench [--filter=AddChild] [--max-size=65536] > results.jsonl
+//
+// "param" in the output is the hole density.
+
+#include <memory>
+#include <numeric>
+#include <random>
+#include "Benchmark.h"
+#include "Arena.h"
+#include "GameObject.h"
+#include "GameObjectStorage.h"
+
+namespace
+{
+	// Cache line sized stand-in for a component
+	struct Payload
+	{
+		Payload() = default;
+		Payload(float value) { std::fill(data, data + 16, value); }
+		float data[16];
+	};
+
+	const std::size_t Sizes[] = { 1 << 10, 1 << 14, 1 << 17, 1 << 20 };
+	const double HoleDensities[] = { 0.0, 0.1, 0.5 };
+
+	template <typename T, typename Storage>
+	void PunchHoles(Arena<T, Storage>& arena, double holes, std::mt19937& rng)
+	{
+		std::bernoulli_distribution isHole(holes);
+		for (std::size_t i = 0; i < arena.OccupiedSize(); ++i)
+		{
+			if (isHole(rng)) { arena.RemoveAt(i); }
+		}
+	}
+
+	std::unique_ptr<Arena<Payload>> MakeArena(std::size_t size, double holes)
+	{
+		std::mt19937 rng(static_cast<unsigned>(size));
+		std::unique_ptr<Arena<Payload>> arena(new Arena<Payload>(size));
+		for (std::size_t i = 0; i < size; ++i) { arena->EmplaceAnywhere(float(i)); }
+		PunchHoles(*arena, holes, rng);
+		return arena;
+	}
+
+	std::vector<std::size_t> LiveIndices(Arena<Payload>& arena, std::mt19937& rng)
+	{
+		std::vector<std::size_t> indices;
+		arena.ForEachLiveRun([&](Payload* first, Payload* last, std::size_t firstIndex)
+		{
+			for (auto index = firstIndex; index < firstIndex + (last - first); ++index) { indices.push_back(index); }
+		});
+
+		std::shuffle(indices.begin(), indices.end(), rng);
+		return indices;
+	}
+
+	void ArenaBenchmarks(Bench::Runner& runner, std::size_t size, double holes)
+	{
+		// Fills the holes, then as many items again at the end
+		runner.Run("Arena/AddAnywhere", size, holes,
+			[&]() { return MakeArena(size, holes); },
+			[&](std::unique_ptr<Arena<Payload>>& arena)
+		{
+			auto count = arena->OccupiedSize() - arena->ItemCount() + size / 8;
+			for (std::size_t i = 0; i < count; ++i) { arena->EmplaceAnywhere(1.0f); }
+			return count;
+		});
+
+		runner.Run("Arena/RemoveAt", size, holes,
+			[&]()
+		{
+			std::mt19937 rng(7);
+			auto arena = MakeArena(size, holes);
+			auto indices = LiveIndices(*arena, rng);
+			indices.resize(indices.size() / 2);
+			return std::make_pair(std::move(arena), std::move(indices));
+		},
+			[&](std::pair<std::unique_ptr<Arena<Payload>>, std::vector<std::size_t>>& fixture)
+		{
+			for (auto index : fixture.second) { fixture.first->RemoveAt(index); }
+			return fixture.second.size();
+		});
+
+		runner.RunRepeated("Arena/GetStartIndexForGap", size, holes,
+			[&]() { return MakeArena(size, holes); },
+			[&](std::unique_ptr<Arena<Payload>>& arena)
+		{
+			std::size_t sum = 0;
+			for (std::size_t i = 0; i < 1024; ++i)
+			{
+				auto preferred = (i * 2654435761u) % size;
+				sum += arena->GetStartIndexForGap(1 + i % 8, preferred);
+			}
+
+			Bench::DoNotOptimize(sum);
+			return std::size_t(1024);
+		});
+
+		runner.RunRepeated("Arena/RangeFor", size, holes,
+			[&]() { return MakeArena(size, holes); },
+			[&](std::unique_ptr<Arena<Payload>>& arena)
+		{
+			float sum = 0.0f;
+			for (auto& item : *arena) { sum += item.data[0]; }
+			Bench::DoNotOptimize(sum);
+			return arena->ItemCount();
+		});
+
+		runner.RunRepeated("Arena/ForEachLiveRun", size, holes,
+			[&]() { return MakeArena(size, holes); },
+			[&](std::unique_ptr<Arena<Payload>>& arena)
+		{
+			float sum = 0.0f;
+			arena->ForEachLiveRun([&](const Payload* first, const Payload* last, std::size_t)
+			{
+				for (auto item = first; item != last; ++item) { sum += item->data[0]; }
+			});
+
+			Bench::DoNotOptimize(sum);
+			return arena->ItemCount();
+		});
+	}
+
+	// Roots with holes in between, one per 16 objects of the final size
+	std::unique_ptr<GameObjectArena> MakeRoots(std::size_t size, double holes, std::vector<std::size_t>& roots)
+	{
+		std::mt19937 rng(static_cast<unsigned>(size));
+		std::unique_ptr<GameObjectArena> arena(new GameObjectArena(size));
+		for (std::size_t i = 0; i < size / 16; ++i) { GameObject::EmplaceInArena(*arena); }
+		PunchHoles(*arena, holes, rng);
+
+		roots.clear();
+		for (std::size_t i = 0; i < arena->OccupiedSize(); ++i)
+		{
+			if (!arena->CanAddItemAt(i)) { roots.push_back(i); }
+		}
+
+		return arena;
+	}
+
+	void HierarchyBenchmarks(Bench::Runner& runner, std::size_t size, double holes)
+	{
+		typedef std::pair<std::unique_ptr<GameObjectArena>, std::vector<std::size_t>> Fixture;
+
+		// Kids get added round robin, so most of them land where a sibling
+		// of another parent is in the way, and the family has to relocate.
+		runner.Run("GameObject/AddChild", size, holes,
+			[&]() { Fixture fixture; fixture.first = MakeRoots(size, holes, fixture.second); return fixture; },
+			[&](Fixture& fixture)
+		{
+			for (int round = 0; round < 15; ++round)
+			{
+				for (auto parent : fixture.second) { GameObject::EmplaceChild(*fixture.first, parent); }
+			}
+
+			return 15 * fixture.second.size();
+		});
+
+		runner.Run("GameObject/AddChildren", size, holes,
+			[&]() { Fixture fixture; fixture.first = MakeRoots(size, holes, fixture.second); return fixture; },
+			[&](Fixture& fixture)
+		{
+			std::vector<GameObject> kids(5);
+			for (int round = 0; round < 3; ++round)
+			{
+				for (auto parent : fixture.second)
+				{
+					GameObject::AddChildren(*fixture.first, parent, kids.begin(), kids.end());
+				}
+			}
+
+			return 3 * kids.size() * fixture.second.size();
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Bench::Runner runner(argc, argv);
+
+	for (auto size : Sizes)
+	{
+		for (auto holes : HoleDensities)
+		{
+			ArenaBenchmarks(runner, size, holes);
+			HierarchyBenchmarks(runner, size, holes);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// A small, dependency free benchmark runner in the spirit of Google
+// Benchmark, so that the benchmarks build anywhere with just a compiler.
+//
+// Every benchmark is timed in a number of repetitions; a repetition keeps
+// calling the body (on a fresh fixture, or on the same one) until it has
+// run for at least MinTimePerRepetition, and the result is the median of
+// the repetitions, in ns per operation. Results go to stdout as JSON, one
+// benchmark per line, in the order they ran, so runs can be diffed.
+//
+// Command line: --filter=<substring> --repetitions=<n> --max-size=<n> --min-ms=<n>
+namespace Bench
+{
+	// Keeps the compiler from optimizing away a value, or the work behind it.
+	template <typename T>
+	inline void DoNotOptimize(const T& value)
+	{
+#ifdef _MSC_VER
+		_ReadWriteBarrier();
+		static volatile const void* sink;
+		sink = &value;
+#else
+		asm volatile("" : : "r"(&value) : "memory");
+#endif
+	}
+
+	struct Result
+	{
+		std::string name;
+		std::size_t size;
+		double param;
+		double nsPerOp;
+		double minNsPerOp;
+		double maxNsPerOp;
+		std::size_t opsPerRepetition;
+	};
+
+	class Runner
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		Runner(int argc, char** argv)
+		{
+			for (int i = 1; i < argc; ++i)
+			{
+				ParseArgument(argv[i], "--filter=", _filter);
+				ParseArgument(argv[i], "--repetitions=", _repetitions);
+				ParseArgument(argv[i], "--max-size=", _maxSize);
+				ParseArgument(argv[i], "--min-ms=", _minMilliseconds);
+			}
+
+			_repetitions = std::max(_repetitions, std::size_t(1));
+		}
+
+		// setup() makes a fresh fixture for every call of body(fixture),
+		// which returns the number of operations it did; only body is timed.
+		// For benchmarks that change the fixture, e.g. adding or removing.
+		template <typename Setup, typename Body>
+		void Run(const std::string& name, std::size_t size, double param, Setup setup, Body body)
+		{
+			if (!ShouldRun(name, size)) { return; }
+
+			std::vector<double> samples;
+			std::size_t opsPerRepetition = 0;
+
+			for (std::size_t rep = 0; rep < _repetitions; ++rep)
+			{
+				Clock::duration elapsed(0);
+				std::size_t ops = 0;
+
+				do
+				{
+					auto fixture = setup();
+					auto start = Clock::now();
+					ops += body(fixture);
+					elapsed += Clock::now() - start;
+				}
+				while (elapsed < MinTimePerRepetition());
+
+				samples.push_back(Nanoseconds(elapsed) / std::max(ops, std::size_t(1)));
+				opsPerRepetition = ops;
+			}
+
+			Report(name, size, param, samples, opsPerRepetition);
+		}
+
+		// Same, but with one fixture per repetition, for benchmarks that
+		// leave it alone, e.g. lookups and iteration.
+		template <typename Setup, typename Body>
+		void RunRepeated(const std::string& name, std::size_t size, double param, Setup setup, Body body)
+		{
+			if (!ShouldRun(name, size)) { return; }
+
+			std::vector<double> samples;
+			std::size_t opsPerRepetition = 0;
+
+			auto fixture = setup();
+			for (std::size_t rep = 0; rep < _repetitions; ++rep)
+			{
+				std::size_t ops = 0;
+				auto start = Clock::now();
+
+				do { ops += body(fixture); }
+				while (Clock::now() - start < MinTimePerRepetition());
+
+				samples.push_back(Nanoseconds(Clock::now() - start) / std::max(ops, std::size_t(1)));
+				opsPerRepetition = ops;
+			}
+
+			Report(name, size, param, samples, opsPerRepetition);
+		}
+
+	private:
+		template <typename Value>
+		static void ParseArgument(const char* arg, const char* prefix, Value& value)
+		{
+			auto length = std::strlen(prefix);
+			if (std::strncmp(arg, prefix, length) == 0) { Assign(arg + length, value); }
+		}
+
+		static void Assign(const char* text, std::string& value) { value = text; }
+		static void Assign(const char* text, std::size_t& value) { value = std::strtoull(text, nullptr, 10); }
+
+		static double Nanoseconds(Clock::duration duration)
+		{
+			return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+		}
+
+		Clock::duration MinTimePerRepetition() const { return std::chrono::milliseconds(_minMilliseconds); }
+
+		bool ShouldRun(const std::string& name, std::size_t size) const
+		{
+			return size <= _maxSize && name.find(_filter) != std::string::npos;
+		}
+
+		void Report(const std::string& name, std::size_t size, double param,
+					std::vector<double> samples, std::size_t opsPerRepetition)
+		{
+			std::sort(samples.begin(), samples.end());
+
+			Result result{ name, size, param, samples[samples.size() / 2], samples.front(), samples.back(), opsPerRepetition };
+			std::printf("{\"name\": \"%s\", \"size\": %zu, \"param\": %.3f, \"ns_per_op\": %.3f, "
+						"\"min_ns_per_op\": %.3f, \"max_ns_per_op\": %.3f, \"ops\": %zu, \"repetitions\": %zu}\n",
+						result.name.c_str(), result.size, result.param, result.nsPerOp,
+						result.minNsPerOp, result.maxNsPerOp, result.opsPerRepetition, _repetitions);
+			std::fflush(stdout);
+		}
+
+	private:
+		std::string _filter;
+		std::size_t _repetitions = 5;
+		std::size_t _maxSize = std::size_t(1) << 20;
+		std::size_t _minMilliseconds = 50;
+	};
+}
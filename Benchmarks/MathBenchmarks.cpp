@@ -0,0 +1,259 @@
+// Micro-benchmarks for the Sisu math operators: each one over arrays of
+// random operands, as Sisu::Scalar and as the operator itself, which is
+// SIMD if the build targets it; and the Sisu::Stream batch functions,
+// against loops over the operators. Standalone; on Linux:
+//
+//	g++ -std=c++14 -O2 -DNDEBUG -I../Sisu MathBenchmarks.cpp ../Sisu/SisuUtilities.cpp -o mathbench
+//	./mathbench [--filter=Quat] > results.jsonl
+//
+// Add -msse4.1 or -mavx2 (to both files) for the wider paths, or
+// -DSISU_MATH_SCALAR for none. "size" is the number of operand pairs per
+// iteration, small enough to stay in L1; "param" is 1 for the operator
+// or the stream version, 0 for the scalar reference or the loop.
+
+#include <random>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "SisuUtilities.h"
+
+namespace
+{
+	const std::size_t Sizes[] = { 256, 1024 };
+
+	template <typename A, typename B, typename R>
+	struct OperandFixture
+	{
+		std::vector<A> a;
+		std::vector<B> b;
+		std::vector<R> results;
+	};
+
+	struct RandomValues
+	{
+		float Next() { return std::uniform_real_distribution<float>(-2.0f, 2.0f)(random); }
+
+		Sisu::Vector3 Vector3() { return Sisu::Vector3(Next(), Next(), Next()); }
+		Sisu::Vector4 Vector4() { return Sisu::Vector4(Next(), Next(), Next(), Next()); }
+		Sisu::Matrix4 Matrix4() { return Sisu::Matrix4(Vector4(), Vector4(), Vector4(), Vector4()); }
+		Sisu::Affine3x4 Affine3x4() { return Sisu::Affine3x4(Vector4(), Vector4(), Vector4()); }
+		Sisu::Quat Quat() { return Sisu::Quat::Euler(Next() * 90.0f, Next() * 90.0f, Next() * 90.0f); }
+
+		std::mt19937 random{ 5 };
+	};
+
+	// Benchmarks result = op(a, b) over the arrays, once with the scalar
+	// version and once with the operator
+	template <typename A, typename B, typename R, typename MakeA, typename MakeB, typename ScalarOp, typename Op>
+	void CompareOps(Bench::Runner& runner, const std::string& name, std::size_t size,
+					MakeA makeA, MakeB makeB, ScalarOp scalarOp, Op op)
+	{
+		auto setup = [&]()
+		{
+			RandomValues values;
+			OperandFixture<A, B, R> fixture;
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				fixture.a.push_back(makeA(values));
+				fixture.b.push_back(makeB(values));
+			}
+			fixture.results.resize(size);
+			return fixture;
+		};
+
+		auto run = [&](OperandFixture<A, B, R>& fixture, auto f)
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				fixture.results[i] = f(fixture.a[i], fixture.b[i]);
+			}
+
+			Bench::DoNotOptimize(fixture.results[size - 1]);
+			return size;
+		};
+
+		runner.RunRepeated("Math/" + name + "/Scalar", size, 0.0, setup,
+			[&](OperandFixture<A, B, R>& fixture) { return run(fixture, scalarOp); });
+		runner.RunRepeated("Math/" + name + "/Operator", size, 1.0, setup,
+			[&](OperandFixture<A, B, R>& fixture) { return run(fixture, op); });
+	}
+
+	void MathBenchmarks(Bench::Runner& runner, std::size_t size)
+	{
+		using namespace Sisu;
+		auto matrix = [](RandomValues& v) { return v.Matrix4(); };
+		auto affine = [](RandomValues& v) { return v.Affine3x4(); };
+		auto vector3 = [](RandomValues& v) { return v.Vector3(); };
+		auto quat = [](RandomValues& v) { return v.Quat(); };
+		auto weight = [](RandomValues& v) { return v.Next() * 0.25f + 0.5f; };
+
+		CompareOps<Matrix4, Matrix4, Matrix4>(runner, "Matrix4/Multiply", size, matrix, matrix,
+			[](const Matrix4& a, const Matrix4& b) { return Scalar::Multiply(a, b); },
+			[](const Matrix4& a, const Matrix4& b) { return a * b; });
+
+		CompareOps<Vector3, Matrix4, Vector3>(runner, "Matrix4/MultiplyVector3", size, vector3, matrix,
+			[](const Vector3& v, const Matrix4& m) { return Scalar::Multiply(v, m); },
+			[](const Vector3& v, const Matrix4& m) { return v * m; });
+
+		CompareOps<Matrix4, float, Matrix4>(runner, "Matrix4/Lerp", size, matrix, weight,
+			[](const Matrix4& a, float t) { return Scalar::Lerp(a, Matrix4::Identity(), t); },
+			[](const Matrix4& a, float t) { return Lerp(a, Matrix4::Identity(), t); });
+
+		CompareOps<Affine3x4, Affine3x4, Affine3x4>(runner, "Affine3x4/Multiply", size, affine, affine,
+			[](const Affine3x4& a, const Affine3x4& b) { return Scalar::Multiply(a, b); },
+			[](const Affine3x4& a, const Affine3x4& b) { return a * b; });
+
+		CompareOps<Affine3x4, Vector3, Vector3>(runner, "Affine3x4/TransformPoint", size, affine, vector3,
+			[](const Affine3x4& m, const Vector3& p) { return Scalar::TransformPoint(m, p); },
+			[](const Affine3x4& m, const Vector3& p) { return m.TransformPoint(p); });
+
+		CompareOps<Affine3x4, Affine3x4, Affine3x4>(runner, "Affine3x4/Lerp", size, affine, affine,
+			[](const Affine3x4& a, const Affine3x4& b) { return Scalar::Lerp(a, b, 0.3f); },
+			[](const Affine3x4& a, const Affine3x4& b) { return Lerp(a, b, 0.3f); });
+
+		CompareOps<Quat, Quat, Quat>(runner, "Quat/Multiply", size, quat, quat,
+			[](const Quat& a, const Quat& b) { return Scalar::Multiply(a, b); },
+			[](const Quat& a, const Quat& b) { return a * b; });
+	}
+
+	// Operands for the Sisu::Stream functions, one array per component
+	struct StreamFixture
+	{
+		explicit StreamFixture(std::size_t size) : matrices(size), results(size)
+		{
+			RandomValues values;
+			for (auto& component : vectors) { component.resize(size); }
+			for (auto& component : quats) { component.resize(size); }
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				matrices[i] = values.Matrix4();
+				auto v = values.Vector3();
+				auto q = values.Quat();
+				vectors[0][i] = v.x, vectors[1][i] = v.y, vectors[2][i] = v.z;
+				quats[0][i] = q.x, quats[1][i] = q.y, quats[2][i] = q.z, quats[3][i] = q.w;
+			}
+
+			shared = values.Matrix4();
+			transform = values.Affine3x4();
+		}
+
+		Sisu::Stream::Vector3Span<float> Vectors(int set = 0) { return Sisu::Stream::Vector3Span<float>(vectors[set * 3].data(), vectors[set * 3 + 1].data(), vectors[set * 3 + 2].data()); }
+		Sisu::Stream::QuatSpan<float> Quats(int set = 0) { return Sisu::Stream::QuatSpan<float>(quats[set * 4].data(), quats[set * 4 + 1].data(), quats[set * 4 + 2].data(), quats[set * 4 + 3].data()); }
+
+		std::vector<Sisu::Matrix4> matrices;
+		std::vector<Sisu::Matrix4> results;
+		std::vector<float> vectors[6];
+		std::vector<float> quats[8];
+		Sisu::Matrix4 shared;
+		Sisu::Affine3x4 transform;
+	};
+
+	// The Sisu::Stream functions, against a loop over the single-element
+	// operators on the same arrays; "param" is 1 for the stream version
+	void StreamBenchmarks(Bench::Runner& runner, std::size_t size)
+	{
+		using namespace Sisu;
+		auto setup = [size]() { return StreamFixture(size); };
+
+		runner.RunRepeated("Math/Stream/MultiplyMatrix4/Loop", size, 0.0, setup, [size](StreamFixture& f)
+		{
+			for (std::size_t i = 0; i < size; ++i) { f.results[i] = f.matrices[i] * f.shared; }
+			Bench::DoNotOptimize(f.results[size - 1]);
+			return size;
+		});
+		runner.RunRepeated("Math/Stream/MultiplyMatrix4/Stream", size, 1.0, setup, [size](StreamFixture& f)
+		{
+			Stream::Multiply(f.matrices.data(), f.shared, f.results.data(), size);
+			Bench::DoNotOptimize(f.results[size - 1]);
+			return size;
+		});
+
+		runner.RunRepeated("Math/Stream/TransformPoints/Loop", size, 0.0, setup, [size](StreamFixture& f)
+		{
+			auto in = f.Vectors(0), out = f.Vectors(1);
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				auto p = f.transform.TransformPoint(Vector3(in.x[i], in.y[i], in.z[i]));
+				out.x[i] = p.x, out.y[i] = p.y, out.z[i] = p.z;
+			}
+			Bench::DoNotOptimize(f.vectors[3][size - 1]);
+			return size;
+		});
+		runner.RunRepeated("Math/Stream/TransformPoints/Stream", size, 1.0, setup, [size](StreamFixture& f)
+		{
+			Stream::TransformPoints(f.transform, f.Vectors(0), f.Vectors(1), size);
+			Bench::DoNotOptimize(f.vectors[3][size - 1]);
+			return size;
+		});
+
+		runner.RunRepeated("Math/Stream/MultiplyQuat/Loop", size, 0.0, setup, [size](StreamFixture& f)
+		{
+			auto a = f.Quats(0), out = f.Quats(1);
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				auto q = Quat(a.x[i], a.y[i], a.z[i], a.w[i]) * Quat(a.w[i], a.z[i], a.y[i], a.x[i]);
+				out.x[i] = q.x, out.y[i] = q.y, out.z[i] = q.z, out.w[i] = q.w;
+			}
+			Bench::DoNotOptimize(f.quats[4][size - 1]);
+			return size;
+		});
+		runner.RunRepeated("Math/Stream/MultiplyQuat/Stream", size, 1.0, setup, [size](StreamFixture& f)
+		{
+			auto a = f.Quats(0);
+			Stream::Multiply(a, Stream::QuatSpan<float>(a.w, a.z, a.y, a.x), f.Quats(1), size);
+			Bench::DoNotOptimize(f.quats[4][size - 1]);
+			return size;
+		});
+
+		runner.RunRepeated("Math/Stream/NormalizeQuat/Loop", size, 0.0, setup, [size](StreamFixture& f)
+		{
+			auto q = f.Quats(0);
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				Quat n(q.x[i], q.y[i], q.z[i], q.w[i]);
+				n.Normalize();
+				q.x[i] = n.x, q.y[i] = n.y, q.z[i] = n.z, q.w[i] = n.w;
+			}
+			Bench::DoNotOptimize(f.quats[0][size - 1]);
+			return size;
+		});
+		runner.RunRepeated("Math/Stream/NormalizeQuat/Stream", size, 1.0, setup, [size](StreamFixture& f)
+		{
+			Stream::Normalize(f.Quats(0), size);
+			Bench::DoNotOptimize(f.quats[0][size - 1]);
+			return size;
+		});
+
+		runner.RunRepeated("Math/Stream/EulerToQuat/Loop", size, 0.0, setup, [size](StreamFixture& f)
+		{
+			auto degrees = f.Vectors(0);
+			auto out = f.Quats(1);
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				auto q = Quat::Euler(degrees.x[i], degrees.y[i], degrees.z[i]);
+				out.x[i] = q.x, out.y[i] = q.y, out.z[i] = q.z, out.w[i] = q.w;
+			}
+			Bench::DoNotOptimize(f.quats[4][size - 1]);
+			return size;
+		});
+		runner.RunRepeated("Math/Stream/EulerToQuat/Stream", size, 1.0, setup, [size](StreamFixture& f)
+		{
+			Stream::EulerToQuat(f.Vectors(0), f.Quats(1), size);
+			Bench::DoNotOptimize(f.quats[4][size - 1]);
+			return size;
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Bench::Runner runner(argc, argv);
+
+	for (auto size : Sizes)
+	{
+		MathBenchmarks(runner, size);
+		StreamBenchmarks(runner, size);
+	}
+
+	return 0;
+}
@@ -0,0 +1,432 @@
+// Benchmarks for the per-tick passes over all game objects: the transform
+// update, and packing the instance data for the renderer. Each one runs on
+// the app's component-split arena (GameObjectArena), and on a plain
+// Arena<GameObject> for comparison. The parallel versions of both run on
+// 1, 2, 4... threads, up to one per core; packing writes to a plain array,
+// standing in for the upload heap. Standalone; on Linux:
+//
+//	g++ -std=c++14 -O2 -DNDEBUG -I../Sisu TransformBenchmarks.cpp ../Sisu/GameObject.cpp ../Sisu/SisuUtilities.cpp ../Sisu/TransformKernel.cpp ../Sisu/TransformUpdateSystem.cpp ../Sisu/GameTimer.cpp -pthread -o transformbench
+//	./transformbench [--filter=Instances] > results.jsonl
+//
+// "param" in the output is the share of objects that move; the others are
+// static, and only the transform update can skip them. For the parallel
+// update and packing, it's the thread count instead, and for the compose
+// kernels, the number of objects per iteration.
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Benchmark.h"
+#include "Arena.h"
+#include "GameObject.h"
+#include "GameObjectStorage.h"
+#include "TransformKernel.h"
+#include "TransformUpdateSystem.h"
+#include "JobSystem.h"
+#include "InstancePacking.h"
+
+namespace
+{
+	typedef Arena<GameObject, PagedStorage<GameObject>> PlainArena;
+
+	const std::size_t Sizes[] = { 1 << 14, 1 << 17, 1 << 20 };
+	const std::size_t ParallelSizes[] = { 10000, 100000, 1000000 };
+	const std::size_t SpinningSize = 100000;
+	const std::size_t KidsPerRoot = 15;
+	const float UpdatePeriod = 0.016f;
+
+	// What BrickRenderer::GatherInstances writes per visible object:
+	// FRObjectConstants, without DirectX
+	struct InstanceData
+	{
+		Sisu::Affine3x4 world;
+		Sisu::Color color;
+		Sisu::Color borderColor;
+		Sisu::Vector3 localScale;
+		float padding;
+	};
+
+	GameObject MakeObject(std::size_t serial, bool isMoving)
+	{
+		GameObject go;
+		go.localPosition = Sisu::Vector3(float(serial % 7), 0.0f, 1.0f);
+		go.velocityPerSec = isMoving ? Sisu::Vector3(0.1f, 0.0f, 0.0f) : Sisu::Vector3::Zero();
+		go.eulerRotPerSec = isMoving ? Sisu::Vector3(0.0f, 45.0f, 0.0f) : Sisu::Vector3::Zero();
+		go.borderColor = Sisu::Color::White();
+		go.isVisible = serial % 8 != 0;
+		return go;
+	}
+
+	// Roots, each with a family of kids right behind it; one in
+	// `movingEvery` families moves
+	template <typename Storage>
+	std::unique_ptr<Arena<GameObject, Storage>> MakeScene(std::size_t size, std::size_t movingEvery = 1)
+	{
+		std::unique_ptr<Arena<GameObject, Storage>> arena(new Arena<GameObject, Storage>(size));
+		std::vector<GameObject> kids;
+		for (std::size_t serial = 0; arena->ItemCount() + KidsPerRoot < size; serial += KidsPerRoot + 1)
+		{
+			auto isMoving = (serial / (KidsPerRoot + 1)) % movingEvery == 0;
+			auto root = GameObject::AddToArena(*arena, MakeObject(serial, isMoving));
+
+			kids.clear();
+			for (std::size_t i = 1; i <= KidsPerRoot; ++i) { kids.push_back(MakeObject(serial + i, isMoving)); }
+			GameObject::AddChildren(*arena, root, kids.begin(), kids.end());
+		}
+
+		return arena;
+	}
+
+	// Trees of `subtreeSize` objects, where every object has up to `fanOut`
+	// kids, until there are `size` objects
+	std::unique_ptr<GameObjectArena> MakeForest(std::size_t size, std::size_t fanOut, std::size_t subtreeSize)
+	{
+		std::unique_ptr<GameObjectArena> arena(new GameObjectArena(size));
+		std::vector<GameObject> kids;
+		std::vector<std::size_t> queue;
+		std::size_t serial = 0;
+
+		while (arena->ItemCount() < size)
+		{
+			auto treeEnd = std::min(arena->ItemCount() + subtreeSize, size);
+			queue.assign(1, GameObject::AddToArena(*arena, MakeObject(serial++, true)));
+
+			for (std::size_t next = 0; next < queue.size() && arena->ItemCount() < treeEnd; ++next)
+			{
+				kids.clear();
+				while (kids.size() < fanOut && arena->ItemCount() + kids.size() < treeEnd) { kids.push_back(MakeObject(serial++, true)); }
+
+				auto first = GameObject::AddChildren(*arena, queue[next], kids.begin(), kids.end());
+				for (auto i = first; i < first + kids.size(); ++i) { queue.push_back(i); }
+			}
+		}
+
+		return arena;
+	}
+
+	// TransformUpdateSystem::DoUpdate as it was before the component split,
+	// on whole objects
+	std::size_t UpdatePlain(PlainArena& bricks, std::vector<GameObject*>& queue)
+	{
+		queue.clear();
+		bricks.ForEachLiveRun([&](GameObject* first, GameObject* last, std::size_t)
+		{
+			for (auto brick = first; brick != last; ++brick)
+			{
+				if (brick->isRoot) { queue.push_back(brick); }
+			}
+		});
+
+		for (std::size_t next = 0; next < queue.size(); ++next)
+		{
+			auto brick = queue[next];
+			brick->localPosition += brick->velocityPerSec * UpdatePeriod;
+			brick->rotQuat = Sisu::Quat::Euler(brick->eulerRotPerSec * UpdatePeriod) * brick->rotQuat;
+
+			auto parentTransform = brick->isRoot ? nullptr : &bricks[brick->parentIndex].transform;
+			brick->RefreshTransform(parentTransform);
+
+			if (brick->hasChildren)
+			{
+				for (auto i = brick->childrenStartIndex; i <= brick->childrenEndIndex; ++i) { queue.push_back(&bricks[i]); }
+			}
+		}
+
+		return queue.size();
+	}
+
+	std::size_t PackPlain(const PlainArena& bricks, std::vector<InstanceData>& instances)
+	{
+		std::size_t count = 0;
+		bricks.ForEachLiveRun([&](const GameObject* first, const GameObject* last, std::size_t)
+		{
+			for (auto brick = first; brick != last; ++brick)
+			{
+				if (brick->isVisible)
+				{
+					instances[count++] = InstanceData{ brick->transform, brick->color, brick->borderColor, brick->localScale, 0.0f };
+				}
+			}
+		});
+
+		return count;
+	}
+
+	// BrickRenderer's packing loop, serial and without the interpolation
+	std::size_t PackComponents(const GameObjectArena& bricks, std::vector<InstanceData>& instances)
+	{
+		const auto& storage = bricks.GetStorage();
+		auto transforms = storage.Transforms();
+		auto motions = storage.Motion();
+		auto colds = storage.Cold();
+
+		std::size_t count = 0;
+		bricks.ForEachLiveRange([&](std::size_t first, std::size_t last)
+		{
+			for (auto index = first; index < last; ++index)
+			{
+				const auto& cold = colds[index];
+				if (cold.isVisible)
+				{
+					instances[count++] = InstanceData{ transforms[index], cold.color, cold.borderColor, motions[index].localScale, 0.0f };
+				}
+			}
+		});
+
+		return count;
+	}
+
+	void TransformBenchmarks(Bench::Runner& runner, std::size_t size)
+	{
+		typedef std::pair<std::unique_ptr<GameObjectArena>, std::unique_ptr<TransformUpdateSystem>> SystemFixture;
+
+		runner.RunRepeated("Transforms/Update/Plain", size, 1.0,
+			[&]() { return std::make_pair(MakeScene<PagedStorage<GameObject>>(size), std::vector<GameObject*>()); },
+			[&](std::pair<std::unique_ptr<PlainArena>, std::vector<GameObject*>>& fixture)
+		{
+			return UpdatePlain(*fixture.first, fixture.second);
+		});
+
+		// Mostly static scenes: only the moving families (and the first
+		// update) should cost anything
+		for (std::size_t movingEvery : { 1, 16 })
+		{
+			runner.RunRepeated("Transforms/Update/Components", size, 1.0 / movingEvery,
+				[&]() { return SystemFixture(MakeScene<GameObjectStorage>(size, movingEvery), std::unique_ptr<TransformUpdateSystem>(new TransformUpdateSystem())); },
+				[&](SystemFixture& fixture)
+			{
+				fixture.second->DoUpdate(*fixture.first);
+				return fixture.first->ItemCount();
+			});
+		}
+
+		runner.RunRepeated("Transforms/Instances/Plain", size, 1.0,
+			[&]() { return std::make_pair(MakeScene<PagedStorage<GameObject>>(size), std::vector<InstanceData>(size)); },
+			[&](std::pair<std::unique_ptr<PlainArena>, std::vector<InstanceData>>& fixture)
+		{
+			Bench::DoNotOptimize(PackPlain(*fixture.first, fixture.second));
+			return fixture.first->ItemCount();
+		});
+
+		runner.RunRepeated("Transforms/Instances/Components", size, 1.0,
+			[&]() { return std::make_pair(MakeScene<GameObjectStorage>(size), std::vector<InstanceData>(size)); },
+			[&](std::pair<std::unique_ptr<GameObjectArena>, std::vector<InstanceData>>& fixture)
+		{
+			Bench::DoNotOptimize(PackComponents(*fixture.first, fixture.second));
+			return fixture.first->ItemCount();
+		});
+	}
+
+	// Every object spins, and nothing else: the transform update at its
+	// most rotation heavy
+	void SpinningBenchmarks(Bench::Runner& runner)
+	{
+		typedef std::pair<std::unique_ptr<GameObjectArena>, std::unique_ptr<TransformUpdateSystem>> SystemFixture;
+
+		runner.RunRepeated("Transforms/Update/Spinning", SpinningSize, 1.0,
+			[&]()
+		{
+			auto arena = MakeScene<GameObjectStorage>(SpinningSize);
+			auto motions = arena->GetStorage().Motion();
+			arena->ForEachLiveRange([&](std::size_t first, std::size_t last)
+			{
+				for (auto index = first; index < last; ++index) { motions[index].velocityPerSec = Sisu::Vector3::Zero(); }
+			});
+
+			return SystemFixture(std::move(arena), std::unique_ptr<TransformUpdateSystem>(new TransformUpdateSystem()));
+		},
+			[&](SystemFixture& fixture)
+		{
+			fixture.second->DoUpdate(*fixture.first);
+			return fixture.first->ItemCount();
+		});
+	}
+
+	// Inputs for the compose kernels: one array per component, every other
+	// object under a parent
+	struct ComposeFixture
+	{
+		explicit ComposeFixture(std::size_t size) : parentTransforms(size), parents(size), results(size), outputs(size)
+		{
+			for (int component = 0; component < 10; ++component) { values[component].resize(size); }
+
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				auto rotation = Sisu::Quat::Euler(float(i % 360), 45.0f, 0.0f);
+				float object[10] = { float(i % 7), 0.0f, 1.0f, 1.0f, 0.5f, 2.0f, rotation.x, rotation.y, rotation.z, rotation.w };
+				for (int component = 0; component < 10; ++component) { values[component][i] = object[component]; }
+
+				parentTransforms[i] = GameObject::ComputeTransform(Sisu::Vector3(1.0f, 1.0f, 1.0f), rotation, Sisu::Vector3(float(i % 5), 2.0f, 0.0f), nullptr);
+				parents[i] = i % 2 == 0 ? &parentTransforms[i] : nullptr;
+				outputs[i] = &results[i];
+			}
+		}
+
+		TransformBatch Batch() const
+		{
+			return TransformBatch{ values[0].data(), values[1].data(), values[2].data(), values[3].data(), values[4].data(),
+								   values[5].data(), values[6].data(), values[7].data(), values[8].data(), values[9].data(),
+								   parents.data(), outputs.data() };
+		}
+
+		std::vector<float> values[10];
+		std::vector<Sisu::Affine3x4> parentTransforms;
+		std::vector<const Sisu::Affine3x4*> parents;
+		std::vector<Sisu::Affine3x4> results;
+		std::vector<Sisu::Affine3x4*> outputs;
+	};
+
+	// Just the math of the transform update: GameObject::ComputeTransform,
+	// vs the batch kernels
+	void ComposeBenchmarks(Bench::Runner& runner, std::size_t size)
+	{
+		runner.RunRepeated("Transforms/Compose/Reference", size, 1.0,
+			[&]() { return ComposeFixture(size); },
+			[&](ComposeFixture& fixture)
+		{
+			const auto& v = fixture.values;
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				fixture.results[i] = GameObject::ComputeTransform(Sisu::Vector3(v[3][i], v[4][i], v[5][i]), Sisu::Quat(v[6][i], v[7][i], v[8][i], v[9][i]),
+																  Sisu::Vector3(v[0][i], v[1][i], v[2][i]), fixture.parents[i]);
+			}
+
+			Bench::DoNotOptimize(fixture.results[size - 1]);
+			return size;
+		});
+
+		struct KindName { TransformKernel::Kind kind; const char* name; double lanes; };
+		const KindName kinds[] = { { TransformKernel::Kind::Scalar, "Scalar", 1.0 }, { TransformKernel::Kind::Sse, "Sse", 4.0 },
+								   { TransformKernel::Kind::Avx2, "Avx2", 8.0 } };
+		for (const auto& kind : kinds)
+		{
+			if (!TransformKernel::IsSupported(kind.kind)) { continue; }
+
+			runner.RunRepeated(std::string("Transforms/Compose/") + kind.name, size, kind.lanes,
+				[&]() { return ComposeFixture(size); },
+				[&](ComposeFixture& fixture)
+			{
+				TransformKernel::Compose(fixture.Batch(), size, kind.kind);
+				Bench::DoNotOptimize(fixture.results[size - 1]);
+				return size;
+			});
+		}
+	}
+
+	// Powers of two, and one thread per core
+	std::vector<std::size_t> ThreadCounts()
+	{
+		std::size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+		std::vector<std::size_t> threadCounts;
+		for (std::size_t threads = 1; threads < cores; threads *= 2) { threadCounts.push_back(threads); }
+		threadCounts.push_back(cores);
+		return threadCounts;
+	}
+
+	struct ParallelFixture
+	{
+		std::unique_ptr<GameObjectArena> arena;
+		std::unique_ptr<JobSystem> jobs;
+		std::unique_ptr<TransformUpdateSystem> system;
+	};
+
+	// Wall time per object vs thread count, for a few hierarchy shapes:
+	// many small families, deep binary trees, and one wide tree.
+	void ParallelBenchmarks(Bench::Runner& runner, std::size_t size)
+	{
+		struct Shape { const char* name; std::size_t fanOut; std::size_t subtreeSize; };
+		const Shape shapes[] = { { "Flat", 15, 16 }, { "Deep", 2, 1023 }, { "Wide", 64, size } };
+
+		for (const auto& shape : shapes)
+		{
+			for (auto threads : ThreadCounts())
+			{
+				runner.RunRepeated(std::string("Transforms/Parallel/") + shape.name, size, double(threads),
+					[&]()
+				{
+					ParallelFixture fixture;
+					fixture.arena = MakeForest(size, shape.fanOut, shape.subtreeSize);
+					fixture.jobs.reset(new JobSystem(threads));
+					fixture.system.reset(new TransformUpdateSystem());
+					fixture.system->SetJobSystem(fixture.jobs.get());
+					return fixture;
+				},
+					[&](ParallelFixture& fixture)
+				{
+					fixture.system->DoUpdate(*fixture.arena);
+					return fixture.arena->ItemCount();
+				});
+			}
+		}
+	}
+
+	struct PackingFixture
+	{
+		std::unique_ptr<GameObjectArena> arena;
+		std::unique_ptr<JobSystem> jobs;
+		ChunkedGather gather;
+		std::vector<InstanceData> uploadHeap;
+	};
+
+	// BrickRenderer::GatherInstances, interpolation included: converts
+	// chunks of the arena on all threads, each one straight into its place
+	// in the output
+	void ParallelPackingBenchmarks(Bench::Runner& runner, std::size_t size)
+	{
+		for (auto threads : ThreadCounts())
+		{
+			runner.RunRepeated("Transforms/Instances/Parallel", size, double(threads),
+				[&]()
+			{
+				PackingFixture fixture;
+				fixture.arena = MakeScene<GameObjectStorage>(size);
+				fixture.jobs.reset(new JobSystem(threads));
+				fixture.uploadHeap.resize(size);
+				return fixture;
+			},
+				[&](PackingFixture& fixture)
+			{
+				const auto& storage = fixture.arena->GetStorage();
+				auto transforms = storage.Transforms();
+				auto previousTransforms = storage.PreviousTransforms();
+				auto motions = storage.Motion();
+				auto colds = storage.Cold();
+				auto isVisible = [colds](std::size_t index) { return colds[index].isVisible; };
+				auto uploadHeap = fixture.uploadHeap.data();
+
+				auto count = fixture.gather.Count(fixture.jobs.get(), *fixture.arena, isVisible);
+				fixture.gather.Write(fixture.jobs.get(), isVisible, [&](std::uint32_t slot, std::size_t index)
+				{
+					const auto& cold = colds[index];
+					uploadHeap[slot] = InstanceData{ Sisu::Lerp(previousTransforms[index], transforms[index], 0.5f),
+													 cold.color, cold.borderColor, motions[index].localScale, 0.0f };
+				});
+
+				Bench::DoNotOptimize(uploadHeap[count - 1]);
+				return fixture.arena->ItemCount();
+			});
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Bench::Runner runner(argc, argv);
+
+	for (auto size : Sizes)
+	{
+		TransformBenchmarks(runner, size);
+		ComposeBenchmarks(runner, size);
+	}
+
+	SpinningBenchmarks(runner);
+
+	for (auto size : ParallelSizes)
+	{
+		ParallelBenchmarks(runner, size);
+		ParallelPackingBenchmarks(runner, size);
+	}
+
+	return 0;
+}
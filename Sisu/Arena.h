@@ -1,8 +1,16 @@
 #pragma once
 #include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "ArenaStorage.h"
+#include "GapIndex.h"
+#include "OccupancyBitmap.h"
 
 #define OUT 
 
@@ -18,42 +26,130 @@ struct Gap
 	}
 };
 
-template <typename T> struct ArenaIterator;
+// Stable reference to an item in an arena. Unlike a plain index, it keeps
+// pointing to the same item when the arena relocates it, and it becomes
+// invalid (instead of silently aliasing something else) once the item is
+// removed, even if the slot gets reused.
+struct ArenaHandle
+{
+	static const std::uint32_t InvalidId = UINT32_MAX;
+
+	ArenaHandle() : id(InvalidId), generation(0) {}
+	ArenaHandle(std::uint32_t pid, std::uint32_t pgeneration) : id(pid), generation(pgeneration) {}
+
+	bool IsNull() const { return id == InvalidId; }
+
+	std::uint32_t id;
+	std::uint32_t generation;
+};
+
+static_assert(sizeof(ArenaHandle) == sizeof(std::uint64_t), "ArenaHandle should fit in 64 bits.");
+
+inline bool operator==(const ArenaHandle& a, const ArenaHandle& b) { return a.id == b.id && a.generation == b.generation; }
+inline bool operator!=(const ArenaHandle& a, const ArenaHandle& b) { return !(a == b); }
+
+// Snapshot of how full and how fragmented an arena is; cheap enough to
+// take every frame.
+struct ArenaStats
+{
+	std::size_t liveCount = 0;
+	std::size_t occupiedSize = 0;			// one past the last used (or reserved) slot
+	std::size_t gapCount = 0;
+	std::size_t largestGap = 0;
+	std::size_t freeCount = 0;				// free slots below occupiedSize
+	float fragmentation = 0.0f;				// 1 - largestGap / freeCount; 0 if all free slots are in one gap
+	std::size_t highWaterMark = 0;			// biggest occupiedSize so far
+	std::size_t relocationCount = 0;		// since the arena was created
+	std::size_t structuralOpCount = 0;		// adds, removes and relocations since ResetFrameCounters()
+};
+
+template <typename T, typename Storage> struct ArenaIterator;
 
-template <typename T>
+// Storage decides what happens on growth, see ArenaStorage.h; use
+// PagedStorage if pointers to items have to stay valid.
+template <typename T, typename Storage = ContiguousStorage<T>>
 class Arena
 {
-	friend struct ArenaIterator<T>;
+	friend struct ArenaIterator<T, Storage>;
 
 public:
+	// T& for the plain storages; a proxy for ones that split T up
+	typedef typename Storage::Reference Reference;
+	typedef typename Storage::ConstReference ConstReference;
+
 	Arena() : _actualSize(0), _begin(0), _end(0)
 	{
 	}
 
 	Arena(std::size_t reservedSize) : _actualSize(0), _begin(0), _end(0)
 	{
-		_items.reserve(reservedSize);
-		_isUsed.reserve(reservedSize);
+		_items.Reserve(reservedSize, _isUsed);
+		_isUsed.Reserve(reservedSize);
+		_handleIdOfSlot.reserve(reservedSize);
+		_handleSlots.reserve(reservedSize);
 	}
 
-	T& operator[](std::size_t index) { ThrowIfNotUsed(index); return _items[index]; }
-	const T& operator[](std::size_t index) const { ThrowIfNotUsed(index); return _items[index]; }
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	~Arena() { DestroyLiveItems(); }
+
+	Reference operator[](std::size_t index) { ThrowIfNotUsed(index); return _items[index]; }
+	ConstReference operator[](std::size_t index) const { ThrowIfNotUsed(index); return _items[index]; }
 
-	ArenaIterator<typename T> begin() 
+	ArenaIterator<T, Storage> begin() 
 	{ 
-		auto firstIndex = _actualSize > 0 ? (_isUsed[0] ? 0 : GetNextValidIndex(0)) : _end;
-		return ArenaIterator<T>(this, firstIndex);
+		return ArenaIterator<T, Storage>(this, _isUsed.NextSet(0, _end));
 	}
 
-	ArenaIterator<typename T> end() { return ArenaIterator<T>(this, _end); }
+	ArenaIterator<T, Storage> end() { return ArenaIterator<T, Storage>(this, _end); }
+
+	std::size_t AddAnywhere(const T& item) { return EmplaceAnywhere(item); }
+	std::size_t AddAnywhere(T&& item) { return EmplaceAnywhere(std::move(item)); }
+
+	// The range overloads construct each item from *it, so passing
+	// std::make_move_iterator()s moves the items in instead of copying.
+	template <typename Iterator> std::size_t AddAnywhere(Iterator begin, Iterator end);
 
-	std::size_t AddAnywhere(T item);
-	std::size_t AddAnywhere(typename std::vector<T>::iterator begin,
-		typename std::vector<T>::iterator end);
+	void AddAt(std::size_t index, const T& item) { EmplaceAt(index, item); }
+	void AddAt(std::size_t index, T&& item) { EmplaceAt(index, std::move(item)); }
+	template <typename Iterator> void AddAt(std::size_t index, Iterator begin, Iterator end);
 
-	void AddAt(std::size_t index, T item);
-	void AddAt(std::size_t index, typename std::vector<T>::iterator begin,
-		typename std::vector<T>::iterator end);
+	// Construct the item in place, from the given constructor arguments.
+	template <typename... Args> std::size_t EmplaceAnywhere(Args&&... args);
+	template <typename... Args> void EmplaceAt(std::size_t index, Args&&... args);
+
+	// Adds and removes between BeginBatch() and CommitBatch() leave the gap
+	// index alone, and it gets brought up to date in one go on commit, or
+	// whenever something has to look for a gap in between. Batches nest.
+	void BeginBatch() { _batchDepth++; }
+	void CommitBatch();
+
+	struct ScopedBatch
+	{
+		ScopedBatch(Arena& parena) : arena(parena) { arena.BeginBatch(); }
+		~ScopedBatch() { arena.CommitBatch(); }
+
+		ScopedBatch(const ScopedBatch&) = delete;
+		ScopedBatch& operator=(const ScopedBatch&) = delete;
+
+		Arena& arena;
+	};
+
+	// Reserved slots are taken out of the gaps, but they don't hold live
+	// items (yet). This is how other threads add items, see
+	// ConcurrentSpawner.h: EmplaceReserved only touches the slot itself, so
+	// it can run concurrently for different slots, as long as nothing else
+	// changes the arena meanwhile. Publishing makes the item live; unused
+	// slots have to be released.
+	std::size_t ReserveSlots(std::size_t count);
+	template <typename... Args> void EmplaceReserved(std::size_t index, Args&&... args);
+	void PublishReserved(std::size_t index);
+	void ReleaseReserved(std::size_t start, std::size_t count);
+
+	// Moves a live item into the free slot at `to` (or to the end of the
+	// arena); handles to the item stay valid.
+	void Relocate(std::size_t from, std::size_t to);
 
 	bool CanAddItemAt(std::size_t index) const;
 	bool CanAddItemsAt(std::size_t index, std::size_t count) const;
@@ -61,146 +157,358 @@ public:
 	void RemoveAt(std::size_t index, std::size_t count = 1);
 	void Clear();
 
+	// Drops the free slots at the end of the arena, if there are any.
+	void TrimEnd();
+
 	std::size_t GetStartIndexForGap(std::size_t requestedGapSize,
 									std::size_t preferredLocationIndex) const;
 
+	// Start of the first free range of the requested size at or after
+	// `fromIndex`; that might mean going past the current end.
+	std::size_t GetStartIndexForGapFrom(std::size_t requestedGapSize,
+										std::size_t fromIndex) const;
+
+	// Calls visit(first, last, firstIndex) for every contiguous run
+	// [first, last) of live items, so callers can loop over them
+	// without per-item occupancy checks. Needs a storage with T& references.
+	template <typename Visitor> void ForEachLiveRun(Visitor visit);
+	template <typename Visitor> void ForEachLiveRun(Visitor visit) const;
+
+	// Same, by index: visit(firstIndex, lastIndex) for every run of live
+	// items, for any storage. Runs aren't split where the storage is.
+	template <typename Visitor> void ForEachLiveRange(Visitor visit) const;
+
+	// For systems that work on the storage directly, e.g. on the component
+	// arrays of GameObjectStorage. Don't change its size through this.
+	Storage& GetStorage() { return _items; }
+	const Storage& GetStorage() const { return _items; }
+
+	ArenaHandle HandleAt(std::size_t index) const;
+	bool IsValid(ArenaHandle handle) const;
+	bool TryGetIndex(ArenaHandle handle, OUT std::size_t& index) const;
+	T* TryGet(ArenaHandle handle);
+	const T* TryGet(ArenaHandle handle) const;
+
 	void PrintGaps() const;
-	const std::size_t OccupiedSize() const { return _items.size(); }
+	ArenaStats GetStats() const;
+	void ResetFrameCounters() { _structuralOpCount = 0; }
+
+	// Changes whenever items get added, removed or moved, so that caches
+	// of indices (e.g. an update order) know when to rebuild.
+	std::size_t StructureVersion() const { return _structureVersion; }
+	const std::size_t OccupiedSize() const { return _items.Size(); }
 	const std::size_t ItemCount() const { return _actualSize; }
 
 private:
 	std::size_t GetNextValidIndex(std::size_t current) const;
 	bool TryFindBestFittingGap(std::size_t size, OUT std::size_t& placementIndex) const;
-	void RefreshGaps();
 	void ThrowIfNotUsed(std::size_t index) const;
 
+	void AttachHandle(std::size_t index);
+	void DetachHandle(std::size_t index);
+
+	template <typename... Args> void EmplaceInGap(std::size_t index, Args&&... args);
+	template <typename... Args> void EmplaceAtEnd(Args&&... args);
+	void DestroyLiveItems();
+
+	void MarkGapsUsed(std::size_t start, std::size_t count);
+	void MarkGapsFree(std::size_t start, std::size_t count);
+	void MarkGapsDirty(std::size_t start, std::size_t end);
+	void SyncGaps() const;
+
 private:
-	std::vector<T> _items;
-	std::vector<bool> _isUsed;
+	struct HandleSlot
+	{
+		std::uint32_t index;
+		std::uint32_t generation;
+	};
+
+	Storage _items;
+	OccupancyBitmap _isUsed;
 	std::size_t _actualSize;
-	std::vector<Gap> _gaps;
+
+	// Lazily synced during batches, see SyncGaps()
+	mutable GapIndex _gaps;
+	mutable std::vector<std::pair<std::size_t, std::size_t>> _dirtyGapRanges;
+	std::size_t _batchDepth = 0;
+
+	// Slot map: handle id -> current index + generation, and back
+	std::vector<HandleSlot> _handleSlots;
+	std::vector<std::uint32_t> _freeHandleIds;
+	std::vector<std::uint32_t> _handleIdOfSlot;
 
 	std::size_t _begin;
 	std::size_t _end;
+
+	std::size_t _highWaterMark = 0;
+	std::size_t _relocationCount = 0;
+	std::size_t _structuralOpCount = 0;
+	std::size_t _structureVersion = 0;
 };
 
-template <typename T>
-bool Arena<T>::CanAddItemAt(std::size_t index) const
+template <typename T, typename Storage>
+bool Arena<T, Storage>::CanAddItemAt(std::size_t index) const
 {
-	return (index < _end && !_isUsed[index]) || index == _end;
+	return (index < _end && !_isUsed.Test(index)) || index == _end;
 }
 
-template <typename T>
-bool Arena<T>::CanAddItemsAt(std::size_t index, std::size_t count) const
+template <typename T, typename Storage>
+bool Arena<T, Storage>::CanAddItemsAt(std::size_t index, std::size_t count) const
 {
 	if (index == _end) { return true; }
 
-	auto canAddItems = true;
-	for (std::size_t i = 0; i < count && index + i < _end; ++i)
-	{
-		if (_isUsed[index + i])
-		{
-			canAddItems = false;
-		}
-	}
-
-	return canAddItems;
+	auto limit = std::min(index + count, _end);
+	return _isUsed.NextSet(index, limit) == limit;
 }
 
-template <typename T>
-std::size_t Arena<T>::GetStartIndexForGap(std::size_t requestedGapSize, 
+template <typename T, typename Storage>
+std::size_t Arena<T, Storage>::GetStartIndexForGap(std::size_t requestedGapSize, 
 										  std::size_t preferredLocationIndex) const
 {
 	if (OccupiedSize() == 0) { return 0; }
 
-	std::size_t gapStartIndex = _end;
-	auto distance = INT_MAX;
-	auto foundSuitableGap = false;
+	SyncGaps();
+	auto gapStartIndex = _gaps.FindClosestFit(requestedGapSize, preferredLocationIndex);
+	if (gapStartIndex != GapIndex::None) { return gapStartIndex; }
+
+	// Nothing fits, so the items go to the end; but if the arena
+	// already ends in a gap, we can start from there.
+	auto trailingGapStart = _gaps.TrailingGapStart(_end);
+	return trailingGapStart != GapIndex::None ? trailingGapStart : _end;
+}
 
-	for (const auto& gap : _gaps)
+template <typename T, typename Storage>
+std::size_t Arena<T, Storage>::GetStartIndexForGapFrom(std::size_t requestedGapSize,
+											  std::size_t fromIndex) const
+{
+	SyncGaps();
+	auto gapStartIndex = _gaps.FindFirstFit(requestedGapSize, fromIndex);
+	if (gapStartIndex != GapIndex::None) { return gapStartIndex; }
+
+	auto trailingGapStart = _gaps.TrailingGapStart(_end);
+	if (trailingGapStart != GapIndex::None && fromIndex < _end)
 	{
-		if (gap.size >= requestedGapSize)
-		{
-			foundSuitableGap = true;
+		return std::max(trailingGapStart, fromIndex);
+	}
+
+	return _end;
+}
 
-			// get distance to gap start as well to gap end, use the smaller one
-			// if using gap end, calc gap start by gap end - gap size
+template <typename T, typename Storage>
+std::size_t Arena<T, Storage>::GetNextValidIndex(std::size_t current) const
+{
+	return _isUsed.NextSet(current + 1, _end);
+}
 
-			auto gapStart = gap.startIndex;
-			auto gapEnd = gap.startIndex + gap.size;
+template <typename T, typename Storage>
+template <typename Visitor>
+void Arena<T, Storage>::ForEachLiveRun(Visitor visit)
+{
+	auto first = _isUsed.NextSet(0, _end);
+	while (first < _end)
+	{
+		auto last = _isUsed.NextUnset(first, _items.ContiguousEnd(first, _end));
+		visit(&_items[first], &_items[last - 1] + 1, first);
+		first = _isUsed.NextSet(last, _end);
+	}
+}
 
-			auto distToStart = gapStart > preferredLocationIndex ? gapStart - preferredLocationIndex : preferredLocationIndex - gapStart;
-			auto distToEnd = gapEnd > preferredLocationIndex ? gapEnd - preferredLocationIndex : preferredLocationIndex - gapEnd;
-			auto useDistanceToStart = distToStart <= distToEnd;
-			
-			auto currDistance = useDistanceToStart ? distToStart : distToEnd;
+template <typename T, typename Storage>
+template <typename Visitor>
+void Arena<T, Storage>::ForEachLiveRun(Visitor visit) const
+{
+	auto first = _isUsed.NextSet(0, _end);
+	while (first < _end)
+	{
+		auto last = _isUsed.NextUnset(first, _items.ContiguousEnd(first, _end));
+		visit(&_items[first], &_items[last - 1] + 1, first);
+		first = _isUsed.NextSet(last, _end);
+	}
+}
 
-			if (currDistance < distance)
-			{
-				distance = currDistance;
-				gapStartIndex = useDistanceToStart ? gapStart : gapEnd - requestedGapSize;
-			}
-		}
-		else
-		{
-			break;
-		}
+template <typename T, typename Storage>
+template <typename Visitor>
+void Arena<T, Storage>::ForEachLiveRange(Visitor visit) const
+{
+	auto first = _isUsed.NextSet(0, _end);
+	while (first < _end)
+	{
+		auto last = _isUsed.NextUnset(first, _end);
+		visit(first, last);
+		first = _isUsed.NextSet(last, _end);
 	}
+}
+
+template <typename T, typename Storage>
+ArenaHandle Arena<T, Storage>::HandleAt(std::size_t index) const
+{
+	ThrowIfNotUsed(index);
+	auto id = _handleIdOfSlot[index];
+	return ArenaHandle(id, _handleSlots[id].generation);
+}
+
+template <typename T, typename Storage>
+bool Arena<T, Storage>::IsValid(ArenaHandle handle) const
+{
+	return handle.id < _handleSlots.size() && _handleSlots[handle.id].generation == handle.generation;
+}
+
+template <typename T, typename Storage>
+bool Arena<T, Storage>::TryGetIndex(ArenaHandle handle, OUT std::size_t& index) const
+{
+	if (!IsValid(handle)) { return false; }
+	index = _handleSlots[handle.id].index;
+	return true;
+}
+
+template <typename T, typename Storage>
+T* Arena<T, Storage>::TryGet(ArenaHandle handle)
+{
+	return IsValid(handle) ? &_items[_handleSlots[handle.id].index] : nullptr;
+}
 
-	if (foundSuitableGap) { return gapStartIndex; }
+template <typename T, typename Storage>
+const T* Arena<T, Storage>::TryGet(ArenaHandle handle) const
+{
+	return IsValid(handle) ? &_items[_handleSlots[handle.id].index] : nullptr;
+}
 
-	while (gapStartIndex > 0 && !_isUsed[gapStartIndex - 1])
+template <typename T, typename Storage>
+void Arena<T, Storage>::AttachHandle(std::size_t index)
+{
+	std::uint32_t id;
+	if (!_freeHandleIds.empty())
+	{
+		id = _freeHandleIds.back();
+		_freeHandleIds.pop_back();
+	}
+	else
 	{
-		gapStartIndex--;
+		id = static_cast<std::uint32_t>(_handleSlots.size());
+		_handleSlots.push_back(HandleSlot{ 0, 0 });
 	}
 
-	return gapStartIndex;
+	_handleSlots[id].index = static_cast<std::uint32_t>(index);
+	_handleIdOfSlot[index] = id;
+}
+
+template <typename T, typename Storage>
+void Arena<T, Storage>::DetachHandle(std::size_t index)
+{
+	// Bumping the generation invalidates every outstanding handle
+	// to the item, even once the id gets reused.
+	auto id = _handleIdOfSlot[index];
+	_handleSlots[id].generation++;
+	_freeHandleIds.push_back(id);
 }
 
-template <typename T>
-std::size_t Arena<T>::GetNextValidIndex(std::size_t current) const
+template <typename T, typename Storage>
+void Arena<T, Storage>::Relocate(std::size_t from, std::size_t to)
 {
-	std::size_t nextValid = current + 1;
+	ThrowIfNotUsed(from);
+	if (!CanAddItemAt(to)) { throw std::runtime_error("[Arena] Trying to relocate an item onto a used slot."); }
+
+	auto id = _handleIdOfSlot[from];
 
-	while (nextValid < _end && !_isUsed[nextValid])
+	if (to == _end)
 	{
-		nextValid++;
+		_items.EmplaceBack(_isUsed, std::move(_items[from]));
+		_isUsed.PushBack(true);
+		_handleIdOfSlot.push_back(id);
+		_end = _items.Size();
+		_highWaterMark = std::max(_highWaterMark, _end);
 	}
+	else
+	{
+		_items.Construct(to, std::move(_items[from]));
+		_isUsed.Set(to);
+		MarkGapsUsed(to, 1);
+		_handleIdOfSlot[to] = id;
+	}
+
+	_handleSlots[id].index = static_cast<std::uint32_t>(to);
 
-	return nextValid;
+	_items.Destroy(from);
+	_isUsed.Reset(from);
+	_relocationCount++;
+	_structuralOpCount++;
+	_structureVersion++;
+	MarkGapsFree(from, 1);
 }
 
-template <typename T>
-void Arena<T>::PrintGaps() const
+template <typename T, typename Storage>
+void Arena<T, Storage>::PrintGaps() const
 {
-	for (const auto& gap : _gaps) { gap.Print(); }
+	SyncGaps();
+	_gaps.ForEachBySize([](std::size_t start, std::size_t size) { Gap(start, size).Print(); });
 }
 
-template <typename T>
-void Arena<T>::ThrowIfNotUsed(std::size_t index) const
+template <typename T, typename Storage>
+ArenaStats Arena<T, Storage>::GetStats() const
 {
-	if (index >= _isUsed.size() || !_isUsed[index])
+	SyncGaps();
+
+	ArenaStats stats;
+	stats.liveCount = _actualSize;
+	stats.occupiedSize = _end;
+	stats.gapCount = _gaps.GapCount();
+	stats.largestGap = _gaps.LargestGap();
+	stats.freeCount = _gaps.FreeCount();
+	stats.fragmentation = stats.freeCount == 0 ? 0.0f : 1.0f - float(stats.largestGap) / float(stats.freeCount);
+	stats.highWaterMark = _highWaterMark;
+	stats.relocationCount = _relocationCount;
+	stats.structuralOpCount = _structuralOpCount;
+	return stats;
+}
+
+template <typename T, typename Storage>
+void Arena<T, Storage>::ThrowIfNotUsed(std::size_t index) const
+{
+	if (index >= _isUsed.Size() || !_isUsed.Test(index))
 	{
 		throw std::runtime_error("[Arena] Trying to access unused element.");
 	}
 }
 
-template <typename T>
-void Arena<T>::Clear()
+template <typename T, typename Storage>
+void Arena<T, Storage>::Clear()
 {
-	_items.clear();
-	_isUsed.clear();
-	_gaps.clear();
+	for (auto index = _isUsed.NextSet(0, _end); index < _end; index = _isUsed.NextSet(index + 1, _end))
+	{
+		DetachHandle(index);
+	}
+
+	DestroyLiveItems();
+	_items.Clear();
+	_handleIdOfSlot.clear();
+	_isUsed.Clear();
+	_gaps.Clear();
+	_dirtyGapRanges.clear();
 	_actualSize = 0;
 	_end = 0;
+	_structureVersion++;
+}
+
+template <typename T, typename Storage>
+void Arena<T, Storage>::TrimEnd()
+{
+	SyncGaps();
+	auto newEnd = _gaps.TrailingGapStart(_end);
+	if (newEnd == GapIndex::None) { return; }
+
+	_items.Truncate(newEnd);
+	_isUsed.Truncate(newEnd);
+	_handleIdOfSlot.resize(newEnd);
+	_gaps.Truncate(newEnd);
+	_end = newEnd;
 }
 
-template <typename T>
-std::size_t Arena<T>::AddAnywhere(typename std::vector<T>::iterator begin,
-	typename std::vector<T>::iterator end)
+template <typename T, typename Storage>
+template <typename Iterator>
+std::size_t Arena<T, Storage>::AddAnywhere(Iterator begin, Iterator end)
 {
 	std::size_t placementIndex;
-	std::size_t requestedSize = end - begin;
+	std::size_t requestedSize = std::distance(begin, end);
 
 	if (TryFindBestFittingGap(requestedSize, OUT placementIndex))
 	{
@@ -208,162 +516,282 @@ std::size_t Arena<T>::AddAnywhere(typename std::vector<T>::iterator begin,
 
 		while (begin != end)
 		{
-			_items[index] = *begin;
-			_isUsed[index] = true;
+			_items.Construct(index, *begin);
+			_isUsed.Set(index);
+			AttachHandle(index);
 			index++;
 			begin++;
 		}
 
 		_actualSize += requestedSize;
-		RefreshGaps();
+		_structuralOpCount += requestedSize;
+		_structureVersion++;
+		MarkGapsUsed(placementIndex, requestedSize);
 	}
 	else
 	{
-		placementIndex = _items.size();
+		placementIndex = _items.Size();
 
 		while (begin != end)
 		{
-			_items.push_back(*begin);
-			_isUsed.push_back(true);
+			EmplaceAtEnd(*begin);
 			begin++;
-			_actualSize++;
 		}
-
-		_end = _items.size();
 	}
 
 	return placementIndex;
 }
 
-template <typename T>
-void Arena<T>::AddAt(std::size_t index, typename std::vector<T>::iterator begin, typename std::vector<T>::iterator end)
+template <typename T, typename Storage>
+template <typename Iterator>
+void Arena<T, Storage>::AddAt(std::size_t index, Iterator begin, Iterator end)
 {
+	ScopedBatch batch(*this);
 	while (begin != end)
 	{
-		AddAt(index++, *begin);
+		EmplaceAt(index++, *begin);
 		begin++;
 	}
 }
 
-template <typename T>
-void Arena<T>::AddAt(std::size_t index, T item)
+template <typename T, typename Storage>
+template <typename... Args>
+void Arena<T, Storage>::EmplaceAt(std::size_t index, Args&&... args)
 {
 	if (index < _end)
 	{
-		_items[index] = item;
-		_isUsed[index] = true;
-		_actualSize++;
-		RefreshGaps();
+		if (_isUsed.Test(index))
+		{
+			// Overwriting: build the new item first, the arguments might
+			// refer to the old one.
+			T item(std::forward<Args>(args)...);
+			_items.Destroy(index);
+			_items.Construct(index, std::move(item));
+			_structureVersion++;
+		}
+		else
+		{
+			EmplaceInGap(index, std::forward<Args>(args)...);
+			MarkGapsUsed(index, 1);
+		}
 	}
 	else
 	{
 		if (index > _end) { throw std::runtime_error("[Arena] Trying to place items into an arena past its end."); }
-		_items.push_back(item);
-		_isUsed.push_back(true);
-		_actualSize++;
-		_end = _items.size();
+		EmplaceAtEnd(std::forward<Args>(args)...);
 	}
 }
 
-template <typename T>
-std::size_t Arena<T>::AddAnywhere(T item)
+template <typename T, typename Storage>
+template <typename... Args>
+std::size_t Arena<T, Storage>::EmplaceAnywhere(Args&&... args)
 {
 	std::size_t placementIndex;
 	if (TryFindBestFittingGap(1, OUT placementIndex))
 	{
-		_items[placementIndex] = item;
-		_isUsed[placementIndex] = true;
+		EmplaceInGap(placementIndex, std::forward<Args>(args)...);
+		MarkGapsUsed(placementIndex, 1);
+		return placementIndex;
+	}
 
-		_actualSize++;
+	EmplaceAtEnd(std::forward<Args>(args)...);
+	return _end - 1;
+}
 
-		RefreshGaps();
+// Doesn't update the gap index, so that callers filling a whole range
+// can do that in one go.
+template <typename T, typename Storage>
+template <typename... Args>
+void Arena<T, Storage>::EmplaceInGap(std::size_t index, Args&&... args)
+{
+	_items.Construct(index, std::forward<Args>(args)...);
+	_isUsed.Set(index);
+	AttachHandle(index);
+	_actualSize++;
+	_structuralOpCount++;
+	_structureVersion++;
+}
 
-		return placementIndex;
-	}
-	else
-	{
-		_items.push_back(item);
-		_isUsed.push_back(true);
+template <typename T, typename Storage>
+template <typename... Args>
+void Arena<T, Storage>::EmplaceAtEnd(Args&&... args)
+{
+	_items.EmplaceBack(_isUsed, std::forward<Args>(args)...);
+	_isUsed.PushBack(true);
+	_handleIdOfSlot.push_back(0);
+	AttachHandle(_end);
+	_actualSize++;
+	_end = _items.Size();
+	_highWaterMark = std::max(_highWaterMark, _end);
+	_structuralOpCount++;
+	_structureVersion++;
+}
 
-		_actualSize++;
-		_end = _items.size();
+template <typename T, typename Storage>
+void Arena<T, Storage>::DestroyLiveItems()
+{
+	if (std::is_trivially_destructible<T>::value) { return; }
 
-		return _items.size() - 1;
+	for (auto index = _isUsed.NextSet(0, _end); index < _end; index = _isUsed.NextSet(index + 1, _end))
+	{
+		_items.Destroy(index);
 	}
 }
 
-template <typename T>
-bool Arena<T>::TryFindBestFittingGap(std::size_t size, OUT std::size_t& placementIndex) const
+template <typename T, typename Storage>
+bool Arena<T, Storage>::TryFindBestFittingGap(std::size_t size, OUT std::size_t& placementIndex) const
 {
-	auto foundGap = false;
+	SyncGaps();
+	return _gaps.TryFindBestFit(size, OUT placementIndex);
+}
 
-	for (const auto& gap : _gaps)
+template <typename T, typename Storage>
+void Arena<T, Storage>::RemoveAt(std::size_t index, std::size_t count)
+{
+	auto end = std::min(index + count, _end);
+	auto runStart = _isUsed.NextSet(index, end);
+
+	// Free up runs of used items, so that each run is a single gap update
+	while (runStart < end)
 	{
-		if (gap.size >= size)
+		auto runEnd = _isUsed.NextUnset(runStart, end);
+		for (auto i = runStart; i < runEnd; ++i)
 		{
-			foundGap = true;
-			placementIndex = gap.startIndex;
+			_items.Destroy(i);
+			_isUsed.Reset(i);
+			DetachHandle(i);
 		}
-		else
-		{
-			break;
-		}
-	}
 
-	return foundGap;
+		_actualSize -= runEnd - runStart;
+		_structuralOpCount += runEnd - runStart;
+		_structureVersion++;
+		MarkGapsFree(runStart, runEnd - runStart);
+
+		runStart = _isUsed.NextSet(runEnd, end);
+	}
 }
 
-template <typename T>
-void Arena<T>::RefreshGaps()
+template <typename T, typename Storage>
+std::size_t Arena<T, Storage>::ReserveSlots(std::size_t count)
 {
-	_gaps.clear();
+	// Not deferred in batches: reserved slots aren't in the occupancy bits,
+	// so the gap index is the only place that knows about them.
+	std::size_t start;
+	if (TryFindBestFittingGap(count, OUT start))
+	{
+		_gaps.MarkUsed(start, count);
+		return start;
+	}
 
-	std::size_t gapStart = 0;
-	std::size_t gapSize = 0;
-	auto hasGaps = false;
+	// Nothing fits: take the trailing gap, if there's one, and grow the rest
+	start = _gaps.TrailingGapStart(_end);
+	if (start != GapIndex::None) { _gaps.MarkUsed(start, _end - start); }
+	else { start = _end; }
 
-	for (std::size_t i = 0; i < _items.size(); ++i)
+	auto growBy = start + count - _end;
+	_items.Extend(growBy, _isUsed);
+	for (std::size_t i = 0; i < growBy; ++i)
 	{
-		if (!_isUsed[i])
-		{
-			if (gapSize == 0) { gapStart = i; gapSize = 1; }
-			else { gapSize++; }
-		}
-		else
-		{
-			if (gapSize > 0)
-			{
-				_gaps.emplace_back(Gap(gapStart, gapSize));
-				gapSize = 0;
-			}
-		}
+		_isUsed.PushBack(false);
+		_handleIdOfSlot.push_back(0);
 	}
 
-	//Maybe there's a gap in the end
-	if (gapSize > 0)
+	_end = _items.Size();
+	_highWaterMark = std::max(_highWaterMark, _end);
+	return start;
+}
+
+template <typename T, typename Storage>
+template <typename... Args>
+void Arena<T, Storage>::EmplaceReserved(std::size_t index, Args&&... args)
+{
+	_items.Construct(index, std::forward<Args>(args)...);
+}
+
+template <typename T, typename Storage>
+void Arena<T, Storage>::PublishReserved(std::size_t index)
+{
+	_isUsed.Set(index);
+	AttachHandle(index);
+	_actualSize++;
+	_structuralOpCount++;
+	_structureVersion++;
+}
+
+template <typename T, typename Storage>
+void Arena<T, Storage>::ReleaseReserved(std::size_t start, std::size_t count)
+{
+	MarkGapsFree(start, count);
+}
+
+template <typename T, typename Storage>
+void Arena<T, Storage>::CommitBatch()
+{
+	if (_batchDepth > 0 && --_batchDepth == 0) { SyncGaps(); }
+}
+
+template <typename T, typename Storage>
+void Arena<T, Storage>::MarkGapsUsed(std::size_t start, std::size_t count)
+{
+	if (_batchDepth > 0) { MarkGapsDirty(start, start + count); }
+	else { _gaps.MarkUsed(start, count); }
+}
+
+template <typename T, typename Storage>
+void Arena<T, Storage>::MarkGapsFree(std::size_t start, std::size_t count)
+{
+	if (_batchDepth > 0) { MarkGapsDirty(start, start + count); }
+	else { _gaps.MarkFree(start, count); }
+}
+
+template <typename T, typename Storage>
+void Arena<T, Storage>::MarkGapsDirty(std::size_t start, std::size_t end)
+{
+	// Adding kids one by one touches consecutive slots, so try
+	// to keep that a single range
+	if (!_dirtyGapRanges.empty())
 	{
-		_gaps.emplace_back(Gap(gapStart, gapSize));
+		auto& last = _dirtyGapRanges.back();
+		if (start <= last.second && end >= last.first)
+		{
+			last.first = std::min(last.first, start);
+			last.second = std::max(last.second, end);
+			return;
+		}
 	}
 
-	std::sort(_gaps.begin(), _gaps.end(), [](const Gap& a, const Gap& b) { return a.size > b.size; });
+	_dirtyGapRanges.emplace_back(start, end);
 }
 
-template <typename T>
-void Arena<T>::RemoveAt(std::size_t index, std::size_t count)
+// Const, so that gap lookups can bring the index up to date
+template <typename T, typename Storage>
+void Arena<T, Storage>::SyncGaps() const
 {
-	for (std::size_t i = 0; i < count && (index + i) < _isUsed.size(); ++i)
+	if (_dirtyGapRanges.empty()) { return; }
+
+	std::sort(_dirtyGapRanges.begin(), _dirtyGapRanges.end());
+
+	auto range = _dirtyGapRanges.front();
+	for (const auto& next : _dirtyGapRanges)
 	{
-		_isUsed[index + i] = false;
+		if (next.first <= range.second)
+		{
+			range.second = std::max(range.second, next.second);
+			continue;
+		}
+
+		_gaps.Rescan(range.first, range.second, _isUsed);
+		range = next;
 	}
 
-	_actualSize -= count;
-	RefreshGaps();
+	_gaps.Rescan(range.first, range.second, _isUsed);
+	_dirtyGapRanges.clear();
 }
 
-template <typename T>
+template <typename T, typename Storage>
 struct ArenaIterator
 {
-	ArenaIterator(Arena<T>* const arena, std::size_t index)
+	ArenaIterator(Arena<T, Storage>* const arena, std::size_t index)
 		: arena(arena), index(index) {}
 
 	ArenaIterator& operator++()
@@ -372,23 +800,24 @@ struct ArenaIterator
 		return *this;
 	}
 
-	T& operator*()
+	// No occupancy check here: the iterator only ever stops on live items.
+	typename Storage::Reference operator*()
 	{
-		return (*arena)[index];
+		return arena->_items[index];
 	}
 
 	std::size_t index;
-	Arena<T>* const arena;
+	Arena<T, Storage>* const arena;
 };
 
-template <typename T>
-bool operator==(const ArenaIterator<T>& a, const ArenaIterator<T>& b)
+template <typename T, typename Storage>
+bool operator==(const ArenaIterator<T, Storage>& a, const ArenaIterator<T, Storage>& b)
 {
 	return a.arena == b.arena && a.index == b.index;
 }
 
-template <typename T>
-bool operator!=(const ArenaIterator<T>& a, const ArenaIterator<T>& b)
+template <typename T, typename Storage>
+bool operator!=(const ArenaIterator<T, Storage>& a, const ArenaIterator<T, Storage>& b)
 {
 	return !(a == b);
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "OccupancyBitmap.h"
+
+// Storage policies for Arena. Both hand out items by index; they differ in
+// what happens on growth. (GameObjectStorage.h has a third one, which
+// hands out proxies instead of references.)
+//
+// Slots are raw memory: an item only exists between Construct / EmplaceBack
+// and Destroy, so T doesn't need a default constructor. The storage doesn't
+// know which slots hold an item, that's what the arena's bitmap is for; the
+// arena has to destroy its items before the storage goes away.
+
+// One contiguous block: the whole arena is a single run in memory, but
+// growing past the capacity moves every live item to a new block.
+template <typename T>
+class ContiguousStorage
+{
+public:
+	typedef T& Reference;
+	typedef const T& ConstReference;
+
+	ContiguousStorage() = default;
+	ContiguousStorage(const ContiguousStorage&) = delete;
+	ContiguousStorage& operator=(const ContiguousStorage&) = delete;
+
+	void Reserve(std::size_t count, const OccupancyBitmap& live)
+	{
+		if (count > _capacity) { Reallocate(count, live); }
+	}
+
+	// Constructs an item in a new slot at the end. Like std::vector, the
+	// arguments may refer to live items, even if this has to grow.
+	template <typename... Args>
+	void EmplaceBack(const OccupancyBitmap& live, Args&&... args)
+	{
+		if (_size < _capacity)
+		{
+			Construct(_size, std::forward<Args>(args)...);
+		}
+		else
+		{
+			// Build the new item before moving the old ones, so that the
+			// arguments are still there to build it from.
+			auto capacity = std::max(std::size_t(16), 2 * _capacity);
+			std::unique_ptr<Slot[]> slots(new Slot[capacity]);
+			new (&slots[_size]) T(std::forward<Args>(args)...);
+
+			MoveLiveItems(slots.get(), live);
+			_slots = std::move(slots);
+			_capacity = capacity;
+		}
+
+		_size++;
+	}
+
+	// Adds `count` slots at the end, without constructing anything in them.
+	void Extend(std::size_t count, const OccupancyBitmap& live)
+	{
+		if (_size + count > _capacity) { Reallocate(std::max(_size + count, 2 * _capacity), live); }
+		_size += count;
+	}
+
+	// Slots past the new size must not hold items anymore.
+	void Truncate(std::size_t count) { _size = std::min(count, _size); }
+	void Clear() { _size = 0; }
+
+	std::size_t Size() const { return _size; }
+
+	template <typename... Args>
+	void Construct(std::size_t index, Args&&... args) { new (&_slots[index]) T(std::forward<Args>(args)...); }
+	void Destroy(std::size_t index) { (*this)[index].~T(); }
+
+	T& operator[](std::size_t index) { return *reinterpret_cast<T*>(&_slots[index]); }
+	const T& operator[](std::size_t index) const { return *reinterpret_cast<const T*>(&_slots[index]); }
+
+	// End of the run of items that are contiguous in memory, starting
+	// from `index`, capped at `limit`.
+	std::size_t ContiguousEnd(std::size_t /*index*/, std::size_t limit) const { return limit; }
+
+private:
+	using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+	void Reallocate(std::size_t capacity, const OccupancyBitmap& live)
+	{
+		std::unique_ptr<Slot[]> slots(new Slot[capacity]);
+		MoveLiveItems(slots.get(), live);
+		_slots = std::move(slots);
+		_capacity = capacity;
+	}
+
+	void MoveLiveItems(Slot* slots, const OccupancyBitmap& live)
+	{
+		for (auto index = live.NextSet(0, _size); index < _size; index = live.NextSet(index + 1, _size))
+		{
+			new (&slots[index]) T(std::move((*this)[index]));
+			Destroy(index);
+		}
+	}
+
+private:
+	std::unique_ptr<Slot[]> _slots;
+	std::size_t _capacity = 0;
+	std::size_t _size = 0;
+};
+
+// Fixed-size pages that never move once allocated: growing allocates a new
+// page and leaves existing items (and pointers to them) alone.
+template <typename T, std::size_t PageShift = 10>
+class PagedStorage
+{
+public:
+	static const std::size_t PageSize = std::size_t(1) << PageShift;
+	static const std::size_t PageMask = PageSize - 1;
+
+	typedef T& Reference;
+	typedef const T& ConstReference;
+
+	PagedStorage() = default;
+	PagedStorage(const PagedStorage&) = delete;
+	PagedStorage& operator=(const PagedStorage&) = delete;
+
+	void Reserve(std::size_t count, const OccupancyBitmap&) { _pages.reserve((count + PageMask) >> PageShift); }
+
+	template <typename... Args>
+	void EmplaceBack(const OccupancyBitmap&, Args&&... args)
+	{
+		if ((_size >> PageShift) == _pages.size())
+		{
+			_pages.emplace_back(new Slot[PageSize]);
+		}
+
+		Construct(_size, std::forward<Args>(args)...);
+		_size++;
+	}
+
+	void Extend(std::size_t count, const OccupancyBitmap&)
+	{
+		while (((_size + count + PageMask) >> PageShift) > _pages.size())
+		{
+			_pages.emplace_back(new Slot[PageSize]);
+		}
+
+		_size += count;
+	}
+
+	// Pages are kept around for reuse, only the size changes.
+	void Truncate(std::size_t count) { _size = std::min(count, _size); }
+	void Clear() { _size = 0; }
+
+	std::size_t Size() const { return _size; }
+
+	template <typename... Args>
+	void Construct(std::size_t index, Args&&... args) { new (&SlotAt(index)) T(std::forward<Args>(args)...); }
+	void Destroy(std::size_t index) { (*this)[index].~T(); }
+
+	T& operator[](std::size_t index) { return *reinterpret_cast<T*>(&SlotAt(index)); }
+	const T& operator[](std::size_t index) const { return *reinterpret_cast<const T*>(&SlotAt(index)); }
+
+	std::size_t ContiguousEnd(std::size_t index, std::size_t limit) const
+	{
+		return std::min(limit, (index | PageMask) + 1);
+	}
+
+private:
+	using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+	Slot& SlotAt(std::size_t index) { return _pages[index >> PageShift][index & PageMask]; }
+	const Slot& SlotAt(std::size_t index) const { return _pages[index >> PageShift][index & PageMask]; }
+
+private:
+	std::vector<std::unique_ptr<Slot[]>> _pages;
+	std::size_t _size = 0;
+};
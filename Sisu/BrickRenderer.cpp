@@ -40,6 +40,8 @@ void BrickRenderer::Update(const GameTimer& gt)
 {
 	_cameraService->Update(gt);
 	WaitForNextFrameResource();
+	GatherInstances();
+	CullInstances();
 	UpdateInstanceData();
 	UpdateUIInstanceData();
 }
@@ -75,30 +77,116 @@ void BrickRenderer::UpdateMainPassCB(const GameTimer& gt, const D3DCamera& activ
 	currPassCB->CopyData(activeCamera.CbvIndex(), _mainPassCB);
 }
 
-void BrickRenderer::UpdateInstanceData()
-{	
-	if (_dirtyFrameCount > 0)
+void BrickRenderer::SetDirtySlots(const OccupancyBitmap& slots, std::size_t first, std::size_t last)
+{
+	for (auto index = slots.NextSet(first, last); index < last; index = slots.NextSet(index + 1, last))
 	{
-		auto currentInstanceBuffer = _currentFrameResource->instanceBuffer.get();
+		_dirtySlots.push_back(index);
+	}
+}
 
-		UINT bufferIndex = 0;
-		for (auto& brick : *_bricks)
-		{
-			if (brick.isVisible)
-			{
-				DirectX::XMMATRIX worldMatrix = ToXMMatrix(brick.transform);
-				FRObjectConstants objConstants(worldMatrix);
-				objConstants.color = DirectX::XMFLOAT4(brick.color.r, brick.color.g, brick.color.b, brick.color.a);
-				objConstants.borderColor = DirectX::XMFLOAT4(brick.borderColor.r, brick.borderColor.g,
-															 brick.borderColor.b, brick.borderColor.a);
-				objConstants.localScale = DirectX::XMFLOAT3(brick.localScale.x, brick.localScale.y, brick.localScale.z);
-				currentInstanceBuffer->CopyData(bufferIndex++, objConstants);
-			}
-		}
+// The visible objects, interpolated, in the shape the shader takes them,
+// and their bounds for culling. Chunks of the arena get converted on all
+// threads, each straight into its place in _instances. Everything after
+// SetDirty, or when objects were added, removed or moved; otherwise only
+// the dirty slots, whose instances keep their places.
+void BrickRenderer::GatherInstances()
+{
+	const auto& storage = _bricks->GetStorage();
+	auto transforms = storage.Transforms();
+	auto previousTransforms = storage.PreviousTransforms();
+	auto motions = storage.Motion();
+	auto colds = storage.Cold();
+	auto isVisible = [colds](std::size_t index) { return colds[index].isVisible; };
+
+	auto convert = [&](std::uint32_t slot, std::size_t index)
+	{
+		const auto& cold = colds[index];
+		auto& objConstants = _instances[slot];
+		objConstants.worldMatrix = Sisu::Lerp(previousTransforms[index], transforms[index], _interpolationAlpha);
+		_instanceBounds.SetTransformedUnitCube(slot, objConstants.worldMatrix);
+		objConstants.color = DirectX::XMFLOAT4(cold.color.r, cold.color.g, cold.color.b, cold.color.a);
+		objConstants.borderColor = DirectX::XMFLOAT4(cold.borderColor.r, cold.borderColor.g,
+													 cold.borderColor.b, cold.borderColor.a);
+		const auto& localScale = motions[index].localScale;
+		objConstants.localScale = DirectX::XMFLOAT3(localScale.x, localScale.y, localScale.z);
+	};
 
-		_dirtyFrameCount--;
-		_drawableObjectCount = bufferIndex;
+	if (_needsFullGather || _bricks->StructureVersion() != _gatheredStructureVersion)
+	{
+		auto count = _gather.Count(_jobs, *_bricks, isVisible);
+		_instances.resize(count, FRObjectConstants(Sisu::Affine3x4::Identity()));
+		_instanceBounds.Resize(count);
+		_gather.Write(_jobs, isVisible, convert);
+
+		_needsFullGather = false;
+		_gatheredStructureVersion = _bricks->StructureVersion();
+		_needsPacking = true;
+	}
+	else if (!_dirtySlots.empty())
+	{
+		// In index order, so that the instances are in order too
+		std::sort(_dirtySlots.begin(), _dirtySlots.end());
+		_dirtySlots.erase(std::unique(_dirtySlots.begin(), _dirtySlots.end()), _dirtySlots.end());
+		_gather.WriteItems(_jobs, _dirtySlots, _regatheredInstances, convert);
 	}
+
+	_dirtySlots.clear();
+}
+
+// Cameras move every frame, so this runs every frame; the instances only
+// need packing again if what some camera sees has changed
+void BrickRenderer::CullInstances()
+{
+	_culledByCamera.resize(_cameraService->MaxCameraCount());
+	for (auto& visible : _culledByCamera)
+	{
+		visible.clear();
+	}
+
+	for (const auto& camera : _cameraService->GetActiveCameras())
+	{
+		auto frustum = Frustum::FromViewProjection(camera.ViewProjectionMatrix());
+		FrustumCulling::Cull(frustum, _instanceBounds, _culledByCamera[camera.CbvIndex()]);
+	}
+
+	if (_culledByCamera != _visibleByCamera)
+	{
+		std::swap(_culledByCamera, _visibleByCamera);
+		_needsPacking = true;
+	}
+}
+
+// Each camera's visible instances, one camera after the other. Only the
+// records that changed since this frame resource's last update get copied,
+// a run of consecutive slots at a time, after which it holds the latest
+// version, with the latest ranges.
+void BrickRenderer::UpdateInstanceData()
+{
+	if (_needsPacking)
+	{
+		_packedInstances.Pack(_instances, _visibleByCamera, _instanceBufferCapacity);
+		_needsPacking = false;
+	}
+	else if (!_regatheredInstances.empty())
+	{
+		_packedInstances.Repack(_instances, _visibleByCamera, _regatheredInstances);
+	}
+
+	_regatheredInstances.clear();
+
+	auto currentInstanceBuffer = _currentFrameResource->instanceBuffer.get();
+	auto uploadedCount = _packedInstances.CopyChangedSince(_currentFrameResource->instanceVersion,
+		[currentInstanceBuffer](std::uint32_t firstSlot, const FRObjectConstants* instances, std::uint32_t count)
+		{
+			currentInstanceBuffer->CopyRange(firstSlot, instances, count);
+		});
+	_currentFrameResource->instanceVersion = _packedInstances.Version();
+
+	_stats.instanceCount = _packedInstances.Size();
+	_stats.instancesTruncated = _packedInstances.TruncatedCount();
+	_stats.instancesUploaded = uploadedCount;
+	_stats.instanceBytesUploaded = uploadedCount * sizeof(FRObjectConstants);
 }
 
 void BrickRenderer::ClearRTVDSVforCamera(ID3D12GraphicsCommandList* cmdList, const D3DCamera& camera) const
@@ -145,13 +233,19 @@ std::size_t BrickRenderer::Draw(const GameTimer& gt)
 	auto maxCameraCount = _cameraService->MaxCameraCount();
 	for (const auto& camera : _cameraService->GetActiveCameras())
 	{
+		const auto& range = _packedInstances.Ranges()[camera.CbvIndex()];
+		if (range.count == 0)
+		{
+			continue;
+		}
+
 		auto passCBVhandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(_cbvHeap->GetGPUDescriptorHandleForHeapStart());
 		passCBVhandle.Offset(camera.CbvIndex(), _CbvSrvUavDescriptorSize);
 
 		_commandList->RSSetViewports(1, &camera.viewport);
 		_commandList->SetGraphicsRootDescriptorTable(0, passCBVhandle);
 
-		DrawBricks(_commandList.Get());
+		DrawBricks(_commandList.Get(), range);
 		drawCallCount++;
 	}
 
@@ -181,7 +275,9 @@ std::size_t BrickRenderer::Draw(const GameTimer& gt)
 	return drawCallCount;
 }
 
-void BrickRenderer::DrawBricks(ID3D12GraphicsCommandList* cmdList)
+// SV_InstanceID starts from 0 whatever StartInstanceLocation is, so the
+// shader also gets the range's first instance as a root constant
+void BrickRenderer::DrawBricks(ID3D12GraphicsCommandList* cmdList, const InstanceRange& range)
 {
 	auto buffer = _currentFrameResource->instanceBuffer->Resource();
 	auto brick = _geometries["shapeGeo"]->drawArgs["brick"];
@@ -190,7 +286,8 @@ void BrickRenderer::DrawBricks(ID3D12GraphicsCommandList* cmdList)
 	cmdList->IASetIndexBuffer(&_geometries["shapeGeo"]->GetIndexBufferView());
 	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	cmdList->SetGraphicsRootShaderResourceView(1, buffer->GetGPUVirtualAddress());
-	cmdList->DrawIndexedInstanced(brick.indexCount, _drawableObjectCount, brick.startIndexLocation, brick.baseVertexLocation, 0);
+	cmdList->SetGraphicsRoot32BitConstant(2, range.first, 0);
+	cmdList->DrawIndexedInstanced(brick.indexCount, range.count, brick.startIndexLocation, brick.baseVertexLocation, range.first);
 }
 
 void BrickRenderer::BuildShadersAndInputLayout()
@@ -216,14 +313,16 @@ void BrickRenderer::BuildRootSignatures()
 	//		= a descriptor table with 1 element for the per pass constant buffer
 	//				= update: 2 elements, b/c 2 cams
 	//		= a root descriptor for the instance data
+	//		= a root constant for the camera's first instance
 	CD3DX12_DESCRIPTOR_RANGE cbvTablePerPass;
 	cbvTablePerPass.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 2, 0);	// base register 0
 
-	CD3DX12_ROOT_PARAMETER slotRootParams[2];
+	CD3DX12_ROOT_PARAMETER slotRootParams[3];
 	slotRootParams[0].InitAsDescriptorTable(1, &cbvTablePerPass);
 	slotRootParams[1].InitAsShaderResourceView(0);					// register space t0, 
 																	// because there's nothing to overlap with
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, slotRootParams, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+	slotRootParams[2].InitAsConstants(1, 2);						// b2, after the pass table's b0 and b1
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, slotRootParams, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 	ComPtr<ID3DBlob> serializedRS = nullptr;
 	ComPtr<ID3DBlob> errorBlob = nullptr;
 	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1, serializedRS.GetAddressOf(), errorBlob.GetAddressOf());
@@ -242,17 +341,6 @@ void BrickRenderer::BuildRootSignatures()
 	);
 }
 
-DirectX::XMMATRIX BrickRenderer::ToXMMatrix(const Sisu::Matrix4& m) const
-{
-	//TODO - we could probably optimize this.
-	DirectX::XMFLOAT4X4 xm(m.r0.x, m.r0.y, m.r0.z, m.r0.w,
-						   m.r1.x, m.r1.y, m.r1.z, m.r1.w,
-						   m.r2.x, m.r2.y, m.r2.z, m.r2.w,
-						   m.r3.x, m.r3.y, m.r3.z, m.r3.w);
-	
-	return DirectX::XMLoadFloat4x4(&xm);
-}
-
 void BrickRenderer::BuildShapeGeometry()
 {
 	GeometryGenerator geoGen;
@@ -337,11 +425,12 @@ void BrickRenderer::BuildFrameResources()
 {
 	UINT passCount = _cameraService->MaxCameraCount();
 	UINT cbObjectCount = 0;
+	_instanceBufferCapacity = passCount * MaxInstancedObjectCount;
 	for (int i = 0; i < FrameResourceCount; ++i)
 	{
 		_frameResources.push_back(
 			std::make_unique<FrameResource>(_d3dDevice.Get(), passCount, cbObjectCount, 
-											MaxInstancedObjectCount, MaxUIObjectCount)
+											_instanceBufferCapacity, MaxUIObjectCount)
 		);
 	}
 }
@@ -3,7 +3,9 @@
 #include "MathHelper.h"
 #include "GeometryGenerator.h"
 #include "Arena.h"
-#include "GameObject.h"
+#include "GameObjectStorage.h"
+#include "FrustumCulling.h"
+#include "InstancePacking.h"
 #include "ICameraService.h"
 #include "IGUIService.h"
 
@@ -19,11 +21,12 @@ struct BrickVertex
 class BrickRenderer : public D3DRenderer
 {
 public:
+	// Per camera: each one gets a copy of what it sees
 	static const UINT MaxInstancedObjectCount = 4096;
 
 	BrickRenderer(WindowManager* const windowManager, 
 		GameTimer* const gameTimer, 
-		Arena<GameObject>* const bricks,
+		GameObjectArena* const bricks,
 		ICameraService* const cameraService):
 		D3DRenderer(windowManager, gameTimer, cameraService), 
 		_bricks (bricks)
@@ -31,10 +34,13 @@ public:
 	}
 
 	virtual bool Init() override;
-	virtual void SetDirty() override { _dirtyFrameCount = FrameResourceCount; }
+	virtual void SetDirty() override { _needsFullGather = true; }
+	virtual void SetDirtySlots(const OccupancyBitmap& slots, std::size_t first, std::size_t last) override;
 	virtual void Update(const GameTimer& gt) override;
 	virtual std::size_t Draw(const GameTimer& gt) override;
 	virtual void SetWireframe(bool state) override { _isWireframe = state; }
+	virtual void SetInterpolationAlpha(float alpha) override { _interpolationAlpha = alpha; }
+	virtual void SetJobSystem(JobSystem* jobs) override { _jobs = jobs; }
 
 private:
 	void BuildDescriptorHeaps();
@@ -45,7 +51,9 @@ private:
 	void BuildShadersAndInputLayout();
 	void BuildPSOs();
 
-	void DrawBricks(ID3D12GraphicsCommandList* cmdList);
+	void DrawBricks(ID3D12GraphicsCommandList* cmdList, const InstanceRange& range);
+	void GatherInstances();
+	void CullInstances();
 	void UpdateInstanceData();
 	void UpdateMainPassCB(const GameTimer& gt, const D3DCamera& activeCamera);
 	void ClearRTVDSVforCamera(ID3D12GraphicsCommandList* cmdList, const D3DCamera& camera) const;
@@ -55,8 +63,6 @@ private:
 		UINT startIndex,
 		DirectX::XMFLOAT4 color) const;
 
-	DirectX::XMMATRIX ToXMMatrix(const Sisu::Matrix4& matrix) const;
-
 private:
 	std::vector<D3D12_INPUT_ELEMENT_DESC> _inputLayout;
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> _shaders;
@@ -67,9 +73,22 @@ private:
 
 	PassConstants _mainPassCB;
 
-	Arena<GameObject>* _bricks;
+	GameObjectArena* _bricks;
+	JobSystem* _jobs = nullptr;
 
-	int _dirtyFrameCount = FrameResourceCount;
+	bool _needsFullGather = true;					// everything, rather than the dirty slots
+	std::size_t _gatheredStructureVersion = 0;		// of the arena, at the last full gather
+	std::vector<std::size_t> _dirtySlots;			// arena slots to gather again
+	bool _needsPacking = true;						// gathered again, or some camera sees something else
+	std::vector<std::uint32_t> _regatheredInstances;	// if only those got gathered again
+	UINT _instanceBufferCapacity = 0;				// MaxInstancedObjectCount for every camera there can be
 	bool _isWireframe;
-	UINT _drawableObjectCount = 0;
+	float _interpolationAlpha = 1.0f;
+
+	ChunkedGather _gather;
+	std::vector<FRObjectConstants> _instances;					// every visible object, for the cameras to pick from
+	WorldBounds _instanceBounds;								// one box per instance
+	std::vector<std::vector<std::uint32_t>> _visibleByCamera;	// by CbvIndex: instances in view
+	std::vector<std::vector<std::uint32_t>> _culledByCamera;	// this frame's, to compare with the above
+	PackedInstances<FRObjectConstants> _packedInstances;		// ranges by CbvIndex
 };
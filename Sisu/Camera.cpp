@@ -29,6 +29,17 @@ DirectX::XMMATRIX D3DCamera::ToXMMatrix(const Sisu::Matrix4& m) const
 	return DirectX::XMLoadFloat4x4(&xm);
 }
 
+Sisu::Matrix4 D3DCamera::ViewProjectionMatrix() const
+{
+	DirectX::XMFLOAT4X4 vp;
+	DirectX::XMStoreFloat4x4(&vp, DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&_viewMatrix), DirectX::XMLoadFloat4x4(&_projectionMatrix)));
+
+	return Sisu::Matrix4(Sisu::Vector4(vp._11, vp._12, vp._13, vp._14),
+						 Sisu::Vector4(vp._21, vp._22, vp._23, vp._24),
+						 Sisu::Vector4(vp._31, vp._32, vp._33, vp._34),
+						 Sisu::Vector4(vp._41, vp._42, vp._43, vp._44));
+}
+
 //TODO: only do this if dirty
 void D3DCamera::Update(const GameTimer& gt, 
 					   const Sisu::Vector3& inputAxes,
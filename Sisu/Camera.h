@@ -16,7 +16,7 @@ public:
 	{
 	}
 
-	void SetViewport(Sisu::Vector4 normalizedVP, float width, float height, float mindepth, float maxdepth)
+	void SetViewport(const Sisu::Vector4& normalizedVP, float width, float height, float mindepth, float maxdepth)
 	{
 		normalizedViewport = normalizedVP;
 		viewport.MinDepth = mindepth;
@@ -39,6 +39,7 @@ public:
 	DirectX::XMFLOAT3 Position() const { return DirectX::XMFLOAT3(_position.x, _position.y, _position.z); }
 	const DirectX::XMFLOAT4X4& ViewMatrix() const { return _viewMatrix; }
 	const DirectX::XMFLOAT4X4& ProjectionMatrix() const { return _projectionMatrix; }
+	Sisu::Matrix4 ViewProjectionMatrix() const;	// for culling on the CPU
 	bool ShouldClearRenderTargetView(OUT D3D12_RECT& rect, OUT float* clearColor) const;
 	std::size_t CbvIndex() const { return _cameraIndex; }
 
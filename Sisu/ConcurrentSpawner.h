@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include "Arena.h"
+
+// Lets worker threads add and remove arena items without taking a lock,
+// e.g. to spawn objects from jobs.
+//
+// The arena itself stays single-threaded; it's only touched in Open() and
+// Close(), on the thread that owns it. In between, the workers may only go
+// through the spawner (reading live items is fine), and the owning thread
+// doesn't change the arena either:
+//	= Open() reserves a range of slots for each worker, plus a shared range;
+//	= Spawn() constructs into the worker's own slots, and when it runs out,
+//	  claims another chunk from the shared range, with a single fetch_add;
+//	= Close() makes the spawned items live, applies the despawns, and gives
+//	  back whatever wasn't used.
+// Spawned items only get a handle on Close().
+template <typename T, typename Storage = ContiguousStorage<T>>
+class ConcurrentSpawner
+{
+public:
+	static const std::size_t None = static_cast<std::size_t>(-1);
+
+	ConcurrentSpawner(std::size_t threadCount, std::size_t slotsPerThread, std::size_t chunkSize = 64)
+		: _threads(threadCount), _slotsPerThread(slotsPerThread), _chunkSize(chunkSize)
+	{
+	}
+
+	void Open(Arena<T, Storage>& arena, std::size_t sharedSlotCount)
+	{
+		typename Arena<T, Storage>::ScopedBatch batch(arena);
+
+		for (auto& thread : _threads)
+		{
+			thread.next = arena.ReserveSlots(_slotsPerThread);
+			thread.end = thread.next + _slotsPerThread;
+		}
+
+		auto sharedStart = arena.ReserveSlots(sharedSlotCount);
+		_sharedEnd = sharedStart + sharedSlotCount;
+		_sharedNext.store(sharedStart, std::memory_order_relaxed);
+	}
+
+	// Worker `thread` only: returns the new item's index, or None if
+	// there are no slots left until the next Open().
+	template <typename... Args>
+	std::size_t Spawn(Arena<T, Storage>& arena, std::size_t thread, Args&&... args)
+	{
+		auto& cache = _threads[thread];
+		if (cache.next == cache.end && !TryClaimChunk(cache)) { return None; }
+
+		auto index = cache.next++;
+		arena.EmplaceReserved(index, std::forward<Args>(args)...);
+		cache.spawned.push_back(index);
+		return index;
+	}
+
+	// Worker `thread` only: removes an item that was live at Open(), or
+	// that got spawned since. Takes effect on Close().
+	void Despawn(std::size_t thread, std::size_t index)
+	{
+		_threads[thread].despawned.push_back(index);
+	}
+
+	// Once all workers are done.
+	void Close(Arena<T, Storage>& arena)
+	{
+		typename Arena<T, Storage>::ScopedBatch batch(arena);
+
+		for (auto& thread : _threads)
+		{
+			for (auto index : thread.spawned) { arena.PublishReserved(index); }
+			arena.ReleaseReserved(thread.next, thread.end - thread.next);
+		}
+
+		auto sharedNext = std::min(_sharedNext.load(std::memory_order_relaxed), _sharedEnd);
+		arena.ReleaseReserved(sharedNext, _sharedEnd - sharedNext);
+
+		// Despawning a slot twice is harmless, RemoveAt skips unused ones
+		for (auto& thread : _threads)
+		{
+			for (auto index : thread.despawned) { arena.RemoveAt(index); }
+
+			thread.spawned.clear();
+			thread.despawned.clear();
+			thread.next = thread.end = 0;
+		}
+	}
+
+private:
+	// Owned by one worker, apart from Open() / Close(). The padding keeps
+	// the hot part of neighbouring caches off the same cache line.
+	struct ThreadCache
+	{
+		std::size_t next = 0;
+		std::size_t end = 0;
+		std::vector<std::size_t> spawned;
+		std::vector<std::size_t> despawned;
+		char padding[64];
+	};
+
+	bool TryClaimChunk(ThreadCache& cache)
+	{
+		auto first = _sharedNext.fetch_add(_chunkSize, std::memory_order_relaxed);
+		if (first >= _sharedEnd) { return false; }
+
+		cache.next = first;
+		cache.end = std::min(first + _chunkSize, _sharedEnd);
+		return true;
+	}
+
+private:
+	std::vector<ThreadCache> _threads;
+	std::size_t _slotsPerThread;
+	std::size_t _chunkSize;
+
+	std::size_t _sharedEnd = 0;
+	std::atomic<std::size_t> _sharedNext{ 0 };
+};
@@ -678,19 +678,22 @@ void D3DRenderer::UpdateUIPassBuffer(const GameTimer& gt, const D3DCamera& uiCam
 
 void D3DRenderer::UpdateUIInstanceData()
 {
+	_stats.uiBytesUploaded = 0;
 	if (_UIDirtyFrameCount > 0)
 	{
-		auto currentInstanceBuffer = _currentFrameResource->UIInstanceBuffer.get();
+		// Straight into the upload heap, in order
+		auto uiInstances = _currentFrameResource->UIInstanceBuffer->MapForWrite(0, static_cast<UINT>(_uiRenderItems.size()));
 		UINT bufferIndex = 0;
 		for (auto& uiRenderItem : _uiRenderItems)
 		{
 			DirectX::XMMATRIX worldMatrix = DirectX::XMLoadFloat4x4(&uiRenderItem.World);
 			UIObjectConstants objConstants(worldMatrix, uiRenderItem.uvData);
-			currentInstanceBuffer->CopyData(bufferIndex++, objConstants);
+			uiInstances.Write(bufferIndex++, objConstants);
 		}
 
 		_UIDirtyFrameCount--;
 		_drawableUIItemCount = bufferIndex;
+		_stats.uiBytesUploaded = bufferIndex * sizeof(UIObjectConstants);
 	}
 
 	/* If we were using constant buffers:
@@ -53,6 +53,7 @@ public:
 	virtual bool IsSetup() const override { return _d3dDevice != nullptr; }
 	virtual std::size_t AddUIRenderItem(const UIElement& uiElement) override;
 	virtual void RefreshUIItem(const UIElement& uiElement) override;
+	virtual RendererStats GetStats() const override { return _stats; }
 
 	ID3D12Device* GetDevice() { return _d3dDevice == nullptr ? nullptr : _d3dDevice.Get(); }
 	ID3D12GraphicsCommandList* GetCommandList() { return _commandList == nullptr ? nullptr : _commandList.Get(); }
@@ -135,6 +136,8 @@ protected:
 	UINT _UIDirtyFrameCount = FrameResourceCount;
 	UINT _drawableUIItemCount = 0;
 
+	RendererStats _stats;
+
 	UINT _RtvDescriptorSize = 0;			// render target descriptor size
 	UINT _DsvDescriptorSize = 0;			// depth and stencil buffer descriptor size
 	UINT _CbvSrvUavDescriptorSize = 0;		// constant buffer, shader resource, unordered acces descriptor sizes
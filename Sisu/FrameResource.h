@@ -7,19 +7,18 @@
 
 struct FRObjectConstants
 {
-	FRObjectConstants(const DirectX::XMMATRIX& worldMatrixToInit)
+	// Affine3x4 is kept transposed already, the way the shader takes it
+	// (row_major float3x4), so it's copied as is.
+	FRObjectConstants(const Sisu::Affine3x4& worldMatrixToInit) :
+		worldMatrix(worldMatrixToInit)
 	{
-		// We need to transpose the world matrix, because "by default,
-		// matrices in the constant buffer are expected to be in column
-		// major format, whereas on the C++ side we're working with
-		// row-major matrices." Because DirectX.
-		DirectX::XMStoreFloat4x4(&worldMatrix, DirectX::XMMatrixTranspose(worldMatrixToInit));
 	}
 
-	DirectX::XMFLOAT4X4 worldMatrix = MathHelper::Identity4x4();
+	Sisu::Affine3x4 worldMatrix = Sisu::Affine3x4::Identity();
 	DirectX::XMFLOAT4 color;
 	DirectX::XMFLOAT4 borderColor;
 	DirectX::XMFLOAT3 localScale = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);
+	float padding = 0.0f;		// worldMatrix is 16-byte aligned, so the struct is padded to 96 bytes anyway
 };
 
 struct UIObjectConstants
@@ -112,6 +111,7 @@ public:
 	std::unique_ptr<UploadBuffer<UIObjectConstants>> UIInstanceBuffer = nullptr;
 
 	UINT64 fence = 0;
+	UINT64 instanceVersion = 0;		// of the PackedInstances that instanceBuffer holds
 
 private:
 	UINT _objectCount;
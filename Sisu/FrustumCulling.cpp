@@ -0,0 +1,249 @@
+#include "stdafx.h"
+#include <cmath>
+#include "FrustumCulling.h"
+
+#if defined(SISU_MATH_AVX2)
+#include <immintrin.h>
+#elif defined(SISU_MATH_SSE)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Column j of a row-vector matrix: what gives clip coordinate j
+	Sisu::Vector4 Column(const Sisu::Matrix4& m, int j)
+	{
+		const float* r0 = &m.r0.x;
+		const float* r1 = &m.r1.x;
+		const float* r2 = &m.r2.x;
+		const float* r3 = &m.r3.x;
+		return Sisu::Vector4(r0[j], r1[j], r2[j], r3[j]);
+	}
+
+	// Scaled to a unit normal, so that plane distances are world distances
+	Sisu::Vector4 Normalized(const Sisu::Vector4& plane)
+	{
+		auto scale = 1.0f / sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+		return Sisu::Vector4(plane.x * scale, plane.y * scale, plane.z * scale, plane.w * scale);
+	}
+
+	Sisu::Vector4 ClipPlane(const Sisu::Vector4& a, const Sisu::Vector4& b, float sign)
+	{
+		return Normalized(Sisu::Vector4(a.x + sign * b.x, a.y + sign * b.y, a.z + sign * b.z, a.w + sign * b.w));
+	}
+
+	// The reference for the SIMD versions: a box is in, unless it's
+	// entirely behind one of the planes
+	bool IsInside(const Frustum& frustum, const WorldBounds& bounds, std::size_t i)
+	{
+		for (const auto& p : frustum.planes)
+		{
+			auto distance = p.x * bounds.centerX[i] + p.y * bounds.centerY[i] + p.z * bounds.centerZ[i] + p.w;
+			auto radius = std::fabs(p.x) * bounds.extentX[i] + std::fabs(p.y) * bounds.extentY[i] + std::fabs(p.z) * bounds.extentZ[i];
+			if (distance + radius < 0.0f)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+#if defined(SISU_MATH_SSE)
+	// A plane's coefficients, each in every lane, and the absolute values of
+	// its normal, which project a box's half extents onto it
+	struct PlaneLanes4
+	{
+		__m128 a, b, c, d;
+		__m128 absA, absB, absC;
+	};
+
+	void Append(int insideBits, std::size_t first, int lanes, std::vector<std::uint32_t>& visible)
+	{
+		for (int lane = 0; lane < lanes; ++lane)
+		{
+			if ((insideBits >> lane) & 1)
+			{
+				visible.push_back(static_cast<std::uint32_t>(first + lane));
+			}
+		}
+	}
+
+	std::size_t CullSse(const Frustum& frustum, const WorldBounds& bounds, std::size_t i, std::vector<std::uint32_t>& visible)
+	{
+		PlaneLanes4 planes[Frustum::PlaneCount];
+		for (int p = 0; p < Frustum::PlaneCount; ++p)
+		{
+			const auto& plane = frustum.planes[p];
+			planes[p] = PlaneLanes4{ _mm_set1_ps(plane.x), _mm_set1_ps(plane.y), _mm_set1_ps(plane.z), _mm_set1_ps(plane.w),
+									 _mm_set1_ps(std::fabs(plane.x)), _mm_set1_ps(std::fabs(plane.y)), _mm_set1_ps(std::fabs(plane.z)) };
+		}
+
+		auto zero = _mm_setzero_ps();
+		for (; i + 4 <= bounds.Size(); i += 4)
+		{
+			auto cx = _mm_loadu_ps(&bounds.centerX[i]), cy = _mm_loadu_ps(&bounds.centerY[i]), cz = _mm_loadu_ps(&bounds.centerZ[i]);
+			auto ex = _mm_loadu_ps(&bounds.extentX[i]), ey = _mm_loadu_ps(&bounds.extentY[i]), ez = _mm_loadu_ps(&bounds.extentZ[i]);
+
+			auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const auto& p : planes)
+			{
+				auto distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p.a, cx), _mm_mul_ps(p.b, cy)), _mm_mul_ps(p.c, cz)), p.d);
+				auto radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.absA, ex), _mm_mul_ps(p.absB, ey)), _mm_mul_ps(p.absC, ez));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+			}
+
+			Append(_mm_movemask_ps(inside), i, 4, visible);
+		}
+
+		return i;
+	}
+#endif
+
+#if defined(SISU_MATH_AVX2)
+	struct PlaneLanes8
+	{
+		__m256 a, b, c, d;
+		__m256 absA, absB, absC;
+	};
+
+	std::size_t CullAvx2(const Frustum& frustum, const WorldBounds& bounds, std::size_t i, std::vector<std::uint32_t>& visible)
+	{
+		PlaneLanes8 planes[Frustum::PlaneCount];
+		for (int p = 0; p < Frustum::PlaneCount; ++p)
+		{
+			const auto& plane = frustum.planes[p];
+			planes[p] = PlaneLanes8{ _mm256_set1_ps(plane.x), _mm256_set1_ps(plane.y), _mm256_set1_ps(plane.z), _mm256_set1_ps(plane.w),
+									 _mm256_set1_ps(std::fabs(plane.x)), _mm256_set1_ps(std::fabs(plane.y)), _mm256_set1_ps(std::fabs(plane.z)) };
+		}
+
+		auto zero = _mm256_setzero_ps();
+		for (; i + 8 <= bounds.Size(); i += 8)
+		{
+			auto cx = _mm256_loadu_ps(&bounds.centerX[i]), cy = _mm256_loadu_ps(&bounds.centerY[i]), cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+			auto ex = _mm256_loadu_ps(&bounds.extentX[i]), ey = _mm256_loadu_ps(&bounds.extentY[i]), ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+			auto inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const auto& p : planes)
+			{
+				auto distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p.a, cx), _mm256_mul_ps(p.b, cy)), _mm256_mul_ps(p.c, cz)), p.d);
+				auto radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p.absA, ex), _mm256_mul_ps(p.absB, ey)), _mm256_mul_ps(p.absC, ez));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+			}
+
+			Append(_mm256_movemask_ps(inside), i, 8, visible);
+		}
+
+		return i;
+	}
+#endif
+}
+
+Frustum Frustum::FromViewProjection(const Sisu::Matrix4& viewProjection)
+{
+	auto x = Column(viewProjection, 0);
+	auto y = Column(viewProjection, 1);
+	auto z = Column(viewProjection, 2);
+	auto w = Column(viewProjection, 3);
+
+	Frustum frustum;
+	frustum.planes[Left] = ClipPlane(w, x, 1.0f);		// -w <= x
+	frustum.planes[Right] = ClipPlane(w, x, -1.0f);		//  x <= w
+	frustum.planes[Bottom] = ClipPlane(w, y, 1.0f);
+	frustum.planes[Top] = ClipPlane(w, y, -1.0f);
+	frustum.planes[Near] = Normalized(z);			//  0 <= z
+	frustum.planes[Far] = ClipPlane(w, z, -1.0f);		//  z <= w
+	return frustum;
+}
+
+bool Frustum::Contains(const Sisu::Vector3& point) const
+{
+	for (const auto& p : planes)
+	{
+		if (p.x * point.x + p.y * point.y + p.z * point.z + p.w < 0.0f)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void WorldBounds::Clear()
+{
+	for (auto component : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+	{
+		component->clear();
+	}
+}
+
+void WorldBounds::Reserve(std::size_t count)
+{
+	for (auto component : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+	{
+		component->reserve(count);
+	}
+}
+
+void WorldBounds::Resize(std::size_t count)
+{
+	for (auto component : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+	{
+		component->resize(count);
+	}
+}
+
+void WorldBounds::Add(const Sisu::Vector3& center, const Sisu::Vector3& halfExtents)
+{
+	Resize(Size() + 1);
+	Set(Size() - 1, center, halfExtents);
+}
+
+void WorldBounds::Set(std::size_t i, const Sisu::Vector3& center, const Sisu::Vector3& halfExtents)
+{
+	centerX[i] = center.x;
+	centerY[i] = center.y;
+	centerZ[i] = center.z;
+	extentX[i] = halfExtents.x;
+	extentY[i] = halfExtents.y;
+	extentZ[i] = halfExtents.z;
+}
+
+void WorldBounds::AddTransformedUnitCube(const Sisu::Affine3x4& transform)
+{
+	Resize(Size() + 1);
+	SetTransformedUnitCube(Size() - 1, transform);
+}
+
+// The cube's center goes to the translation; along each world axis, the
+// half extent is half the sum of how far the cube's three axes reach
+void WorldBounds::SetTransformedUnitCube(std::size_t i, const Sisu::Affine3x4& transform)
+{
+	auto reach = [](const Sisu::Vector4& row)
+	{
+		return 0.5f * (std::fabs(row.x) + std::fabs(row.y) + std::fabs(row.z));
+	};
+
+	Set(i, transform.Translation(), Sisu::Vector3(reach(transform.r0), reach(transform.r1), reach(transform.r2)));
+}
+
+namespace FrustumCulling
+{
+	void Cull(const Frustum& frustum, const WorldBounds& bounds, std::vector<std::uint32_t>& visible)
+	{
+		std::size_t i = 0;
+#if defined(SISU_MATH_AVX2)
+		i = CullAvx2(frustum, bounds, i, visible);
+#endif
+#if defined(SISU_MATH_SSE)
+		i = CullSse(frustum, bounds, i, visible);
+#endif
+		for (; i < bounds.Size(); ++i)
+		{
+			if (IsInside(frustum, bounds, i))
+			{
+				visible.push_back(static_cast<std::uint32_t>(i));
+			}
+		}
+	}
+}
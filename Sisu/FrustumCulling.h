@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "SisuUtilities.h"
+
+// CPU view frustum culling, without anything from D3D, so that it can run
+// (and be tested) headless. The renderer fills a WorldBounds with one box
+// per candidate instance, then culls it against each camera's Frustum.
+
+// Six planes (a, b, c, d) in world space, normalized, facing inwards: a
+// point is inside a plane where a * x + b * y + c * z + d >= 0.
+struct Frustum
+{
+	enum Plane { Left, Right, Bottom, Top, Near, Far, PlaneCount };
+
+	// From a view * projection matrix the way D3DCamera builds them: row
+	// vectors (clip = p * viewProjection), and clip z from 0 to w.
+	static Frustum FromViewProjection(const Sisu::Matrix4& viewProjection);
+
+	bool Contains(const Sisu::Vector3& point) const;
+
+	Sisu::Vector4 planes[PlaneCount];
+};
+
+// Axis-aligned boxes, as center and half extents, one array per
+// component, so that the culling tests 4 or 8 boxes at a time.
+struct WorldBounds
+{
+	void Clear();
+	void Reserve(std::size_t count);
+	std::size_t Size() const { return centerX.size(); }
+
+	void Resize(std::size_t count);
+	void Add(const Sisu::Vector3& center, const Sisu::Vector3& halfExtents);
+	void Set(std::size_t i, const Sisu::Vector3& center, const Sisu::Vector3& halfExtents);
+
+	// The box around the unit cube centered on the origin (the brick mesh),
+	// put through `transform`
+	void AddTransformedUnitCube(const Sisu::Affine3x4& transform);
+	void SetTransformedUnitCube(std::size_t i, const Sisu::Affine3x4& transform);
+
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+};
+
+namespace FrustumCulling
+{
+	// Appends to `visible` the index of every box that's at least partly
+	// inside the frustum, in increasing order. Conservative: a box near a
+	// corner, outside but not fully behind any one plane, still counts.
+	void Cull(const Frustum& frustum, const WorldBounds& bounds, std::vector<std::uint32_t>& visible);
+}
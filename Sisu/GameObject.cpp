@@ -1,7 +1,13 @@
 #include "stdafx.h"
 #include "GameObject.h"
 
-void GameObject::RefreshTransform(Sisu::Matrix4* parentTransform)
+void GameObject::RefreshTransform(const Sisu::Affine3x4* parentTransform)
+{
+	transform = ComputeTransform(localScale, rotQuat, localPosition, parentTransform);
+}
+
+Sisu::Affine3x4 GameObject::ComputeTransform(const Sisu::Vector3& localScale, const Sisu::Quat& rotQuat,
+											 const Sisu::Vector3& localPosition, const Sisu::Affine3x4* parentTransform)
 {
 	// Create scale matrix
 	Sisu::Matrix4 scaleMatrix(Sisu::Vector4(localScale.x, 0.0, 0.0, 0.0),
@@ -18,9 +24,11 @@ void GameObject::RefreshTransform(Sisu::Matrix4* parentTransform)
 							  Sisu::Vector4(0.0, 0.0, 1.0, 0.0),
 							  Sisu::Vector4(localPosition.x, localPosition.y, localPosition.z, 1.0));
 
-	transform = scaleMatrix * rotMatrix * translateMatrix;
+	auto transform = Sisu::Affine3x4::FromMatrix4(scaleMatrix * rotMatrix * translateMatrix);
 	if (parentTransform != nullptr)
 	{
 		transform = transform * (*parentTransform);
 	}
+
+	return transform;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include <cstddef>
+#include <iterator>
+#include <utility>
 #include <vector>
 #include "Arena.h"
 #include "SisuUtilities.h"
@@ -7,16 +9,31 @@
 class GameObject
 {
 public:
-	static std::size_t AddToArena(Arena<GameObject>& arena, GameObject go)
+	template <typename Storage>
+	static std::size_t AddToArena(Arena<GameObject, Storage>& arena, GameObject&& go)
+	{
+		return arena.AddAnywhere(std::move(go));
+	}
+
+	template <typename Storage>
+	static std::size_t AddToArena(Arena<GameObject, Storage>& arena, const GameObject& go)
 	{
 		return arena.AddAnywhere(go);
 	}
 
-	static std::size_t AddChildren(Arena<GameObject>& arena, std::size_t parentIndex,
-		std::vector<GameObject>::iterator begin,
-		std::vector<GameObject>::iterator end)
+	template <typename Storage, typename... Args>
+	static std::size_t EmplaceInArena(Arena<GameObject, Storage>& arena, Args&&... args)
+	{
+		return arena.EmplaceAnywhere(std::forward<Args>(args)...);
+	}
+
+	// Pass std::make_move_iterator()s to move the kids in.
+	template <typename Storage, typename Iterator>
+	static std::size_t AddChildren(Arena<GameObject, Storage>& arena, std::size_t parentIndex,
+		Iterator begin, Iterator end)
 	{
-		std::size_t newChildrenCount = end - begin;
+		typename Arena<GameObject, Storage>::ScopedBatch batch(arena);
+		std::size_t newChildrenCount = std::distance(begin, end);
 		if (!arena[parentIndex].hasChildren)
 		{
 			auto firstChildIndex = arena.GetStartIndexForGap(newChildrenCount, parentIndex);
@@ -53,27 +70,13 @@ public:
 
 		// So now we need to relocate.
 		// TODO: DRY
-		auto& parent = arena[parentIndex];
+		auto&& parent = arena[parentIndex];
 		auto existingKidCount = parent.childrenEndIndex - parent.childrenStartIndex + 1;
 		auto childrenCount = existingKidCount + newChildrenCount;
 		auto gapStartIndex = arena.GetStartIndexForGap(childrenCount, parentIndex);
 
-		// First copy the existing kids and update their indices
-		auto fromIndex = parent.childrenStartIndex;
-		for (std::size_t i = 0; i < existingKidCount; ++i)
-		{
-			auto newIndex = gapStartIndex + i;
-			arena.AddAt(newIndex, arena[fromIndex + i]);
-			if (arena[newIndex].hasChildren)
-			{
-				for (std::size_t j = arena[newIndex].childrenStartIndex; j <= arena[newIndex].childrenEndIndex; ++j)
-				{
-					arena[j].parentIndex = newIndex;
-				}
-			}
-		}
-
-		arena.RemoveAt(fromIndex, existingKidCount);
+		// First move the existing kids and update their indices
+		RelocateBlock(arena, parent.childrenStartIndex, existingKidCount, gapStartIndex);
 
 		// Then add the new kids
 		auto firstChildIndex = gapStartIndex + existingKidCount;
@@ -90,14 +93,23 @@ public:
 		return arena[parentIndex].childrenStartIndex;
 	}
 
-	static std::size_t AddChild(Arena<GameObject>& arena, std::size_t parentIndex, GameObject child)
+	template <typename Storage>
+	static std::size_t AddChild(Arena<GameObject, Storage>& arena, std::size_t parentIndex, GameObject child)
+	{
+		return EmplaceChild(arena, parentIndex, std::move(child));
+	}
+
+	// Constructs the new kid in place. Siblings might get relocated before
+	// that happens, so the arguments must not refer to objects in the arena.
+	template <typename Storage, typename... Args>
+	static std::size_t EmplaceChild(Arena<GameObject, Storage>& arena, std::size_t parentIndex, Args&&... args)
 	{
 		if (!arena[parentIndex].hasChildren)
 		{
 			auto childIndex = arena.GetStartIndexForGap(1, parentIndex);
-			arena.AddAt(childIndex, child);
+			arena.EmplaceAt(childIndex, std::forward<Args>(args)...);
 
-			auto& parent = arena[parentIndex];
+			auto&& parent = arena[parentIndex];
 
 			parent.hasChildren = true;
 			parent.childrenStartIndex = childIndex;
@@ -113,38 +125,24 @@ public:
 		if (arena.CanAddItemAt(arena[parentIndex].childrenEndIndex + 1))
 		{
 			auto childIndex = arena[parentIndex].childrenEndIndex + 1;
-			arena.AddAt(childIndex, child);
+			arena.EmplaceAt(childIndex, std::forward<Args>(args)...);
 			arena[parentIndex].childrenEndIndex = childIndex;
 			arena[childIndex].SetParent(parentIndex);
 			return childIndex;
 		}
 
 		// We have to relocate all kids, including the new one
-		auto& parent = arena[parentIndex];
+		auto&& parent = arena[parentIndex];
 		auto existingKidCount = parent.childrenEndIndex - parent.childrenStartIndex + 1;
 		auto childrenCount = existingKidCount + 1;
 		auto gapStartIndex = arena.GetStartIndexForGap(childrenCount, parentIndex);
 
-		// First copy the existing kids and update their indices
-		auto fromIndex = parent.childrenStartIndex;
-		for (std::size_t i = 0; i < existingKidCount; ++i)
-		{
-			auto newIndex = gapStartIndex + i;
-			arena.AddAt(newIndex, arena[fromIndex + i]);
-			if (arena[newIndex].hasChildren)
-			{
-				for (std::size_t j = arena[newIndex].childrenStartIndex; j <= arena[newIndex].childrenEndIndex; ++j)
-				{
-					arena[j].parentIndex = newIndex;
-				}
-			}
-		}
-
-		arena.RemoveAt(fromIndex, existingKidCount);
+		// First move the existing kids and update their indices
+		RelocateBlock(arena, parent.childrenStartIndex, existingKidCount, gapStartIndex);
 
 		// Then add the new kid
 		auto newKidsIndex = gapStartIndex + existingKidCount;
-		arena.AddAt(newKidsIndex, child);
+		arena.EmplaceAt(newKidsIndex, std::forward<Args>(args)...);
 		arena[newKidsIndex].SetParent(parentIndex);
 
 		// Then set up the parent
@@ -154,6 +152,29 @@ public:
 		return newKidsIndex;
 	}
 
+	// Moves `count` consecutive objects from `fromIndex` to the free range
+	// starting at `toIndex` (which must not be inside the moved range past
+	// its first slot), and points their kids back to them. Handles to the
+	// moved objects stay valid; updating their parent is up to the caller.
+	template <typename Storage>
+	static void RelocateBlock(Arena<GameObject, Storage>& arena, std::size_t fromIndex,
+							  std::size_t count, std::size_t toIndex)
+	{
+		typename Arena<GameObject, Storage>::ScopedBatch batch(arena);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			auto newIndex = toIndex + i;
+			arena.Relocate(fromIndex + i, newIndex);
+			if (arena[newIndex].hasChildren)
+			{
+				for (std::size_t j = arena[newIndex].childrenStartIndex; j <= arena[newIndex].childrenEndIndex; ++j)
+				{
+					arena[j].parentIndex = newIndex;
+				}
+			}
+		}
+	}
+
 	//TODO: make sure we know when we're making copies
 	GameObject()
 	{
@@ -161,8 +182,10 @@ public:
 		localRotation = Sisu::Vector3::Zero();
 		localScale = Sisu::Vector3(1.0, 1.0, 1.0);
 		color = Sisu::Color::Blue();
-		transform = Sisu::Matrix4::Identity();
+		transform = Sisu::Affine3x4::Identity();
 		velocityPerSec = Sisu::Vector3::Zero();
+		eulerRotPerSec = Sisu::Vector3::Zero();
+		borderColor = Sisu::Color::Black();
 	}
 
 	GameObject(const GameObject& other) = default;
@@ -173,11 +196,15 @@ public:
 		this->isRoot = false;
 	}
 
-	void RefreshTransform(Sisu::Matrix4* parentTransform);
+	void RefreshTransform(const Sisu::Affine3x4* parentTransform);
+
+	// scale * rotation * translation, then the parent's transform on top, if any
+	static Sisu::Affine3x4 ComputeTransform(const Sisu::Vector3& localScale, const Sisu::Quat& rotQuat,
+											const Sisu::Vector3& localPosition, const Sisu::Affine3x4* parentTransform);
 
 public:
 	//TODO: organize this nicely for alignment + only what's really needed
-	Sisu::Matrix4 transform;
+	Sisu::Affine3x4 transform;
 	Sisu::Quat rotQuat = Sisu::Quat::Identity();
 
 	Sisu::Vector3 localPosition;
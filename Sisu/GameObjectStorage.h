@@ -0,0 +1,328 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "GameObject.h"
+#include "OccupancyBitmap.h"
+
+// Structure-of-arrays storage for Arena<GameObject>: instead of whole
+// GameObjects, it keeps one paged array per component, all indexed by the
+// arena's slot index. The transform update only streams through the
+// hot arrays (motion, transforms, flags), and the renderer only through
+// the transforms and the cold data, instead of dragging every field of
+// every object through the cache.
+
+// Integrated every tick: exactly one cache line per object. The (16-byte
+// aligned) quaternion goes first, so there's no padding.
+struct GameObjectMotion
+{
+	Sisu::Quat rotQuat;
+	Sisu::Vector3 localPosition;
+	Sisu::Vector3 localScale;
+	Sisu::Vector3 velocityPerSec;
+	Sisu::Vector3 eulerRotPerSec;
+};
+static_assert(sizeof(GameObjectMotion) == 64, "GameObjectMotion should fill exactly one cache line.");
+
+// The rotation per update step, for an object's eulerRotPerSec. Only the
+// transform update uses it, and recomputes it when the rate or the step
+// changes; a zero step means it hasn't been computed yet.
+struct GameObjectSpin
+{
+	Sisu::Quat stepRotation;
+	Sisu::Vector3 eulerRotPerSec;
+	float stepSeconds;
+};
+
+struct GameObjectHierarchy
+{
+	std::size_t childrenStartIndex;
+	std::size_t childrenEndIndex;
+	std::size_t parentIndex;
+	bool isRoot;
+	bool hasChildren;
+};
+
+// Not touched by the transform update.
+struct GameObjectCold
+{
+	Sisu::Color color;
+	Sisu::Color borderColor;
+	Sisu::Vector3 localRotation;
+	bool isVisible;
+};
+
+// Bits in GameObjectStorage::TransformFlags(), one byte per object
+struct TransformFlag
+{
+	static const std::uint8_t LocalDirty = 1;		// local position, rotation or scale got changed from outside
+	static const std::uint8_t WorldChanged = 2;		// the transform got recomputed in the latest update
+	static const std::uint8_t Queued = 4;			// during the update only: the new transform isn't written yet
+};
+
+// What arena[index] returns with this storage: the same fields as a
+// GameObject, but each one refers into its component array. So existing
+// code like arena[i].hasChildren = true keeps working; bind it with auto&&.
+// The components are paged, so it stays valid when the arena grows. After
+// changing the local position, rotation or scale of an existing object,
+// call MarkTransformDirty(); new objects are dirty anyway.
+template <bool IsConst>
+struct BasicGameObjectRef
+{
+	template <typename X> using Ref = typename std::conditional<IsConst, const X&, X&>::type;
+
+	BasicGameObjectRef(Ref<Sisu::Affine3x4> ptransform, Ref<GameObjectMotion> motion,
+					   Ref<GameObjectHierarchy> hierarchy, Ref<GameObjectCold> cold, Ref<std::uint8_t> flags) :
+		transform(ptransform),
+		rotQuat(motion.rotQuat),
+		localPosition(motion.localPosition),
+		localRotation(cold.localRotation),
+		localScale(motion.localScale),
+		childrenStartIndex(hierarchy.childrenStartIndex),
+		childrenEndIndex(hierarchy.childrenEndIndex),
+		parentIndex(hierarchy.parentIndex),
+		color(cold.color),
+		borderColor(cold.borderColor),
+		isRoot(hierarchy.isRoot),
+		hasChildren(hierarchy.hasChildren),
+		isVisible(cold.isVisible),
+		velocityPerSec(motion.velocityPerSec),
+		eulerRotPerSec(motion.eulerRotPerSec),
+		transformFlags(flags)
+	{
+	}
+
+	// A copy of the whole object
+	operator GameObject() const
+	{
+		GameObject go;
+		go.transform = transform;
+		go.rotQuat = rotQuat;
+		go.localPosition = localPosition;
+		go.localRotation = localRotation;
+		go.localScale = localScale;
+		go.childrenStartIndex = childrenStartIndex;
+		go.childrenEndIndex = childrenEndIndex;
+		go.parentIndex = parentIndex;
+		go.color = color;
+		go.borderColor = borderColor;
+		go.isRoot = isRoot;
+		go.hasChildren = hasChildren;
+		go.isVisible = isVisible;
+		go.velocityPerSec = velocityPerSec;
+		go.eulerRotPerSec = eulerRotPerSec;
+		return go;
+	}
+
+	void SetParent(std::size_t pparentIndex)
+	{
+		parentIndex = pparentIndex;
+		isRoot = false;
+	}
+
+	void MarkTransformDirty() { transformFlags |= TransformFlag::LocalDirty; }
+
+	void RefreshTransform(const Sisu::Affine3x4* parentTransform)
+	{
+		transform = GameObject::ComputeTransform(localScale, rotQuat, localPosition, parentTransform);
+	}
+
+	Ref<Sisu::Affine3x4> transform;
+	Ref<Sisu::Quat> rotQuat;
+
+	Ref<Sisu::Vector3> localPosition;
+	Ref<Sisu::Vector3> localRotation;
+	Ref<Sisu::Vector3> localScale;
+
+	Ref<std::size_t> childrenStartIndex;
+	Ref<std::size_t> childrenEndIndex;
+	Ref<std::size_t> parentIndex;
+
+	Ref<Sisu::Color> color;
+	Ref<Sisu::Color> borderColor;
+
+	Ref<bool> isRoot;
+	Ref<bool> hasChildren;
+	Ref<bool> isVisible;
+
+	Ref<Sisu::Vector3> velocityPerSec;
+	Ref<Sisu::Vector3> eulerRotPerSec;
+
+	Ref<std::uint8_t> transformFlags;
+};
+
+typedef BasicGameObjectRef<false> GameObjectRef;
+typedef BasicGameObjectRef<true> ConstGameObjectRef;
+
+// One component for every slot, in fixed-size pages like PagedStorage's:
+// they never move once allocated, so growing allocates pages instead of
+// copying the whole array, and references into it stay valid.
+template <typename T>
+class ComponentPages
+{
+public:
+	static const std::size_t PageShift = 10;
+	static const std::size_t PageSize = std::size_t(1) << PageShift;
+	static const std::size_t PageMask = PageSize - 1;
+
+	typedef std::unique_ptr<T[]> Page;
+
+	// Indexes like an array, through the page table. Slots in the same
+	// page are contiguous. Don't keep it across anything that adds a page.
+	template <bool IsConst>
+	class BasicView
+	{
+	public:
+		typedef typename std::conditional<IsConst, const T, T>::type Element;
+
+		BasicView() = default;
+		explicit BasicView(const Page* pages) : _pages(pages) {}
+
+		Element& operator[](std::size_t index) const { return _pages[index >> PageShift][index & PageMask]; }
+
+	private:
+		const Page* _pages = nullptr;
+	};
+
+	typedef BasicView<false> View;
+	typedef BasicView<true> ConstView;
+
+	void Reserve(std::size_t count) { _pages.reserve((count + PageMask) >> PageShift); }
+
+	// Makes sure there are pages for `count` slots
+	void Grow(std::size_t count)
+	{
+		while (count > (_pages.size() << PageShift))
+		{
+			_pages.emplace_back(new T[PageSize]);
+		}
+	}
+
+	T& operator[](std::size_t index) { return _pages[index >> PageShift][index & PageMask]; }
+	const T& operator[](std::size_t index) const { return _pages[index >> PageShift][index & PageMask]; }
+
+	View Pages() { return View(_pages.data()); }
+	ConstView Pages() const { return ConstView(_pages.data()); }
+
+private:
+	std::vector<Page> _pages;
+};
+
+// Storage policy, see ArenaStorage.h. Components are plain data, so there's
+// nothing to destroy; unused slots just hold stale values.
+class GameObjectStorage
+{
+public:
+	typedef GameObjectRef Reference;
+	typedef ConstGameObjectRef ConstReference;
+
+	static const std::size_t PageShift = ComponentPages<GameObjectHierarchy>::PageShift;
+	static const std::size_t PageMask = ComponentPages<GameObjectHierarchy>::PageMask;
+
+	GameObjectStorage() = default;
+	GameObjectStorage(const GameObjectStorage&) = delete;
+	GameObjectStorage& operator=(const GameObjectStorage&) = delete;
+
+	void Reserve(std::size_t count, const OccupancyBitmap&)
+	{
+		_transforms.Reserve(count);
+		_previousTransforms.Reserve(count);
+		_motion.Reserve(count);
+		_spin.Reserve(count);
+		_hierarchy.Reserve(count);
+		_cold.Reserve(count);
+		_transformFlags.Reserve(count);
+	}
+
+	// The object is built before the storage grows, so the arguments may
+	// refer to live objects (e.g. a relocated one).
+	template <typename... Args>
+	void EmplaceBack(const OccupancyBitmap& live, Args&&... args)
+	{
+		GameObject go(std::forward<Args>(args)...);
+		Extend(1, live);
+		Store(_size - 1, go);
+	}
+
+	void Extend(std::size_t count, const OccupancyBitmap&)
+	{
+		_size += count;
+		_transforms.Grow(_size);
+		_previousTransforms.Grow(_size);
+		_motion.Grow(_size);
+		_spin.Grow(_size);
+		_hierarchy.Grow(_size);
+		_cold.Grow(_size);
+		_transformFlags.Grow(_size);
+	}
+
+	// Pages are kept around for reuse, only the size changes.
+	void Truncate(std::size_t count) { _size = std::min(count, _size); }
+	void Clear() { _size = 0; }
+
+	std::size_t Size() const { return _size; }
+
+	template <typename... Args>
+	void Construct(std::size_t index, Args&&... args) { Store(index, GameObject(std::forward<Args>(args)...)); }
+	void Destroy(std::size_t) {}
+
+	GameObjectRef operator[](std::size_t index)
+	{
+		return GameObjectRef(_transforms[index], _motion[index], _hierarchy[index], _cold[index], _transformFlags[index]);
+	}
+
+	ConstGameObjectRef operator[](std::size_t index) const
+	{
+		return ConstGameObjectRef(_transforms[index], _motion[index], _hierarchy[index], _cold[index], _transformFlags[index]);
+	}
+
+	std::size_t ContiguousEnd(std::size_t index, std::size_t limit) const
+	{
+		return std::min(limit, (index | PageMask) + 1);
+	}
+
+	// The components, Size() slots of each
+	ComponentPages<Sisu::Affine3x4>::View Transforms() { return _transforms.Pages(); }
+	ComponentPages<Sisu::Affine3x4>::ConstView Transforms() const { return _transforms.Pages(); }
+	// The transforms as of the tick before the latest one, to interpolate from
+	ComponentPages<Sisu::Affine3x4>::View PreviousTransforms() { return _previousTransforms.Pages(); }
+	ComponentPages<Sisu::Affine3x4>::ConstView PreviousTransforms() const { return _previousTransforms.Pages(); }
+	ComponentPages<GameObjectMotion>::View Motion() { return _motion.Pages(); }
+	ComponentPages<GameObjectMotion>::ConstView Motion() const { return _motion.Pages(); }
+	ComponentPages<GameObjectSpin>::View Spin() { return _spin.Pages(); }
+	ComponentPages<GameObjectSpin>::ConstView Spin() const { return _spin.Pages(); }
+	ComponentPages<GameObjectHierarchy>::View Hierarchy() { return _hierarchy.Pages(); }
+	ComponentPages<GameObjectHierarchy>::ConstView Hierarchy() const { return _hierarchy.Pages(); }
+	ComponentPages<GameObjectCold>::View Cold() { return _cold.Pages(); }
+	ComponentPages<GameObjectCold>::ConstView Cold() const { return _cold.Pages(); }
+	ComponentPages<std::uint8_t>::View TransformFlags() { return _transformFlags.Pages(); }
+	ComponentPages<std::uint8_t>::ConstView TransformFlags() const { return _transformFlags.Pages(); }
+
+private:
+	void Store(std::size_t index, const GameObject& go)
+	{
+		_transforms[index] = go.transform;
+		_previousTransforms[index] = go.transform;
+		_motion[index] = GameObjectMotion{ go.rotQuat, go.localPosition, go.localScale, go.velocityPerSec, go.eulerRotPerSec };
+		_spin[index] = GameObjectSpin{ Sisu::Quat(), Sisu::Vector3::Zero(), 0.0f };
+		_hierarchy[index] = GameObjectHierarchy{ go.childrenStartIndex, go.childrenEndIndex, go.parentIndex, go.isRoot, go.hasChildren };
+		_cold[index] = GameObjectCold{ go.color, go.borderColor, go.localRotation, go.isVisible };
+		_transformFlags[index] = TransformFlag::LocalDirty;
+	}
+
+private:
+	ComponentPages<Sisu::Affine3x4> _transforms;
+	ComponentPages<Sisu::Affine3x4> _previousTransforms;
+	ComponentPages<GameObjectMotion> _motion;
+	ComponentPages<GameObjectSpin> _spin;
+	ComponentPages<GameObjectHierarchy> _hierarchy;
+	ComponentPages<GameObjectCold> _cold;
+	ComponentPages<std::uint8_t> _transformFlags;
+	std::size_t _size = 0;
+};
+
+using GameObjectArena = Arena<GameObject, GameObjectStorage>;
@@ -0,0 +1,297 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+#include "OccupancyBitmap.h"
+
+// Incrementally maintained index of the free ranges ("gaps") of an arena.
+// Gaps are always maximal, i.e. neighbouring free ranges get coalesced on
+// MarkFree, and split on MarkUsed. Every gap is stored three ways:
+//	= by start index, to find neighbours when merging / splitting;
+//	= by (size, start), to find the best fitting gap;
+//	= in a max-tree over start indices, to find the closest fitting gap
+//	  to a given index.
+// All of these are O(log n) per operation.
+class GapIndex
+{
+public:
+	static const std::size_t None = static_cast<std::size_t>(-1);
+
+	void Clear()
+	{
+		_byStart.clear();
+		_bySize.clear();
+		_freeCount = 0;
+		std::fill(_maxTree.begin(), _maxTree.end(), 0);
+	}
+
+	// Marks [start, start + count) as free. The range has to be currently
+	// in use; neighbouring gaps are merged into one.
+	void MarkFree(std::size_t start, std::size_t count)
+	{
+		if (count == 0) { return; }
+
+		auto end = start + count;
+
+		auto next = _byStart.find(end);
+		if (next != _byStart.end())
+		{
+			end += next->second;
+			Erase(next);
+		}
+
+		auto prev = _byStart.lower_bound(start);
+		if (prev != _byStart.begin())
+		{
+			--prev;
+			if (prev->first + prev->second == start)
+			{
+				start = prev->first;
+				Erase(prev);
+			}
+		}
+
+		Insert(start, end - start);
+	}
+
+	// Marks [start, start + count) as used. The range has to lie
+	// within a single gap; what remains of that gap is split in two.
+	void MarkUsed(std::size_t start, std::size_t count)
+	{
+		if (count == 0) { return; }
+
+		auto it = FindGapContaining(start);
+		if (it == _byStart.end()) { return; }
+
+		auto gapStart = it->first;
+		auto gapEnd = it->first + it->second;
+		Erase(it);
+
+		if (gapStart < start) { Insert(gapStart, start - gapStart); }
+		if (start + count < gapEnd) { Insert(start + count, gapEnd - (start + count)); }
+	}
+
+	// Forgets about everything at or past `newEnd`, i.e. the arena
+	// got shorter.
+	void Truncate(std::size_t newEnd)
+	{
+		while (!_byStart.empty() && std::prev(_byStart.end())->first >= newEnd)
+		{
+			Erase(std::prev(_byStart.end()));
+		}
+
+		if (newEnd == 0) { return; }
+
+		auto it = FindGapContaining(newEnd - 1);
+		if (it != _byStart.end() && it->first + it->second > newEnd)
+		{
+			auto gapStart = it->first;
+			Erase(it);
+			Insert(gapStart, newEnd - gapStart);
+		}
+	}
+
+	// Re-derives the gaps in [from, to) from the occupancy bits, after a
+	// batch of changes in that range. Gaps reaching into the range get
+	// rebuilt along with it, so the result is maximal again.
+	void Rescan(std::size_t from, std::size_t to, const OccupancyBitmap& isUsed)
+	{
+		auto it = _byStart.upper_bound(to);
+		while (it != _byStart.begin())
+		{
+			auto prev = std::prev(it);
+			if (prev->first + prev->second < from) { break; }
+
+			from = std::min(from, prev->first);
+			to = std::max(to, prev->first + prev->second);
+			Erase(prev);
+		}
+
+		auto end = std::min(to, isUsed.Size());
+		auto start = isUsed.NextUnset(from, end);
+		while (start < end)
+		{
+			auto stop = isUsed.NextSet(start, end);
+			Insert(start, stop - start);
+			start = isUsed.NextUnset(stop, end);
+		}
+	}
+
+	// Smallest gap that can hold `size` items; out of equally sized gaps,
+	// the one closest to the end of the arena.
+	bool TryFindBestFit(std::size_t size, std::size_t& placementIndex) const
+	{
+		auto it = _bySize.lower_bound(std::make_pair(size, std::size_t(0)));
+		if (it == _bySize.end()) { return false; }
+
+		auto sameSizeEnd = _bySize.lower_bound(std::make_pair(it->first + 1, std::size_t(0)));
+		placementIndex = std::prev(sameSizeEnd)->second;
+		return true;
+	}
+
+	// Start index for a range of `size` items, taken from the gap that is
+	// closest to `preferredIndex`; either aligned to the start or to the
+	// end of that gap, whichever is nearer. Returns None if no gap fits.
+	std::size_t FindClosestFit(std::size_t size, std::size_t preferredIndex) const
+	{
+		auto minSize = std::max(size, std::size_t(1));
+		auto leafCount = _maxTree.size() / 2;
+		if (leafCount == 0) { return None; }
+
+		// Gaps are disjoint, so only the nearest fitting gap on either
+		// side of the preferred index can be the closest one.
+		auto clampedIndex = std::min(preferredIndex, leafCount - 1);
+		auto before = FindLastFitting(1, 0, leafCount, clampedIndex + 1, minSize);
+		auto after = FindFirstFitting(1, 0, leafCount, clampedIndex + 1, minSize);
+
+		auto bestStart = None;
+		auto bestDistance = None;
+		auto bestGapSize = std::size_t(0);
+
+		for (auto gapStart : { before, after })
+		{
+			if (gapStart == None) { continue; }
+
+			auto gapSize = _byStart.at(gapStart);
+			auto gapEnd = gapStart + gapSize;
+
+			auto distToStart = Distance(gapStart, preferredIndex);
+			auto distToEnd = Distance(gapEnd, preferredIndex);
+			auto useDistanceToStart = distToStart <= distToEnd;
+			auto distance = useDistanceToStart ? distToStart : distToEnd;
+
+			// On a tie, prefer the bigger gap, then the one that comes first.
+			if (distance < bestDistance || (distance == bestDistance && gapSize > bestGapSize))
+			{
+				bestDistance = distance;
+				bestGapSize = gapSize;
+				bestStart = useDistanceToStart ? gapStart : gapEnd - size;
+			}
+		}
+
+		return bestStart;
+	}
+
+	// First gap starting at or after `from` that can hold `size` items, or None.
+	std::size_t FindFirstFit(std::size_t size, std::size_t from) const
+	{
+		auto leafCount = _maxTree.size() / 2;
+		if (from >= leafCount) { return None; }
+		return FindFirstFitting(1, 0, leafCount, from, std::max(size, std::size_t(1)));
+	}
+
+	// Start of the gap that ends exactly at `end`, or None.
+	std::size_t TrailingGapStart(std::size_t end) const
+	{
+		if (_byStart.empty()) { return None; }
+
+		auto last = std::prev(_byStart.end());
+		return last->first + last->second == end ? last->first : None;
+	}
+
+	std::size_t GapCount() const { return _byStart.size(); }
+	std::size_t LargestGap() const { return _bySize.empty() ? 0 : _bySize.rbegin()->first; }
+	std::size_t FreeCount() const { return _freeCount; }
+
+	// Visits (start, size) of each gap, biggest first.
+	template <typename Visitor>
+	void ForEachBySize(Visitor visit) const
+	{
+		for (auto it = _bySize.rbegin(); it != _bySize.rend(); ++it)
+		{
+			visit(it->second, it->first);
+		}
+	}
+
+private:
+	static std::size_t Distance(std::size_t a, std::size_t b) { return a > b ? a - b : b - a; }
+
+	std::map<std::size_t, std::size_t>::iterator FindGapContaining(std::size_t index)
+	{
+		auto it = _byStart.upper_bound(index);
+		if (it == _byStart.begin()) { return _byStart.end(); }
+
+		--it;
+		return index < it->first + it->second ? it : _byStart.end();
+	}
+
+	void Insert(std::size_t start, std::size_t size)
+	{
+		_byStart.emplace(start, size);
+		_bySize.emplace(size, start);
+		SetTreeLeaf(start, size);
+		_freeCount += size;
+	}
+
+	void Erase(std::map<std::size_t, std::size_t>::iterator it)
+	{
+		_bySize.erase(std::make_pair(it->second, it->first));
+		_freeCount -= it->second;
+		SetTreeLeaf(it->first, 0);
+		_byStart.erase(it);
+	}
+
+	void SetTreeLeaf(std::size_t index, std::size_t value)
+	{
+		auto leafCount = _maxTree.size() / 2;
+		if (index >= leafCount)
+		{
+			if (value == 0) { return; }
+			GrowTree(index + 1);
+			leafCount = _maxTree.size() / 2;
+		}
+
+		auto node = leafCount + index;
+		_maxTree[node] = value;
+		for (node /= 2; node > 0; node /= 2)
+		{
+			_maxTree[node] = std::max(_maxTree[2 * node], _maxTree[2 * node + 1]);
+		}
+	}
+
+	void GrowTree(std::size_t minLeafCount)
+	{
+		std::size_t leafCount = 64;
+		while (leafCount < minLeafCount) { leafCount *= 2; }
+
+		_maxTree.assign(2 * leafCount, 0);
+		for (const auto& gap : _byStart) { _maxTree[leafCount + gap.first] = gap.second; }
+		for (auto node = leafCount - 1; node > 0; --node)
+		{
+			_maxTree[node] = std::max(_maxTree[2 * node], _maxTree[2 * node + 1]);
+		}
+	}
+
+	// Last gap start in [lo, hi) that is below `limit`, and fits minSize.
+	std::size_t FindLastFitting(std::size_t node, std::size_t lo, std::size_t hi,
+								std::size_t limit, std::size_t minSize) const
+	{
+		if (lo >= limit || _maxTree[node] < minSize) { return None; }
+		if (hi - lo == 1) { return lo; }
+
+		auto mid = lo + (hi - lo) / 2;
+		auto found = FindLastFitting(2 * node + 1, mid, hi, limit, minSize);
+		return found != None ? found : FindLastFitting(2 * node, lo, mid, limit, minSize);
+	}
+
+	// First gap start in [lo, hi) that is at or above `from`, and fits minSize.
+	std::size_t FindFirstFitting(std::size_t node, std::size_t lo, std::size_t hi,
+								 std::size_t from, std::size_t minSize) const
+	{
+		if (hi <= from || _maxTree[node] < minSize) { return None; }
+		if (hi - lo == 1) { return lo; }
+
+		auto mid = lo + (hi - lo) / 2;
+		auto found = FindFirstFitting(2 * node, lo, mid, from, minSize);
+		return found != None ? found : FindFirstFitting(2 * node + 1, mid, hi, from, minSize);
+	}
+
+private:
+	std::map<std::size_t, std::size_t> _byStart;				// start -> size
+	std::set<std::pair<std::size_t, std::size_t>> _bySize;		// (size, start)
+	std::vector<std::size_t> _maxTree;							// implicit binary tree, leaves: gap size by start
+	std::size_t _freeCount = 0;									// sum of all gap sizes
+};
@@ -0,0 +1,227 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "Arena.h"
+#include "GameObject.h"
+
+// Rewrites an Arena<GameObject> in breadth-first hierarchy order: roots first,
+// then each family of kids in the order their parents ended up in. This closes
+// every gap, and puts objects in the order the transform update visits them.
+//
+// The work can be spread over several frames: Step() stops after (about) a
+// given number of moves, and the hierarchy is valid between steps, even if
+// objects get added or removed in the meantime. A family of kids always moves
+// as a whole, so a step may overshoot its budget by up to one family.
+class HierarchyCompactor
+{
+public:
+	static const std::size_t Unlimited = static_cast<std::size_t>(-1);
+	static const std::size_t NotMapped = static_cast<std::size_t>(-1);
+
+	// Compacts the whole arena in one go, e.g. on a level transition.
+	// Returns the remap table: old index -> new index, or NotMapped.
+	template <typename Storage>
+	static std::vector<std::size_t> Compact(Arena<GameObject, Storage>& arena)
+	{
+		HierarchyCompactor compactor;
+		compactor.Begin(arena);
+		compactor.Step(arena, Unlimited);
+		return compactor.BuildRemap(arena);
+	}
+
+	// Starts a new pass; the remap table will map from the indices as they are now.
+	template <typename Storage>
+	void Begin(const Arena<GameObject, Storage>& arena)
+	{
+		_handlesAtBegin.assign(arena.OccupiedSize(), ArenaHandle());
+		arena.ForEachLiveRange([&](std::size_t first, std::size_t last)
+		{
+			for (auto index = first; index < last; ++index)
+			{
+				_handlesAtBegin[index] = arena.HandleAt(index);
+			}
+		});
+
+		_moveCount = 0;
+		_isDone = false;
+	}
+
+	// Moves at most (about) maxMoves objects; returns true once the arena is compact.
+	template <typename Storage>
+	bool Step(Arena<GameObject, Storage>& arena, std::size_t maxMoves)
+	{
+		CollectFamilies(arena);
+
+		std::size_t movesLeft = maxMoves;
+		std::size_t cursor = 0;
+
+		for (const auto& family : _families)
+		{
+			std::size_t start, count;
+			Resolve(arena, family, OUT start, OUT count);
+
+			if (start != cursor)
+			{
+				if (movesLeft == 0) { return false; }
+
+				auto moves = MoveFamily(arena, start, count, cursor);
+				movesLeft -= std::min(moves, movesLeft);
+				_moveCount += moves;
+			}
+
+			cursor += count;
+		}
+
+		arena.TrimEnd();
+		_isDone = true;
+		return true;
+	}
+
+	bool IsDone() const { return _isDone; }
+	std::size_t MoveCount() const { return _moveCount; }
+
+	// Old index (as of Begin) -> current index; NotMapped for slots that
+	// were unused, or whose object got removed since.
+	template <typename Storage>
+	std::vector<std::size_t> BuildRemap(const Arena<GameObject, Storage>& arena) const
+	{
+		std::vector<std::size_t> remap(_handlesAtBegin.size(), std::size_t(NotMapped));
+		for (std::size_t oldIndex = 0; oldIndex < _handlesAtBegin.size(); ++oldIndex)
+		{
+			std::size_t newIndex;
+			if (arena.TryGetIndex(_handlesAtBegin[oldIndex], OUT newIndex))
+			{
+				remap[oldIndex] = newIndex;
+			}
+		}
+
+		return remap;
+	}
+
+private:
+	// Either a single root, or all the kids of a parent. These are the
+	// units that get moved, because kids have to stay next to each other.
+	struct Family
+	{
+		ArenaHandle anchor;		// the root itself, or the parent of the kids
+		bool isRoot;
+	};
+
+	template <typename Storage>
+	void CollectFamilies(const Arena<GameObject, Storage>& arena)
+	{
+		_families.clear();
+		arena.ForEachLiveRange([&](std::size_t first, std::size_t last)
+		{
+			for (auto index = first; index < last; ++index)
+			{
+				if (arena[index].isRoot)
+				{
+					_families.push_back(Family{ arena.HandleAt(index), true });
+				}
+			}
+		});
+
+		for (std::size_t i = 0; i < _families.size(); ++i)
+		{
+			std::size_t start, count;
+			Resolve(arena, _families[i], OUT start, OUT count);
+
+			for (auto index = start; index < start + count; ++index)
+			{
+				if (arena[index].hasChildren)
+				{
+					_families.push_back(Family{ arena.HandleAt(index), false });
+				}
+			}
+		}
+	}
+
+	template <typename Storage>
+	static void Resolve(const Arena<GameObject, Storage>& arena, Family family,
+						OUT std::size_t& start, OUT std::size_t& count)
+	{
+		std::size_t anchorIndex = 0;
+		arena.TryGetIndex(family.anchor, OUT anchorIndex);
+
+		if (family.isRoot)
+		{
+			start = anchorIndex;
+			count = 1;
+		}
+		else
+		{
+			const auto& parent = arena[anchorIndex];
+			start = parent.childrenStartIndex;
+			count = parent.childrenEndIndex - parent.childrenStartIndex + 1;
+		}
+	}
+
+	template <typename Storage>
+	static void FamilyAt(const Arena<GameObject, Storage>& arena, std::size_t index,
+						 OUT std::size_t& start, OUT std::size_t& count)
+	{
+		const auto& go = arena[index];
+		if (go.isRoot)
+		{
+			start = index;
+			count = 1;
+		}
+		else
+		{
+			const auto& parent = arena[go.parentIndex];
+			start = parent.childrenStartIndex;
+			count = parent.childrenEndIndex - parent.childrenStartIndex + 1;
+		}
+	}
+
+	// Moves the family at [start, start + count) to `target`, which is at
+	// the end of the already compacted part. Whatever is in the way gets
+	// moved out first, to somewhere past the target range.
+	template <typename Storage>
+	static std::size_t MoveFamily(Arena<GameObject, Storage>& arena, std::size_t start,
+								  std::size_t count, std::size_t target)
+	{
+		std::size_t moves = 0;
+
+		for (auto index = target; index < target + count; ++index)
+		{
+			auto isOwnSlot = index >= start && index < start + count;
+			if (isOwnSlot || arena.CanAddItemAt(index)) { continue; }
+
+			std::size_t blockerStart, blockerCount;
+			FamilyAt(arena, index, OUT blockerStart, OUT blockerCount);
+
+			auto to = arena.GetStartIndexForGapFrom(blockerCount, target + count);
+			moves += MoveBlock(arena, blockerStart, blockerCount, to);
+		}
+
+		moves += MoveBlock(arena, start, count, target);
+		return moves;
+	}
+
+	template <typename Storage>
+	static std::size_t MoveBlock(Arena<GameObject, Storage>& arena, std::size_t from,
+								 std::size_t count, std::size_t to)
+	{
+		auto isRoot = arena[from].isRoot;
+		auto parentIndex = arena[from].parentIndex;
+
+		GameObject::RelocateBlock(arena, from, count, to);
+
+		if (!isRoot)
+		{
+			arena[parentIndex].childrenStartIndex = to;
+			arena[parentIndex].childrenEndIndex = to + count - 1;
+		}
+
+		return count;
+	}
+
+private:
+	std::vector<ArenaHandle> _handlesAtBegin;
+	std::vector<Family> _families;
+	std::size_t _moveCount = 0;
+	bool _isDone = false;
+};
@@ -3,11 +3,23 @@
 #include <wrl/client.h>
 
 class GameTimer;
+class JobSystem;
+class OccupancyBitmap;
 struct ID3D12Device;
 struct ID3D12GraphicsCommandList;
 struct ID3D12DescriptorHeap;
 struct UIElement;
 
+// What the renderer did in its last frame
+struct RendererStats
+{
+	std::size_t instanceCount = 0;			// packed, over all cameras
+	std::size_t instancesTruncated = 0;		// visible, but past the end of the instance buffer, so not drawn
+	std::size_t instancesUploaded = 0;		// of those, copied to the frame's upload buffer
+	std::size_t instanceBytesUploaded = 0;
+	std::size_t uiBytesUploaded = 0;
+};
+
 struct IRenderer
 {
 	virtual ~IRenderer() {};
@@ -22,8 +34,12 @@ struct IRenderer
 	virtual void OnResize() = 0;
 	virtual void Update(const GameTimer& gt) = 0;
 	virtual std::size_t Draw(const GameTimer& gt) = 0;
-	virtual void SetDirty() = 0;
+	virtual void SetDirty() = 0;							// every object, e.g. after it changed colors
+	virtual void SetDirtySlots(const OccupancyBitmap& slots, std::size_t first, std::size_t last) = 0;	// set in [first, last)
 	virtual void SetWireframe(bool state) = 0;
+	virtual void SetInterpolationAlpha(float alpha) = 0;	// see TransformUpdateSystem::InterpolationAlpha
+	virtual void SetJobSystem(JobSystem* jobs) = 0;			// none: everything on the calling thread
+	virtual RendererStats GetStats() const = 0;
 
 	virtual std::size_t AddUIRenderItem(const UIElement& uiElement) = 0;
 	virtual void RefreshUIItem(const UIElement& uiElement) = 0;
@@ -0,0 +1,333 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "JobSystem.h"
+
+// Lays out the instance buffer with one contiguous range per camera, so
+// that each camera draws only what it sees. It knows nothing about D3D:
+// the instances come from an array, and go out through a callback, e.g.
+// UploadBuffer::CopyRange, or a plain vector in tests.
+//
+// PackedInstances keeps the packed buffer on the CPU as well, with the
+// version at which each slot last changed. Every frame resource's copy
+// remembers the version it holds, and catches up by copying only the
+// slots that changed since.
+//
+// ChunkedGather fills the array the instances come from, on all threads,
+// and refills just the items that changed, when only some did.
+
+// Where a camera's instances are in the instance buffer, in instances
+struct InstanceRange
+{
+	std::uint32_t first = 0;
+	std::uint32_t count = 0;
+};
+
+namespace InstancePacking
+{
+	// One range per camera, in camera order, each right after the one
+	// before. The buffer holds `capacity` instances; a camera that doesn't
+	// fit gets what's left, down to nothing. Returns the instances used.
+	inline std::uint32_t Layout(const std::vector<std::vector<std::uint32_t>>& visibleByCamera,
+								std::uint32_t capacity,
+								std::vector<InstanceRange>& ranges)
+	{
+		ranges.resize(visibleByCamera.size());
+
+		std::uint32_t used = 0;
+		for (std::size_t camera = 0; camera < visibleByCamera.size(); ++camera)
+		{
+			auto count = static_cast<std::uint32_t>(std::min<std::size_t>(visibleByCamera[camera].size(), capacity - used));
+			ranges[camera].first = used;
+			ranges[camera].count = count;
+			used += count;
+		}
+
+		return used;
+	}
+
+	// Writes instances[visible[i]] of each camera to slot range.first + i,
+	// calling write(slot, instance) once per slot, in slot order.
+	template <typename Instance, typename Write>
+	void Pack(const std::vector<Instance>& instances,
+			  const std::vector<std::vector<std::uint32_t>>& visibleByCamera,
+			  const std::vector<InstanceRange>& ranges,
+			  Write&& write)
+	{
+		for (std::size_t camera = 0; camera < ranges.size(); ++camera)
+		{
+			const auto& visible = visibleByCamera[camera];
+			const auto& range = ranges[camera];
+			for (std::uint32_t i = 0; i < range.count; ++i)
+			{
+				write(range.first + i, instances[visible[i]]);
+			}
+		}
+	}
+}
+
+// The packed instance buffer, and when each slot of it last changed. The
+// instances are compared bytewise, so Instance mustn't have padding that
+// isn't zeroed.
+template <typename Instance>
+class PackedInstances
+{
+public:
+	// Packs again (see InstancePacking), and gives each slot whose
+	// contents changed the next version. Returns the number of them.
+	// Instances that don't fit in `capacity` are left out, and counted in
+	// TruncatedCount().
+	std::size_t Pack(const std::vector<Instance>& instances,
+					 const std::vector<std::vector<std::uint32_t>>& visibleByCamera,
+					 std::uint32_t capacity)
+	{
+		auto size = InstancePacking::Layout(visibleByCamera, capacity, _ranges);
+		_truncatedCount = 0;
+		for (const auto& visible : visibleByCamera) { _truncatedCount += visible.size(); }
+		_truncatedCount -= size;
+		auto nextVersion = _version + 1;
+		std::size_t changedCount = 0;
+
+		InstancePacking::Pack(instances, visibleByCamera, _ranges, [&](std::uint32_t slot, const Instance& instance)
+		{
+			changedCount += Store(slot, instance, nextVersion) ? 1 : 0;
+		});
+
+		_size = size;
+		if (changedCount > 0)
+		{
+			_version = nextVersion;
+		}
+
+		return changedCount;
+	}
+
+	// Pack, for when the cameras see the same instances as in the last Pack,
+	// and only the given ones, in increasing order, may have changed: only
+	// their slots get compared. Each camera's visible list is in increasing
+	// order too, so finding them is a search from the last one found.
+	std::size_t Repack(const std::vector<Instance>& instances,
+					   const std::vector<std::vector<std::uint32_t>>& visibleByCamera,
+					   const std::vector<std::uint32_t>& changedInstances)
+	{
+		auto nextVersion = _version + 1;
+		std::size_t changedCount = 0;
+
+		for (std::size_t camera = 0; camera < _ranges.size(); ++camera)
+		{
+			const auto& visible = visibleByCamera[camera];
+			const auto& range = _ranges[camera];
+			auto it = visible.begin();
+			auto end = visible.begin() + range.count;
+			for (auto instance : changedInstances)
+			{
+				it = std::lower_bound(it, end, instance);
+				if (it == end) { break; }
+				if (*it != instance) { continue; }
+
+				auto slot = range.first + static_cast<std::uint32_t>(it - visible.begin());
+				changedCount += Store(slot, instances[instance], nextVersion) ? 1 : 0;
+			}
+		}
+
+		if (changedCount > 0)
+		{
+			_version = nextVersion;
+		}
+
+		return changedCount;
+	}
+
+	// Calls write(firstSlot, instances, count) for each run of consecutive
+	// slots that changed after `version`, in slot order, so that each run
+	// can be copied in one go. Returns the number of slots.
+	template <typename Write>
+	std::size_t CopyChangedSince(std::uint64_t version, Write&& write) const
+	{
+		if (version >= _version)
+		{
+			return 0;
+		}
+
+		std::size_t copiedCount = 0;
+		std::uint32_t slot = 0;
+		while (slot < _size)
+		{
+			if (_slotVersions[slot] <= version)
+			{
+				slot++;
+				continue;
+			}
+
+			auto first = slot;
+			while (slot < _size && _slotVersions[slot] > version) { slot++; }
+
+			write(first, &_slots[first], slot - first);
+			copiedCount += slot - first;
+		}
+
+		return copiedCount;
+	}
+
+	// Starts from 0, before anything was packed
+	std::uint64_t Version() const { return _version; }
+	std::uint32_t Size() const { return _size; }
+	std::size_t TruncatedCount() const { return _truncatedCount; }
+	const std::vector<InstanceRange>& Ranges() const { return _ranges; }
+
+private:
+	// Slots come in order, so new ones go on the end. The ones past the old
+	// size hold whatever was there before, so they count as changed.
+	bool Store(std::uint32_t slot, const Instance& instance, std::uint64_t nextVersion)
+	{
+		if (slot == _slots.size())
+		{
+			_slots.push_back(instance);
+			_slotVersions.push_back(nextVersion);
+			return true;
+		}
+
+		if (slot >= _size || std::memcmp(&_slots[slot], &instance, sizeof(Instance)) != 0)
+		{
+			_slots[slot] = instance;
+			_slotVersions[slot] = nextVersion;
+			return true;
+		}
+
+		return false;
+	}
+
+	std::vector<Instance> _slots;
+	std::vector<std::uint64_t> _slotVersions;
+	std::vector<InstanceRange> _ranges;
+	std::uint32_t _size = 0;
+	std::size_t _truncatedCount = 0;
+	std::uint64_t _version = 0;
+};
+
+// Gathers the live items of an arena that pass a filter into a compact
+// array, in index order, on all of the job system's threads. The arena is
+// cut into chunks; each chunk counts its included items, an exclusive
+// prefix sum over the counts gives each chunk its first output slot, and
+// then all chunks write at once, each to its own slots.
+class ChunkedGather
+{
+public:
+	static const std::size_t ChunkSize = 1024;
+
+	// Splits the arena's live items into chunks and counts the included
+	// ones, isIncluded(index). Returns the count, i.e. the output size.
+	template <typename ArenaType, typename IsIncluded>
+	std::uint32_t Count(JobSystem* jobs, const ArenaType& arena, IsIncluded isIncluded)
+	{
+		_chunks.clear();
+		arena.ForEachLiveRange([&](std::size_t first, std::size_t last)
+		{
+			for (; first < last; first += ChunkSize)
+			{
+				_chunks.push_back(Chunk{ first, std::min(first + ChunkSize, last), 0, 0 });
+			}
+		});
+
+		_slotOf.assign(_chunks.empty() ? 0 : _chunks.back().last, std::uint32_t(NoSlot));
+
+		ForEachChunk(jobs, [&](Chunk& chunk)
+		{
+			for (auto index = chunk.first; index < chunk.last; ++index)
+			{
+				chunk.count += isIncluded(index) ? 1 : 0;
+			}
+		});
+
+		std::uint32_t total = 0;
+		for (auto& chunk : _chunks)
+		{
+			chunk.offset = total;
+			total += chunk.count;
+		}
+
+		return total;
+	}
+
+	// Calls write(slot, index) for every included item of the last Count,
+	// slot being its place among them. isIncluded has to answer as it did.
+	template <typename IsIncluded, typename WriteItem>
+	void Write(JobSystem* jobs, IsIncluded isIncluded, WriteItem write)
+	{
+		ForEachChunk(jobs, [&](Chunk& chunk)
+		{
+			auto slot = chunk.offset;
+			for (auto index = chunk.first; index < chunk.last; ++index)
+			{
+				if (isIncluded(index))
+				{
+					_slotOf[index] = slot;
+					write(slot++, index);
+				}
+			}
+		});
+	}
+
+	// Same, but only for the given items, as long as the live items and
+	// what's included are still as they were in the last Write. Items that
+	// weren't included are skipped. The slots written go in `slots`, in
+	// the order of `indices`.
+	template <typename WriteItem>
+	void WriteItems(JobSystem* jobs, const std::vector<std::size_t>& indices,
+					std::vector<std::uint32_t>& slots, WriteItem write)
+	{
+		slots.clear();
+		_items.clear();
+		for (auto index : indices)
+		{
+			if (index < _slotOf.size() && _slotOf[index] != NoSlot)
+			{
+				slots.push_back(_slotOf[index]);
+				_items.push_back(index);
+			}
+		}
+
+		auto taskCount = (_items.size() + ChunkSize - 1) / ChunkSize;
+		auto writeTask = [&](std::size_t task)
+		{
+			auto last = std::min((task + 1) * ChunkSize, _items.size());
+			for (auto i = task * ChunkSize; i < last; ++i) { write(slots[i], _items[i]); }
+		};
+
+		if (jobs == nullptr || taskCount <= 1)
+		{
+			for (std::size_t task = 0; task < taskCount; ++task) { writeTask(task); }
+			return;
+		}
+
+		jobs->ParallelFor(taskCount, writeTask);
+	}
+
+private:
+	static const std::uint32_t NoSlot = ~std::uint32_t(0);
+
+	struct Chunk
+	{
+		std::size_t first, last;
+		std::uint32_t offset, count;
+	};
+
+	// On the calling thread alone without a job system, or for one chunk
+	template <typename Task>
+	void ForEachChunk(JobSystem* jobs, Task task)
+	{
+		if (jobs == nullptr || _chunks.size() <= 1)
+		{
+			for (auto& chunk : _chunks) { task(chunk); }
+			return;
+		}
+
+		jobs->ParallelFor(_chunks.size(), [&](std::size_t i) { task(_chunks[i]); });
+	}
+
+	std::vector<Chunk> _chunks;
+	std::vector<std::uint32_t> _slotOf;		// by index, as of the last Write
+	std::vector<std::size_t> _items;		// WriteItems' included ones
+};
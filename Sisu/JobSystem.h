@@ -0,0 +1,160 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool, for data-parallel loops like the
+// transform update.
+//
+// ParallelFor() deals the tasks out to one queue per thread, in contiguous
+// blocks; every thread works through its own queue from the back, and once
+// that's empty, steals from the front of the others. The calling thread
+// works too, so a pool of N threads has N - 1 workers. One ParallelFor() at
+// a time, from the thread that owns the pool; tasks must not throw.
+class JobSystem
+{
+public:
+	// 0: one thread per core
+	explicit JobSystem(std::size_t threadCount = 0)
+	{
+		if (threadCount == 0) { threadCount = std::max(std::thread::hardware_concurrency(), 1u); }
+
+		for (std::size_t i = 0; i < threadCount; ++i) { _queues.emplace_back(new Queue()); }
+		for (std::size_t i = 1; i < threadCount; ++i) { _workers.emplace_back([this, i]() { WorkerLoop(i); }); }
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_wakeMutex);
+			_isStopping = true;
+		}
+
+		_wake.notify_all();
+		for (auto& worker : _workers) { worker.join(); }
+	}
+
+	std::size_t ThreadCount() const { return _queues.size(); }
+
+	// Calls task(i) for every i in [0, taskCount), on all threads, and
+	// returns once they're all done.
+	void ParallelFor(std::size_t taskCount, std::function<void(std::size_t)> task)
+	{
+		if (taskCount == 0) { return; }
+		if (ThreadCount() == 1 || taskCount == 1)
+		{
+			for (std::size_t i = 0; i < taskCount; ++i) { task(i); }
+			return;
+		}
+
+		// The task has to be in place before the first index is in a queue:
+		// a worker still busy with the previous loop might pick it up.
+		_task = std::move(task);
+		_remaining.store(taskCount, std::memory_order_relaxed);
+
+		auto threadCount = ThreadCount();
+		for (std::size_t thread = 0; thread < threadCount; ++thread)
+		{
+			auto& queue = *_queues[thread];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			for (auto i = taskCount * thread / threadCount; i < taskCount * (thread + 1) / threadCount; ++i)
+			{
+				queue.tasks.push_back(i);
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_wakeMutex);
+			_generation++;
+		}
+
+		_wake.notify_all();
+		RunTasks(0);
+
+		// Nothing left to take; wait for the tasks still running elsewhere
+		while (_remaining.load(std::memory_order_acquire) != 0) { std::this_thread::yield(); }
+	}
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::size_t> tasks;
+		char padding[64];
+	};
+
+	void WorkerLoop(std::size_t self)
+	{
+		std::size_t seenGeneration = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(_wakeMutex);
+				_wake.wait(lock, [&]() { return _isStopping || _generation != seenGeneration; });
+				if (_isStopping) { return; }
+				seenGeneration = _generation;
+			}
+
+			RunTasks(self);
+		}
+	}
+
+	void RunTasks(std::size_t self)
+	{
+		std::size_t index;
+		while (TryPop(self, index) || TrySteal(self, index))
+		{
+			_task(index);
+			_remaining.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+
+	bool TryPop(std::size_t self, std::size_t& index)
+	{
+		auto& queue = *_queues[self];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) { return false; }
+
+		index = queue.tasks.back();
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	bool TrySteal(std::size_t self, std::size_t& index)
+	{
+		for (std::size_t i = 1; i < _queues.size(); ++i)
+		{
+			auto& queue = *_queues[(self + i) % _queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty()) { continue; }
+
+			index = queue.tasks.front();
+			queue.tasks.pop_front();
+			return true;
+		}
+
+		return false;
+	}
+
+private:
+	std::vector<std::unique_ptr<Queue>> _queues;
+	std::vector<std::thread> _workers;
+
+	std::function<void(std::size_t)> _task;
+	std::atomic<std::size_t> _remaining{ 0 };
+
+	std::mutex _wakeMutex;
+	std::condition_variable _wake;
+	std::size_t _generation = 0;
+	bool _isStopping = false;
+};
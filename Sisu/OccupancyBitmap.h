@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// One bit per arena slot, packed into 64-bit words, so that skipping over
+// runs of used / unused slots is a count-trailing-zeros per word instead
+// of a test per slot.
+class OccupancyBitmap
+{
+public:
+	static const std::size_t BitsPerWord = 64;
+
+	static std::size_t CountTrailingZeros(std::uint64_t word)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, word);
+		return index;
+#else
+		return static_cast<std::size_t>(__builtin_ctzll(word));
+#endif
+	}
+
+	void Reserve(std::size_t bitCount) { _words.reserve(WordCount(bitCount)); }
+	void Clear() { _words.clear(); _size = 0; }
+	std::size_t Size() const { return _size; }
+
+	void PushBack(bool value)
+	{
+		if (_size % BitsPerWord == 0) { _words.push_back(0); }
+		if (value) { Set(_size); }
+		_size++;
+	}
+
+	void Truncate(std::size_t bitCount)
+	{
+		_words.resize(WordCount(bitCount));
+		if (bitCount % BitsPerWord != 0)
+		{
+			_words.back() &= Bit(bitCount) - 1;
+		}
+
+		_size = bitCount;
+	}
+
+	bool Test(std::size_t index) const
+	{
+		return (_words[index / BitsPerWord] >> (index % BitsPerWord)) & 1;
+	}
+
+	void Set(std::size_t index) { _words[index / BitsPerWord] |= Bit(index); }
+	void Reset(std::size_t index) { _words[index / BitsPerWord] &= ~Bit(index); }
+
+	// First used index in [from, limit), or limit if there's none.
+	std::size_t NextSet(std::size_t from, std::size_t limit) const
+	{
+		return Find(from, limit, 0);
+	}
+
+	// First unused index in [from, limit), or limit if there's none.
+	std::size_t NextUnset(std::size_t from, std::size_t limit) const
+	{
+		return Find(from, limit, ~std::uint64_t(0));
+	}
+
+private:
+	static std::size_t WordCount(std::size_t bitCount) { return (bitCount + BitsPerWord - 1) / BitsPerWord; }
+	static std::uint64_t Bit(std::size_t index) { return std::uint64_t(1) << (index % BitsPerWord); }
+
+	std::size_t Find(std::size_t from, std::size_t limit, std::uint64_t flip) const
+	{
+		if (from >= limit) { return limit; }
+
+		auto wordIndex = from / BitsPerWord;
+		auto word = (_words[wordIndex] ^ flip) & (~std::uint64_t(0) << (from % BitsPerWord));
+		auto lastWordIndex = (limit - 1) / BitsPerWord;
+
+		while (word == 0)
+		{
+			if (++wordIndex > lastWordIndex) { return limit; }
+			word = _words[wordIndex] ^ flip;
+		}
+
+		auto found = wordIndex * BitsPerWord + CountTrailingZeros(word);
+		return found < limit ? found : limit;
+	}
+
+private:
+	std::vector<std::uint64_t> _words;
+	std::size_t _size = 0;
+};
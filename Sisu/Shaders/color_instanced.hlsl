@@ -1,9 +1,11 @@
 struct InstanceData
 {
-	float4x4 world;
+	// Affine: the 4x4 world matrix transposed, minus its constant (0, 0, 0, 1) row
+	row_major float3x4 world;
 	float4 color;
 	float4 borderColor;
 	float3 localScale;
+	float pad;
 };
 
 StructuredBuffer<InstanceData> gInstanceData : register(t0);
@@ -26,6 +28,13 @@ cbuffer cbPass : register(b0)
 	float gDeltaTime;	
 };
 
+// Where the camera's range starts in gInstanceData: SV_InstanceID doesn't
+// include StartInstanceLocation
+cbuffer cbInstanceRange : register(b2)
+{
+	uint gFirstInstance;
+};
+
 struct VertexIn
 {
 	float3 PosL : POSITION;
@@ -43,12 +52,13 @@ struct VertexOut
 VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout;
-	float4 posW = mul(float4(vin.PosL, 1.0f), gInstanceData[instanceID].world);
+	uint index = gFirstInstance + instanceID;
+	float4 posW = float4(mul(gInstanceData[index].world, float4(vin.PosL, 1.0f)), 1.0f);
 	vout.PosH = mul(posW, gViewProj);
-	vout.Color = gInstanceData[instanceID].color;
+	vout.Color = gInstanceData[index].color;
 	vout.TexCoord = vin.PosL;
-	vout.LocScale = gInstanceData[instanceID].localScale;
-	vout.BorderColor = gInstanceData[instanceID].borderColor;
+	vout.LocScale = gInstanceData[index].localScale;
+	vout.BorderColor = gInstanceData[index].borderColor;
 	return vout;
 }
 
@@ -10,6 +10,7 @@ bool SisuApp::Init(int width, int height, const std::wstring& title)
 	auto success = true;
 
 	success &= InitArenas();
+	success &= InitJobSystem();
 
 	success &= InitGameTimer();
 	success &= InitInputService(_gameTimer.get());
@@ -44,8 +45,10 @@ bool SisuApp::Init(int width, int height, const std::wstring& title)
 	_cameraService->SetCameras(cameras);
 
 	//TODO proper setup
-	auto yetAnotherCubeIndex = GameObject::AddToArena(*_gameObjects, GameObject());
-	auto& yac = (*_gameObjects)[yetAnotherCubeIndex];
+	GameObjectArena::ScopedBatch batch(*_gameObjects);
+
+	auto yetAnotherCubeIndex = GameObject::EmplaceInArena(*_gameObjects);
+	auto&& yac = (*_gameObjects)[yetAnotherCubeIndex];
 
 	yac.isVisible = true;
 	yac.eulerRotPerSec = Sisu::Vector3(0.5, 0.5, 0.5);
@@ -54,8 +57,8 @@ bool SisuApp::Init(int width, int height, const std::wstring& title)
 	yac.color = Sisu::Color::Green();
 	yac.borderColor = Sisu::Color::Blue();
 
-	auto parentIndex = GameObject::AddToArena(*_gameObjects, GameObject());
-	auto& testObject = (*_gameObjects)[parentIndex];
+	auto parentIndex = GameObject::EmplaceInArena(*_gameObjects);
+	auto&& testObject = (*_gameObjects)[parentIndex];
 
 	testObject.isVisible = true;
 	testObject.velocityPerSec = Sisu::Vector3(0.0, 0.0, 0.0);
@@ -63,8 +66,8 @@ bool SisuApp::Init(int width, int height, const std::wstring& title)
 	testObject.localScale = Sisu::Vector3(1.0, 1.0, 1.0);
 	testObject.borderColor = Sisu::Color::White();
 
-	auto childIndex = GameObject::AddChild(*_gameObjects, parentIndex, GameObject());
-	auto& child = (*_gameObjects)[childIndex];
+	auto childIndex = GameObject::EmplaceChild(*_gameObjects, parentIndex);
+	auto&& child = (*_gameObjects)[childIndex];
 
 	child.isVisible = true;
 	child.localPosition = Sisu::Vector3(-2.0, 0.0, 0.0);
@@ -73,8 +76,8 @@ bool SisuApp::Init(int width, int height, const std::wstring& title)
 	child.color = Sisu::Color::Red();
 	child.borderColor = Sisu::Color::Black();
 
-	auto grandKidIndex = GameObject::AddChild(*_gameObjects, childIndex, GameObject());
-	auto& grandKid = (*_gameObjects)[grandKidIndex];
+	auto grandKidIndex = GameObject::EmplaceChild(*_gameObjects, childIndex);
+	auto&& grandKid = (*_gameObjects)[grandKidIndex];
 
 	grandKid.isVisible = true;
 	grandKid.localPosition = Sisu::Vector3(-2.0, 0.0, 0.0);
@@ -88,7 +91,7 @@ bool SisuApp::Init(int width, int height, const std::wstring& title)
 
 bool SisuApp::InitArenas()
 {
-	_gameObjects = std::make_unique<Arena<GameObject>>(MaxGameObjectCount);
+	_gameObjects = std::make_unique<GameObjectArena>(MaxGameObjectCount);
 	return _gameObjects != nullptr;
 }
 
@@ -111,9 +114,10 @@ bool SisuApp::InitCameraService(IInputService* const inputService, WindowManager
 }
 
 bool SisuApp::InitRenderer(WindowManager* const windowManager, GameTimer* const gt,
-	Arena<GameObject>* const arena, ICameraService* const camService)
+	GameObjectArena* const arena, ICameraService* const camService)
 {
 	_renderer = std::make_unique<BrickRenderer>(windowManager, gt, arena, camService);
+	_renderer->SetJobSystem(_jobSystem.get());
 	return _renderer->Init();
 }
 
@@ -130,9 +134,19 @@ bool SisuApp::InitWindowManager(IInputService* const inputService, int width, in
 	return _windowManager->IsSetup();
 }
 
+bool SisuApp::InitJobSystem()
+{
+	_jobSystem = std::make_unique<JobSystem>();
+	return _jobSystem != nullptr;
+}
+
 bool SisuApp::InitTransformUpdateSystem()
 {
 	_transformUpdateSystem = std::make_unique<TransformUpdateSystem>();
+	_transformUpdateSystem->SetJobSystem(_jobSystem.get());
+
+	// Drawn interpolated, so the simulation doesn't have to keep up with the display
+	_transformUpdateSystem->SetUpdatePeriod(1.0f / 30.0f);
 	return _transformUpdateSystem != nullptr;
 }
 
@@ -176,13 +190,17 @@ void SisuApp::Update()
 	static std::size_t charIndex = 0;
 
 	const auto& gt = *_gameTimer;
-	auto hasSomethingChanged = _transformUpdateSystem->Update(gt, *_gameObjects);
-
-	if (hasSomethingChanged)
+	if (UpdateArenaMaintenance())
 	{
 		_renderer->SetDirty();
 	}
 
+	// Only what moved, or is still being interpolated, gets gathered again
+	_transformUpdateSystem->Update(gt, *_gameObjects);
+	auto changed = _transformUpdateSystem->ChangedRange();
+	_renderer->SetDirtySlots(_transformUpdateSystem->ChangedSlots(), changed.first, changed.second);
+
+	_renderer->SetInterpolationAlpha(_transformUpdateSystem->InterpolationAlpha());
 	_renderer->Update(gt);
 	_renderer->SetWireframe(_inputService->GetKey(KeyCode::One));
 
@@ -235,6 +253,24 @@ void SisuApp::OnResize()
 	}
 }
 
+bool SisuApp::UpdateArenaMaintenance()
+{
+	auto stats = _gameObjects->GetStats();
+	_gameObjects->ResetFrameCounters();
+
+	if (!_isCompacting && stats.gapCount >= CompactionMinGapCount
+		&& stats.fragmentation > CompactionFragmentationThreshold)
+	{
+		_compactor.Begin(*_gameObjects);
+		_isCompacting = true;
+	}
+
+	if (!_isCompacting) { return false; }
+
+	_isCompacting = !_compactor.Step(*_gameObjects, CompactionMovesPerFrame);
+	return true;
+}
+
 void SisuApp::CalculateFrameStats(std::size_t drawCallCount)
 {
 	static int frameCount = 0;
@@ -248,7 +284,32 @@ void SisuApp::CalculateFrameStats(std::size_t drawCallCount)
 		auto fpsAsString = std::to_wstring(fps);
 		auto msPerFrameAsString = std::to_wstring(msPerFrame);
 		auto drawCallsAsString = std::to_wstring(drawCallCount);
-		_windowManager->SetText(L"      fps: " + fpsAsString + L"    ms/frame: " + msPerFrameAsString + L"     draw calls: " + drawCallsAsString);
+
+		// Live objects / occupied slots (high-water mark), for sizing MaxGameObjectCount
+		auto arenaStats = _gameObjects->GetStats();
+		auto objectsAsString = std::to_wstring(arenaStats.liveCount) + L"/" + std::to_wstring(arenaStats.occupiedSize)
+							   + L" (" + std::to_wstring(arenaStats.highWaterMark) + L")";
+		auto fragmentationAsString = std::to_wstring(static_cast<int>(arenaStats.fragmentation * 100.0f)) + L"%";
+
+		// Instance and UI data copied to the upload heap in the last frame
+		auto rendererStats = _renderer->GetStats();
+		auto uploadedAsString = std::to_wstring((rendererStats.instanceBytesUploaded + rendererStats.uiBytesUploaded) / 1024) + L" KB ("
+								+ std::to_wstring(rendererStats.instancesUploaded) + L"/" + std::to_wstring(rendererStats.instanceCount) + L" instances)";
+		if (rendererStats.instancesTruncated > 0)
+		{
+			uploadedAsString += L", " + std::to_wstring(rendererStats.instancesTruncated) + L" didn't fit";
+		}
+
+		_windowManager->SetText(L"      fps: " + fpsAsString + L"    ms/frame: " + msPerFrameAsString + L"     draw calls: " + drawCallsAsString
+								+ L"     objects: " + objectsAsString + L"     fragmentation: " + fragmentationAsString
+								+ L"     uploaded: " + uploadedAsString);
+
+		static bool hasWarnedAboutSize = false;
+		if (arenaStats.highWaterMark > MaxGameObjectCount && !hasWarnedAboutSize)
+		{
+			hasWarnedAboutSize = true;
+			std::clog << "Game objects outgrew MaxGameObjectCount: " << arenaStats.highWaterMark << " slots used.\n";
+		}
 
 		frameCount = 0;
 		elapsedTime += 1.0f;
@@ -7,7 +7,9 @@
 #include "IRenderer.h"
 #include "IInputService.h"
 #include "Arena.h"
-#include "GameObject.h"
+#include "GameObjectStorage.h"
+#include "HierarchyCompactor.h"
+#include "JobSystem.h"
 #include "TransformUpdateSystem.h"
 #include "ICameraService.h"
 #include "IGUIService.h"
@@ -20,6 +22,12 @@ class SisuApp
 public:
 	const static std::size_t MaxGameObjectCount = 4096;
 
+	// Incremental compaction starts once the free slots are scattered over
+	// enough gaps, and moves about this many objects per frame.
+	const static std::size_t CompactionMinGapCount = 32;
+	const static std::size_t CompactionMovesPerFrame = 256;
+	constexpr static float CompactionFragmentationThreshold = 0.5f;
+
 	SisuApp(HINSTANCE hInstance) : _hAppInstance(hInstance) {}
 	SisuApp(SisuApp&& other) = default;
 	SisuApp& operator=(SisuApp&& other) = default;
@@ -48,24 +56,28 @@ protected:
 	virtual void PostDraw();
 
 	bool InitArenas();
+	bool InitJobSystem();
 	bool InitGameTimer();
 
 	bool InitInputService(GameTimer* const gt);
 	bool InitWindowManager(IInputService* const inputService, int width, int height, const std::wstring& title);
 	bool InitCameraService(IInputService* const inputService, WindowManager* const windowManager);
 	bool InitRenderer(WindowManager* const windowManager, GameTimer* const gt,
-						Arena<GameObject>* const arena, ICameraService* const cameraService);
+						GameObjectArena* const arena, ICameraService* const cameraService);
 
 	bool InitGUIService(IInputService* const inputService, WindowManager* const windowManager, 
 						ICameraService* const camService, IRenderer* const renderer);
 
 	bool InitTransformUpdateSystem();
 	void CalculateFrameStats(std::size_t drawCallCount);
+	bool UpdateArenaMaintenance();	// returns true if objects got moved
 
 protected:
 	HINSTANCE _hAppInstance = nullptr;
 
-	std::unique_ptr<Arena<GameObject>> _gameObjects;
+	std::unique_ptr<GameObjectArena> _gameObjects;
+	HierarchyCompactor _compactor;
+	bool _isCompacting = false;
 
 	std::unique_ptr<GameTimer> _gameTimer;
 	std::unique_ptr<WindowManager> _windowManager;
@@ -74,6 +86,7 @@ protected:
 	std::unique_ptr<ICameraService> _cameraService;
 	std::unique_ptr<IGUIService> _gui;
 
+	std::unique_ptr<JobSystem> _jobSystem;
 	std::unique_ptr<TransformUpdateSystem> _transformUpdateSystem;
 
 	bool _isRendererSetup = false;
@@ -1,26 +1,34 @@
 #include "stdafx.h"
 #include "SisuUtilities.h"
 
+#if defined(SISU_MATH_AVX2)
+#include <immintrin.h>
+#elif defined(SISU_MATH_SSE41)
+#include <smmintrin.h>
+#elif defined(SISU_MATH_SSE)
+#include <emmintrin.h>
+#endif
+
 namespace Sisu
 {
-	bool Sisu::Approx(float a, float b, float e)
+	bool Approx(float a, float b, float e)
 	{
 		return (a > b) ? (a - b < e) : (b - a < e);
 	}
 
-	Sisu::Matrix4 Sisu::Matrix4::FromQuat(Quat q)
+	Matrix4 Matrix4::FromQuat(const Quat& q)
 	{
-		float r0x = 1.0f - 2.0f * pow(q.y, 2) - 2.0f * pow(q.z, 2);
+		float r0x = 1.0f - 2.0f * q.y * q.y - 2.0f * q.z * q.z;
 		float r0y = 2.0f * q.x * q.y + 2.0f * q.w * q.z;
 		float r0z = 2.0f * q.x * q.z - 2.0f * q.w * q.y;
 		
 		float r1x = 2.0f * q.x * q.y - 2.0f * q.w * q.z;
-		float r1y = 1.0f - 2.0f * pow(q.x, 2) - 2.0f * pow(q.z, 2);
+		float r1y = 1.0f - 2.0f * q.x * q.x - 2.0f * q.z * q.z;
 		float r1z = 2.0f * q.y * q.z + 2.0f * q.w * q.x;
 
 		float r2x = 2.0f * q.x * q.z + 2.0f * q.w * q.y;
 		float r2y = 2.0f * q.y * q.z - 2.0f * q.w * q.x;
-		float r2z = 1.0f - 2.0f * pow(q.x, 2) - 2.0f * pow(q.y, 2);
+		float r2z = 1.0f - 2.0f * q.x * q.x - 2.0f * q.y * q.y;
 
 		return Matrix4(Vector4(r0x, r0y, r0z, 0.0f),
 					   Vector4(r1x, r1y, r1z, 0.0f),
@@ -33,56 +41,378 @@ namespace Sisu
 		return Sisu::Vector3(vec.x * s, vec.y * s, vec.z * s);
 	}
 
-	//TODO = somehow note that this is funky: multiplying a vec3 by a m4x4?!
-	//	   => so we ignore the 4th row and col in the matrix
-	Sisu::Vector3 operator*(const Sisu::Vector3& vec, const Sisu::Matrix4& m)
+	Affine3x4 Affine3x4::FromMatrix4(const Matrix4& m)
+	{
+		return Affine3x4(Vector4(m.r0.x, m.r1.x, m.r2.x, m.r3.x),
+						 Vector4(m.r0.y, m.r1.y, m.r2.y, m.r3.y),
+						 Vector4(m.r0.z, m.r1.z, m.r2.z, m.r3.z));
+	}
+
+	Matrix4 Affine3x4::ToMatrix4() const
+	{
+		return Matrix4(Vector4(r0.x, r1.x, r2.x, 0.0f),
+					   Vector4(r0.y, r1.y, r2.y, 0.0f),
+					   Vector4(r0.z, r1.z, r2.z, 0.0f),
+					   Vector4(r0.w, r1.w, r2.w, 1.0f));
+	}
+
+	// The 3x3 part's inverse from cross products of its rows, then the
+	// translation undone through that
+	Affine3x4 Affine3x4::Inverse() const
 	{
-		Sisu::Vector3 v;
+		auto cross = [](const Vector4& a, const Vector4& b)
+		{
+			return Vector3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+		};
+
+		auto c0 = cross(r1, r2);
+		auto c1 = cross(r2, r0);
+		auto c2 = cross(r0, r1);
+		auto invDet = 1.0f / (r0.x * c0.x + r0.y * c0.y + r0.z * c0.z);
 
-		v.x = (vec.x * m.r0.x) + (vec.y * m.r1.x) + (vec.z * m.r2.x);
-		v.y = (vec.x * m.r0.y) + (vec.y * m.r1.y) + (vec.z * m.r2.y);
-		v.z = (vec.x * m.r0.z) + (vec.y * m.r1.z) + (vec.z * m.r2.z);
+		Affine3x4 inverse(Vector4(c0.x * invDet, c1.x * invDet, c2.x * invDet, 0.0f),
+						  Vector4(c0.y * invDet, c1.y * invDet, c2.y * invDet, 0.0f),
+						  Vector4(c0.z * invDet, c1.z * invDet, c2.z * invDet, 0.0f));
 
-		return v;
+		auto translation = inverse.TransformVector(Translation());
+		inverse.r0.w = -translation.x;
+		inverse.r1.w = -translation.y;
+		inverse.r2.w = -translation.z;
+		return inverse;
+	}
+
+	namespace Scalar
+	{
+		//TODO = somehow note that this is funky: multiplying a vec3 by a m4x4?!
+		//	   => so we ignore the 4th row and col in the matrix
+		Sisu::Vector3 Multiply(const Sisu::Vector3& vec, const Sisu::Matrix4& m)
+		{
+			Sisu::Vector3 v;
+
+			v.x = (vec.x * m.r0.x) + (vec.y * m.r1.x) + (vec.z * m.r2.x);
+			v.y = (vec.x * m.r0.y) + (vec.y * m.r1.y) + (vec.z * m.r2.y);
+			v.z = (vec.x * m.r0.z) + (vec.y * m.r1.z) + (vec.z * m.r2.z);
+
+			return v;
+		}
+
+		Sisu::Matrix4 Multiply(const Sisu::Matrix4& a, const Sisu::Matrix4& b)
+		{
+			Sisu::Vector4 r0, r1, r2, r3;
+
+			r0.x = (a.r0.x * b.r0.x) + (a.r0.y * b.r1.x) + (a.r0.z * b.r2.x) + (a.r0.w * b.r3.x);
+			r0.y = (a.r0.x * b.r0.y) + (a.r0.y * b.r1.y) + (a.r0.z * b.r2.y) + (a.r0.w * b.r3.y);
+			r0.z = (a.r0.x * b.r0.z) + (a.r0.y * b.r1.z) + (a.r0.z * b.r2.z) + (a.r0.w * b.r3.z);
+			r0.w = (a.r0.x * b.r0.w) + (a.r0.y * b.r1.w) + (a.r0.z * b.r2.w) + (a.r0.w * b.r3.w);
+
+			r1.x = (a.r1.x * b.r0.x) + (a.r1.y * b.r1.x) + (a.r1.z * b.r2.x) + (a.r1.w * b.r3.x);
+			r1.y = (a.r1.x * b.r0.y) + (a.r1.y * b.r1.y) + (a.r1.z * b.r2.y) + (a.r1.w * b.r3.y);
+			r1.z = (a.r1.x * b.r0.z) + (a.r1.y * b.r1.z) + (a.r1.z * b.r2.z) + (a.r1.w * b.r3.z);
+			r1.w = (a.r1.x * b.r0.w) + (a.r1.y * b.r1.w) + (a.r1.z * b.r2.w) + (a.r1.w * b.r3.w);
+
+			r2.x = (a.r2.x * b.r0.x) + (a.r2.y * b.r1.x) + (a.r2.z * b.r2.x) + (a.r2.w * b.r3.x);
+			r2.y = (a.r2.x * b.r0.y) + (a.r2.y * b.r1.y) + (a.r2.z * b.r2.y) + (a.r2.w * b.r3.y);
+			r2.z = (a.r2.x * b.r0.z) + (a.r2.y * b.r1.z) + (a.r2.z * b.r2.z) + (a.r2.w * b.r3.z);
+			r2.w = (a.r2.x * b.r0.w) + (a.r2.y * b.r1.w) + (a.r2.z * b.r2.w) + (a.r2.w * b.r3.w);
+
+			r3.x = (a.r3.x * b.r0.x) + (a.r3.y * b.r1.x) + (a.r3.z * b.r2.x) + (a.r3.w * b.r3.x);
+			r3.y = (a.r3.x * b.r0.y) + (a.r3.y * b.r1.y) + (a.r3.z * b.r2.y) + (a.r3.w * b.r3.y);
+			r3.z = (a.r3.x * b.r0.z) + (a.r3.y * b.r1.z) + (a.r3.z * b.r2.z) + (a.r3.w * b.r3.z);
+			r3.w = (a.r3.x * b.r0.w) + (a.r3.y * b.r1.w) + (a.r3.z * b.r2.w) + (a.r3.w * b.r3.w);
+
+			return Sisu::Matrix4(r0, r1, r2, r3);
+		}
+
+		Sisu::Matrix4 Lerp(const Sisu::Matrix4& a, const Sisu::Matrix4& b, float t)
+		{
+			auto lerp = [t](const Sisu::Vector4& ra, const Sisu::Vector4& rb)
+			{
+				return Sisu::Vector4(ra.x + (rb.x - ra.x) * t, ra.y + (rb.y - ra.y) * t,
+									 ra.z + (rb.z - ra.z) * t, ra.w + (rb.w - ra.w) * t);
+			};
+
+			return Sisu::Matrix4(lerp(a.r0, b.r0), lerp(a.r1, b.r1), lerp(a.r2, b.r2), lerp(a.r3, b.r3));
+		}
+
+		Sisu::Affine3x4 Multiply(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b)
+		{
+			// Each row of b, through a's rows; 36 multiplies instead of 64
+			auto row = [&a](const Sisu::Vector4& br)
+			{
+				return Sisu::Vector4(br.x * a.r0.x + br.y * a.r1.x + br.z * a.r2.x,
+									 br.x * a.r0.y + br.y * a.r1.y + br.z * a.r2.y,
+									 br.x * a.r0.z + br.y * a.r1.z + br.z * a.r2.z,
+									 br.x * a.r0.w + br.y * a.r1.w + br.z * a.r2.w + br.w);
+			};
+
+			return Sisu::Affine3x4(row(b.r0), row(b.r1), row(b.r2));
+		}
+
+		Sisu::Affine3x4 Lerp(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b, float t)
+		{
+			auto lerp = [t](const Sisu::Vector4& ra, const Sisu::Vector4& rb)
+			{
+				return Sisu::Vector4(ra.x + (rb.x - ra.x) * t, ra.y + (rb.y - ra.y) * t,
+									 ra.z + (rb.z - ra.z) * t, ra.w + (rb.w - ra.w) * t);
+			};
+
+			return Sisu::Affine3x4(lerp(a.r0, b.r0), lerp(a.r1, b.r1), lerp(a.r2, b.r2));
+		}
+
+		Sisu::Vector3 TransformPoint(const Sisu::Affine3x4& m, const Sisu::Vector3& p)
+		{
+			return Sisu::Vector3(m.r0.x * p.x + m.r0.y * p.y + m.r0.z * p.z + m.r0.w,
+								 m.r1.x * p.x + m.r1.y * p.y + m.r1.z * p.z + m.r1.w,
+								 m.r2.x * p.x + m.r2.y * p.y + m.r2.z * p.z + m.r2.w);
+		}
+
+		Sisu::Vector3 TransformVector(const Sisu::Affine3x4& m, const Sisu::Vector3& v)
+		{
+			return Sisu::Vector3(m.r0.x * v.x + m.r0.y * v.y + m.r0.z * v.z,
+								 m.r1.x * v.x + m.r1.y * v.y + m.r1.z * v.z,
+								 m.r2.x * v.x + m.r2.y * v.y + m.r2.z * v.z);
+		}
+
+		Sisu::Quat Multiply(const Sisu::Quat& a, const Sisu::Quat& b)
+		{
+			float w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+
+			float x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+			float y = a.w * b.y + a.y * b.w + a.z * b.x - a.x * b.z;
+			float z = a.w * b.z + a.z * b.w + a.x * b.y - a.y * b.x;
+
+			return Quat(x, y, z, w);
+		}
+	}
+
+#if defined(SISU_MATH_SSE)
+	namespace
+	{
+		// Vector3 is packed, so it gets loaded with w set explicitly;
+		// everything else straight from its storage. Those loads and stores
+		// are the unaligned kind: they cost the same on aligned data, and the
+		// heap doesn't always honor alignas(16).
+		inline __m128 LoadPoint(const Vector3& p) { return _mm_setr_ps(p.x, p.y, p.z, 1.0f); }
+		inline __m128 LoadVector(const Vector3& v) { return _mm_setr_ps(v.x, v.y, v.z, 0.0f); }
+
+		inline Vector3 StoreVector3(__m128 v)
+		{
+			alignas(16) float f[4];
+			_mm_storeu_ps(f, v);
+			return Vector3(f[0], f[1], f[2]);
+		}
+
+		template <int Lane>
+		inline __m128 Splat(__m128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(Lane, Lane, Lane, Lane)); }
+
+		// Each of m's rows dotted with v; the fourth lane is zero
+		inline __m128 Dot3Rows(const Affine3x4& m, __m128 v)
+		{
+#if defined(SISU_MATH_SSE41)
+			// Horizontal adds; three _mm_dp_ps measured slower than this
+			auto x = _mm_mul_ps(_mm_loadu_ps(&m.r0.x), v);
+			auto y = _mm_mul_ps(_mm_loadu_ps(&m.r1.x), v);
+			auto z = _mm_mul_ps(_mm_loadu_ps(&m.r2.x), v);
+			return _mm_hadd_ps(_mm_hadd_ps(x, y), _mm_hadd_ps(z, _mm_setzero_ps()));
+#else
+			auto x = _mm_mul_ps(_mm_loadu_ps(&m.r0.x), v);
+			auto y = _mm_mul_ps(_mm_loadu_ps(&m.r1.x), v);
+			auto z = _mm_mul_ps(_mm_loadu_ps(&m.r2.x), v);
+			auto w = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+			return _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w));
+#endif
+		}
+
+		inline __m128 LerpRow(const Vector4& a, const Vector4& b, __m128 t)
+		{
+			auto ra = _mm_loadu_ps(&a.x);
+			return _mm_add_ps(ra, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&b.x), ra), t));
+		}
+
+		// Row i of a Matrix4 product is a's row i weighing b's rows, so b's
+		// rows are loaded once and kept in registers, for one product or many
+#if defined(SISU_MATH_AVX2)
+		// Each of b's rows in both halves, so a register takes two of a's rows
+		typedef __m256 MatrixRow;
+
+		inline void LoadRows(const Matrix4& b, MatrixRow (&rows)[4])
+		{
+			rows[0] = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&b.r0.x));
+			rows[1] = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&b.r1.x));
+			rows[2] = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&b.r2.x));
+			rows[3] = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&b.r3.x));
+		}
+
+		// Matrix4 is only 16-byte aligned, so these are unaligned loads
+		inline void MultiplyRows(const Matrix4& a, const MatrixRow (&b)[4], Matrix4& out)
+		{
+			auto rows = [&b](const Vector4& first, Vector4& result)
+			{
+				auto ar = _mm256_loadu_ps(&first.x);
+				auto r = _mm256_mul_ps(_mm256_permute_ps(ar, 0x00), b[0]);
+				r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(ar, 0x55), b[1]));
+				r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(ar, 0xAA), b[2]));
+				r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(ar, 0xFF), b[3]));
+				_mm256_storeu_ps(&result.x, r);
+			};
+
+			rows(a.r0, out.r0);
+			rows(a.r2, out.r2);
+		}
+#else
+		typedef __m128 MatrixRow;
+
+		inline void LoadRows(const Matrix4& b, MatrixRow (&rows)[4])
+		{
+			rows[0] = _mm_loadu_ps(&b.r0.x);
+			rows[1] = _mm_loadu_ps(&b.r1.x);
+			rows[2] = _mm_loadu_ps(&b.r2.x);
+			rows[3] = _mm_loadu_ps(&b.r3.x);
+		}
+
+		inline void MultiplyRows(const Matrix4& a, const MatrixRow (&b)[4], Matrix4& out)
+		{
+			auto row = [&b](const Vector4& ar, Vector4& result)
+			{
+				auto v = _mm_loadu_ps(&ar.x);
+				auto r = _mm_mul_ps(Splat<0>(v), b[0]);
+				r = _mm_add_ps(r, _mm_mul_ps(Splat<1>(v), b[1]));
+				r = _mm_add_ps(r, _mm_mul_ps(Splat<2>(v), b[2]));
+				r = _mm_add_ps(r, _mm_mul_ps(Splat<3>(v), b[3]));
+				_mm_storeu_ps(&result.x, r);
+			};
+
+			row(a.r0, out.r0);
+			row(a.r1, out.r1);
+			row(a.r2, out.r2);
+			row(a.r3, out.r3);
+		}
+#endif
+
+		// For an Affine3x4 product, as in the scalar version, each of b's rows
+		// weighs a's rows, plus its own w. So b's rows get split up: x, y and
+		// z each in all lanes, and w in the last lane only.
+		inline void SplitRows(const Affine3x4& b, __m128 (&split)[3][4])
+		{
+			auto onlyW = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+			const Vector4* rows[] = { &b.r0, &b.r1, &b.r2 };
+			for (int r = 0; r < 3; ++r)
+			{
+				auto v = _mm_loadu_ps(&rows[r]->x);
+				split[r][0] = Splat<0>(v);
+				split[r][1] = Splat<1>(v);
+				split[r][2] = Splat<2>(v);
+				split[r][3] = _mm_and_ps(v, onlyW);
+			}
+		}
+
+		inline void MultiplyRows(const Affine3x4& a, const __m128 (&b)[3][4], Affine3x4& out)
+		{
+			auto a0 = _mm_loadu_ps(&a.r0.x);
+			auto a1 = _mm_loadu_ps(&a.r1.x);
+			auto a2 = _mm_loadu_ps(&a.r2.x);
+
+			Vector4* rows[] = { &out.r0, &out.r1, &out.r2 };
+			for (int r = 0; r < 3; ++r)
+			{
+				auto v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b[r][0], a0), _mm_mul_ps(b[r][1], a1)), _mm_mul_ps(b[r][2], a2));
+				_mm_storeu_ps(&rows[r]->x, _mm_add_ps(v, b[r][3]));
+			}
+		}
+	}
+
+	Vector3 Affine3x4::TransformPoint(const Vector3& p) const
+	{
+		return StoreVector3(Dot3Rows(*this, LoadPoint(p)));
+	}
+
+	Vector3 Affine3x4::TransformVector(const Vector3& v) const
+	{
+		return StoreVector3(Dot3Rows(*this, LoadVector(v)));
+	}
+
+	Sisu::Vector3 operator*(const Sisu::Vector3& vec, const Sisu::Matrix4& m)
+	{
+		auto v = _mm_mul_ps(_mm_set1_ps(vec.x), _mm_loadu_ps(&m.r0.x));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(vec.y), _mm_loadu_ps(&m.r1.x)));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(vec.z), _mm_loadu_ps(&m.r2.x)));
+		return StoreVector3(v);
 	}
 
 	Sisu::Matrix4 operator*(const Sisu::Matrix4& a, const Sisu::Matrix4& b)
 	{
-		Sisu::Vector4 r0, r1, r2, r3;
+		MatrixRow rows[4];
+		LoadRows(b, rows);
 
-		r0.x = (a.r0.x * b.r0.x) + (a.r0.y * b.r1.x) + (a.r0.z * b.r2.x) + (a.r0.w * b.r3.x);
-		r0.y = (a.r0.x * b.r0.y) + (a.r0.y * b.r1.y) + (a.r0.z * b.r2.y) + (a.r0.w * b.r3.y);
-		r0.z = (a.r0.x * b.r0.z) + (a.r0.y * b.r1.z) + (a.r0.z * b.r2.z) + (a.r0.w * b.r3.z);
-		r0.w = (a.r0.x * b.r0.w) + (a.r0.y * b.r1.w) + (a.r0.z * b.r2.w) + (a.r0.w * b.r3.w);
+		Sisu::Matrix4 result;
+		MultiplyRows(a, rows, result);
+		return result;
+	}
 
-		r1.x = (a.r1.x * b.r0.x) + (a.r1.y * b.r1.x) + (a.r1.z * b.r2.x) + (a.r1.w * b.r3.x);
-		r1.y = (a.r1.x * b.r0.y) + (a.r1.y * b.r1.y) + (a.r1.z * b.r2.y) + (a.r1.w * b.r3.y);
-		r1.z = (a.r1.x * b.r0.z) + (a.r1.y * b.r1.z) + (a.r1.z * b.r2.z) + (a.r1.w * b.r3.z);
-		r1.w = (a.r1.x * b.r0.w) + (a.r1.y * b.r1.w) + (a.r1.z * b.r2.w) + (a.r1.w * b.r3.w);
+	Sisu::Matrix4 Lerp(const Sisu::Matrix4& a, const Sisu::Matrix4& b, float t)
+	{
+		Sisu::Matrix4 result;
+		auto vt = _mm_set1_ps(t);
+		_mm_storeu_ps(&result.r0.x, LerpRow(a.r0, b.r0, vt));
+		_mm_storeu_ps(&result.r1.x, LerpRow(a.r1, b.r1, vt));
+		_mm_storeu_ps(&result.r2.x, LerpRow(a.r2, b.r2, vt));
+		_mm_storeu_ps(&result.r3.x, LerpRow(a.r3, b.r3, vt));
+		return result;
+	}
 
-		r2.x = (a.r2.x * b.r0.x) + (a.r2.y * b.r1.x) + (a.r2.z * b.r2.x) + (a.r2.w * b.r3.x);
-		r2.y = (a.r2.x * b.r0.y) + (a.r2.y * b.r1.y) + (a.r2.z * b.r2.y) + (a.r2.w * b.r3.y);
-		r2.z = (a.r2.x * b.r0.z) + (a.r2.y * b.r1.z) + (a.r2.z * b.r2.z) + (a.r2.w * b.r3.z);
-		r2.w = (a.r2.x * b.r0.w) + (a.r2.y * b.r1.w) + (a.r2.z * b.r2.w) + (a.r2.w * b.r3.w);
+	Sisu::Affine3x4 operator*(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b)
+	{
+		__m128 split[3][4];
+		SplitRows(b, split);
 
-		r3.x = (a.r3.x * b.r0.x) + (a.r3.y * b.r1.x) + (a.r3.z * b.r2.x) + (a.r3.w * b.r3.x);
-		r3.y = (a.r3.x * b.r0.y) + (a.r3.y * b.r1.y) + (a.r3.z * b.r2.y) + (a.r3.w * b.r3.y);
-		r3.z = (a.r3.x * b.r0.z) + (a.r3.y * b.r1.z) + (a.r3.z * b.r2.z) + (a.r3.w * b.r3.z);
-		r3.w = (a.r3.x * b.r0.w) + (a.r3.y * b.r1.w) + (a.r3.z * b.r2.w) + (a.r3.w * b.r3.w);
+		Sisu::Affine3x4 result;
+		MultiplyRows(a, split, result);
+		return result;
+	}
 
-		return Sisu::Matrix4(r0, r1, r2, r3);
+	Sisu::Affine3x4 Lerp(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b, float t)
+	{
+		Sisu::Affine3x4 result;
+		auto vt = _mm_set1_ps(t);
+		_mm_storeu_ps(&result.r0.x, LerpRow(a.r0, b.r0, vt));
+		_mm_storeu_ps(&result.r1.x, LerpRow(a.r1, b.r1, vt));
+		_mm_storeu_ps(&result.r2.x, LerpRow(a.r2, b.r2, vt));
+		return result;
 	}
 
+	// Each of a's components scales a shuffled, sign-flipped b:
+	// a.w * (bx, by, bz, bw) + a.x * (bw, -bz, by, -bx)
+	//   + a.y * (bz, bw, -bx, -by) + a.z * (-by, bx, bw, -bz)
 	Sisu::Quat operator*(const Sisu::Quat& a, const Sisu::Quat& b)
 	{
-		float w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+		auto va = _mm_loadu_ps(&a.x);
+		auto vb = _mm_loadu_ps(&b.x);
 
-		float x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
-		float y = a.w * b.y + a.y * b.w + a.z * b.x - a.x * b.z;
-		float z = a.w * b.z + a.z * b.w + a.x * b.y - a.y * b.x;
+		auto xTerm = _mm_xor_ps(_mm_shuffle_ps(vb, vb, _MM_SHUFFLE(0, 1, 2, 3)), _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f));
+		auto yTerm = _mm_xor_ps(_mm_shuffle_ps(vb, vb, _MM_SHUFFLE(1, 0, 3, 2)), _mm_setr_ps(0.0f, 0.0f, -0.0f, -0.0f));
+		auto zTerm = _mm_xor_ps(_mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 3, 0, 1)), _mm_setr_ps(-0.0f, 0.0f, 0.0f, -0.0f));
 
-		return Quat(x, y, z, w);
+		auto r = _mm_mul_ps(Splat<3>(va), vb);
+		r = _mm_add_ps(r, _mm_mul_ps(Splat<0>(va), xTerm));
+		r = _mm_add_ps(r, _mm_mul_ps(Splat<1>(va), yTerm));
+		r = _mm_add_ps(r, _mm_mul_ps(Splat<2>(va), zTerm));
+
+		Sisu::Quat result;
+		_mm_storeu_ps(&result.x, r);
+		return result;
 	}
+#else
+	Vector3 Affine3x4::TransformPoint(const Vector3& p) const { return Scalar::TransformPoint(*this, p); }
+	Vector3 Affine3x4::TransformVector(const Vector3& v) const { return Scalar::TransformVector(*this, v); }
+
+	Sisu::Vector3 operator*(const Sisu::Vector3& vec, const Sisu::Matrix4& m) { return Scalar::Multiply(vec, m); }
+	Sisu::Matrix4 operator*(const Sisu::Matrix4& a, const Sisu::Matrix4& b) { return Scalar::Multiply(a, b); }
+	Sisu::Matrix4 Lerp(const Sisu::Matrix4& a, const Sisu::Matrix4& b, float t) { return Scalar::Lerp(a, b, t); }
+	Sisu::Affine3x4 operator*(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b) { return Scalar::Multiply(a, b); }
+	Sisu::Affine3x4 Lerp(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b, float t) { return Scalar::Lerp(a, b, t); }
+	Sisu::Quat operator*(const Sisu::Quat& a, const Sisu::Quat& b) { return Scalar::Multiply(a, b); }
+#endif
 
 	bool operator==(const Sisu::Quat& a, const Sisu::Quat& b)
 	{
@@ -92,4 +422,319 @@ namespace Sisu
 			   Approx(a.w, b.w);
 	}
 
+	namespace
+	{
+		// The stream kernels on structures of arrays are written once, for
+		// any of these: one float at a time, or a whole SSE or AVX register.
+		// The leftovers after the wide lanes get the very same math.
+		struct ScalarLanes
+		{
+			typedef float Float;
+			typedef int Int;
+			static const std::size_t Width = 1;
+
+			static Float Load(const float* p) { return *p; }
+			static void Store(float* p, Float v) { *p = v; }
+			static Float Set(float f) { return f; }
+			static Float Add(Float a, Float b) { return a + b; }
+			static Float Sub(Float a, Float b) { return a - b; }
+			static Float Mul(Float a, Float b) { return a * b; }
+			static Float Div(Float a, Float b) { return a / b; }
+			static Float Sqrt(Float a) { return sqrtf(a); }
+			static Int Round(Float a) { return int(lrintf(a)); }	// to nearest even, as cvtps2dq
+			static Float ToFloat(Int i) { return float(i); }
+
+			// From the sine and cosine of the remainder to those of the
+			// angle, which was q quarter turns further
+			static void Quadrant(Int q, Float& s, Float& c)
+			{
+				auto sine = (q & 1) ? c : s;
+				auto cosine = (q & 1) ? s : c;
+				s = (q & 2) ? -sine : sine;
+				c = ((q + 1) & 2) ? -cosine : cosine;
+			}
+		};
+
+#if defined(SISU_MATH_SSE)
+		struct SseLanes
+		{
+			typedef __m128 Float;
+			typedef __m128i Int;
+			static const std::size_t Width = 4;
+
+			static Float Load(const float* p) { return _mm_loadu_ps(p); }
+			static void Store(float* p, Float v) { _mm_storeu_ps(p, v); }
+			static Float Set(float f) { return _mm_set1_ps(f); }
+			static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+			static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+			static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+			static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+			static Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+			static Int Round(Float a) { return _mm_cvtps_epi32(a); }
+			static Float ToFloat(Int i) { return _mm_cvtepi32_ps(i); }
+
+			static void Quadrant(Int q, Float& s, Float& c)
+			{
+				auto one = _mm_set1_epi32(1);
+				auto two = _mm_set1_epi32(2);
+				auto swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+				auto sine = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+				auto cosine = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+
+				// Bit 1 of q (or q + 1), moved to the sign bit
+				s = _mm_xor_ps(sine, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30)));
+				c = _mm_xor_ps(cosine, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30)));
+			}
+		};
+#endif
+
+#if defined(SISU_MATH_AVX2)
+		struct Avx2Lanes
+		{
+			typedef __m256 Float;
+			typedef __m256i Int;
+			static const std::size_t Width = 8;
+
+			static Float Load(const float* p) { return _mm256_loadu_ps(p); }
+			static void Store(float* p, Float v) { _mm256_storeu_ps(p, v); }
+			static Float Set(float f) { return _mm256_set1_ps(f); }
+			static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+			static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+			static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+			static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+			static Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+			static Int Round(Float a) { return _mm256_cvtps_epi32(a); }
+			static Float ToFloat(Int i) { return _mm256_cvtepi32_ps(i); }
+
+			static void Quadrant(Int q, Float& s, Float& c)
+			{
+				auto one = _mm256_set1_epi32(1);
+				auto two = _mm256_set1_epi32(2);
+				auto swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+				auto sine = _mm256_blendv_ps(s, c, swap);
+				auto cosine = _mm256_blendv_ps(c, s, swap);
+
+				s = _mm256_xor_ps(sine, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30)));
+				c = _mm256_xor_ps(cosine, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30)));
+			}
+		};
+#endif
+
+		// Runs range(lanes, i), which handles elements from i on for as long
+		// as whole registers fit and returns where it stopped, with the widest
+		// lanes first and single floats for the rest
+		template <typename Range>
+		void ForEachWidth(Range range)
+		{
+			std::size_t i = 0;
+#if defined(SISU_MATH_AVX2)
+			i = range(Avx2Lanes(), i);
+#endif
+#if defined(SISU_MATH_SSE)
+			i = range(SseLanes(), i);
+#endif
+			range(ScalarLanes(), i);
+		}
+
+		// Reduces x by multiples of pi/2, in three parts so that the products
+		// are exact (Cody and Waite), then Cephes' sinf and cosf polynomials
+		// on the remainder. Good to about 1e-7 for |x| up to a few thousand.
+		template <typename L>
+		void SinCos(typename L::Float x, typename L::Float& s, typename L::Float& c)
+		{
+			auto q = L::Round(L::Mul(x, L::Set(0.636619772f)));
+			auto qf = L::ToFloat(q);
+			auto r = L::Sub(x, L::Mul(qf, L::Set(1.5703125f)));
+			r = L::Sub(r, L::Mul(qf, L::Set(4.837512969970703125e-4f)));
+			r = L::Sub(r, L::Mul(qf, L::Set(7.54978995489188216e-8f)));
+			auto r2 = L::Mul(r, r);
+
+			auto sp = L::Add(L::Mul(L::Set(-1.9515295891e-4f), r2), L::Set(8.3321608736e-3f));
+			sp = L::Add(L::Mul(sp, r2), L::Set(-1.6666654611e-1f));
+			s = L::Add(L::Mul(L::Mul(sp, r2), r), r);
+
+			auto cp = L::Add(L::Mul(L::Set(2.443315711809948e-5f), r2), L::Set(-1.388731625493765e-3f));
+			cp = L::Add(L::Mul(cp, r2), L::Set(4.166664568298827e-2f));
+			c = L::Add(L::Sub(L::Mul(L::Mul(cp, r2), r2), L::Mul(L::Set(0.5f), r2)), L::Set(1.0f));
+
+			L::Quadrant(q, s, c);
+		}
+
+		template <typename L>
+		std::size_t TransformRange(const Affine3x4& m, float w, Stream::Vector3Span<const float> in,
+								   Stream::Vector3Span<float> out, std::size_t i, std::size_t count)
+		{
+			const Vector4* rows[] = { &m.r0, &m.r1, &m.r2 };
+			typename L::Float coefficients[3][4];
+			for (int r = 0; r < 3; ++r)
+			{
+				coefficients[r][0] = L::Set(rows[r]->x);
+				coefficients[r][1] = L::Set(rows[r]->y);
+				coefficients[r][2] = L::Set(rows[r]->z);
+				coefficients[r][3] = L::Set(rows[r]->w * w);
+			}
+
+			float* outputs[] = { out.x, out.y, out.z };
+			for (; i + L::Width <= count; i += L::Width)
+			{
+				auto x = L::Load(in.x + i), y = L::Load(in.y + i), z = L::Load(in.z + i);
+				typename L::Float results[3];
+				for (int r = 0; r < 3; ++r)
+				{
+					const auto& k = coefficients[r];
+					results[r] = L::Add(L::Add(L::Add(L::Mul(k[0], x), L::Mul(k[1], y)), L::Mul(k[2], z)), k[3]);
+				}
+
+				for (int r = 0; r < 3; ++r) { L::Store(outputs[r] + i, results[r]); }
+			}
+
+			return i;
+		}
+
+		template <typename L>
+		std::size_t MultiplyQuatRange(Stream::QuatSpan<const float> a, Stream::QuatSpan<const float> b,
+									  Stream::QuatSpan<float> out, std::size_t i, std::size_t count)
+		{
+			for (; i + L::Width <= count; i += L::Width)
+			{
+				auto ax = L::Load(a.x + i), ay = L::Load(a.y + i), az = L::Load(a.z + i), aw = L::Load(a.w + i);
+				auto bx = L::Load(b.x + i), by = L::Load(b.y + i), bz = L::Load(b.z + i), bw = L::Load(b.w + i);
+
+				auto w = L::Sub(L::Sub(L::Sub(L::Mul(aw, bw), L::Mul(ax, bx)), L::Mul(ay, by)), L::Mul(az, bz));
+				auto x = L::Sub(L::Add(L::Add(L::Mul(aw, bx), L::Mul(ax, bw)), L::Mul(ay, bz)), L::Mul(az, by));
+				auto y = L::Sub(L::Add(L::Add(L::Mul(aw, by), L::Mul(ay, bw)), L::Mul(az, bx)), L::Mul(ax, bz));
+				auto z = L::Sub(L::Add(L::Add(L::Mul(aw, bz), L::Mul(az, bw)), L::Mul(ax, by)), L::Mul(ay, bx));
+
+				L::Store(out.x + i, x);
+				L::Store(out.y + i, y);
+				L::Store(out.z + i, z);
+				L::Store(out.w + i, w);
+			}
+
+			return i;
+		}
+
+		template <typename L>
+		std::size_t NormalizeRange(Stream::QuatSpan<float> q, std::size_t i, std::size_t count)
+		{
+			auto one = L::Set(1.0f);
+			for (; i + L::Width <= count; i += L::Width)
+			{
+				auto x = L::Load(q.x + i), y = L::Load(q.y + i), z = L::Load(q.z + i), w = L::Load(q.w + i);
+				auto lengthSquared = L::Add(L::Add(L::Add(L::Mul(x, x), L::Mul(y, y)), L::Mul(z, z)), L::Mul(w, w));
+				auto scale = L::Div(one, L::Sqrt(lengthSquared));
+
+				L::Store(q.x + i, L::Mul(x, scale));
+				L::Store(q.y + i, L::Mul(y, scale));
+				L::Store(q.z + i, L::Mul(z, scale));
+				L::Store(q.w + i, L::Mul(w, scale));
+			}
+
+			return i;
+		}
+
+		// Quat::Euler's formula, on half angles in radians
+		template <typename L>
+		std::size_t EulerRange(Stream::Vector3Span<const float> degrees, Stream::QuatSpan<float> out, std::size_t i, std::size_t count)
+		{
+			auto halfRadians = L::Set(float(PI / 360.0));
+			for (; i + L::Width <= count; i += L::Width)
+			{
+				typename L::Float sinp, cosp, sinh, cosh, sinb, cosb;
+				SinCos<L>(L::Mul(L::Load(degrees.x + i), halfRadians), sinp, cosp);
+				SinCos<L>(L::Mul(L::Load(degrees.y + i), halfRadians), sinh, cosh);
+				SinCos<L>(L::Mul(L::Load(degrees.z + i), halfRadians), sinb, cosb);
+
+				auto chcp = L::Mul(cosh, cosp), shsp = L::Mul(sinh, sinp);
+				auto chsp = L::Mul(cosh, sinp), shcp = L::Mul(sinh, cosp);
+
+				L::Store(out.x + i, L::Add(L::Mul(chsp, cosb), L::Mul(shcp, sinb)));
+				L::Store(out.y + i, L::Sub(L::Mul(shcp, cosb), L::Mul(chsp, sinb)));
+				L::Store(out.z + i, L::Sub(L::Mul(chcp, sinb), L::Mul(shsp, cosb)));
+				L::Store(out.w + i, L::Add(L::Mul(chcp, cosb), L::Mul(shsp, sinb)));
+			}
+
+			return i;
+		}
+	}
+
+	namespace Stream
+	{
+		void Multiply(const Sisu::Matrix4* a, const Sisu::Matrix4* b, Sisu::Matrix4* out, std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+#if defined(SISU_MATH_SSE)
+				MatrixRow rows[4];
+				LoadRows(b[i], rows);
+				MultiplyRows(a[i], rows, out[i]);
+#else
+				out[i] = Scalar::Multiply(a[i], b[i]);
+#endif
+			}
+		}
+
+		void Multiply(const Sisu::Matrix4* a, const Sisu::Matrix4& b, Sisu::Matrix4* out, std::size_t count)
+		{
+#if defined(SISU_MATH_SSE)
+			MatrixRow rows[4];
+			LoadRows(b, rows);
+			for (std::size_t i = 0; i < count; ++i) { MultiplyRows(a[i], rows, out[i]); }
+#else
+			auto shared = b;
+			for (std::size_t i = 0; i < count; ++i) { out[i] = Scalar::Multiply(a[i], shared); }
+#endif
+		}
+
+		void Multiply(const Sisu::Affine3x4* a, const Sisu::Affine3x4* b, Sisu::Affine3x4* out, std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+#if defined(SISU_MATH_SSE)
+				__m128 split[3][4];
+				SplitRows(b[i], split);
+				MultiplyRows(a[i], split, out[i]);
+#else
+				out[i] = Scalar::Multiply(a[i], b[i]);
+#endif
+			}
+		}
+
+		void Multiply(const Sisu::Affine3x4* a, const Sisu::Affine3x4& b, Sisu::Affine3x4* out, std::size_t count)
+		{
+#if defined(SISU_MATH_SSE)
+			__m128 split[3][4];
+			SplitRows(b, split);
+			for (std::size_t i = 0; i < count; ++i) { MultiplyRows(a[i], split, out[i]); }
+#else
+			auto shared = b;
+			for (std::size_t i = 0; i < count; ++i) { out[i] = Scalar::Multiply(a[i], shared); }
+#endif
+		}
+
+		void TransformPoints(const Sisu::Affine3x4& m, Vector3Span<const float> points, Vector3Span<float> out, std::size_t count)
+		{
+			ForEachWidth([&](auto lanes, std::size_t i) { return TransformRange<decltype(lanes)>(m, 1.0f, points, out, i, count); });
+		}
+
+		void TransformVectors(const Sisu::Affine3x4& m, Vector3Span<const float> vectors, Vector3Span<float> out, std::size_t count)
+		{
+			ForEachWidth([&](auto lanes, std::size_t i) { return TransformRange<decltype(lanes)>(m, 0.0f, vectors, out, i, count); });
+		}
+
+		void Multiply(QuatSpan<const float> a, QuatSpan<const float> b, QuatSpan<float> out, std::size_t count)
+		{
+			ForEachWidth([&](auto lanes, std::size_t i) { return MultiplyQuatRange<decltype(lanes)>(a, b, out, i, count); });
+		}
+
+		void Normalize(QuatSpan<float> q, std::size_t count)
+		{
+			ForEachWidth([&](auto lanes, std::size_t i) { return NormalizeRange<decltype(lanes)>(q, i, count); });
+		}
+
+		void EulerToQuat(Vector3Span<const float> degrees, QuatSpan<float> out, std::size_t count)
+		{
+			ForEachWidth([&](auto lanes, std::size_t i) { return EulerRange<decltype(lanes)>(degrees, out, i, count); });
+		}
+	}
 }
@@ -1,7 +1,21 @@
 #pragma once
 #include <cmath>
+#include <cstddef>
 #define PI 3.14159265
 
+// The operators below use SSE wherever the compiler targets it (x64, and
+// Win32 with /arch:SSE2), SSE4.1 / AVX2 under -msse4.1 / -mavx2 or
+// /arch:AVX2, and plain C++ elsewhere, or with SISU_MATH_SCALAR defined.
+#if !defined(SISU_MATH_SCALAR) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SISU_MATH_SSE
+#if defined(__SSE4_1__) || defined(__AVX__)
+#define SISU_MATH_SSE41
+#endif
+#if defined(__AVX2__)
+#define SISU_MATH_AVX2
+#endif
+#endif
+
 namespace Sisu
 {
 	struct Quat;
@@ -40,7 +54,7 @@ namespace Sisu
 		float r, g, b, a;
 	};
 
-	struct Vector4
+	struct alignas(16) Vector4
 	{
 		Vector4() = default;
 		Vector4(float px, float py, float pz, float pw) :
@@ -59,16 +73,48 @@ namespace Sisu
 						   Vector4(0.0f, 0.0f, 0.0f, 1.0f));
 		}
 
-		static Matrix4 FromQuat(Quat q);
+		static Matrix4 FromQuat(const Quat& q);
 
 		Matrix4() = default;
-		Matrix4(Vector4 pr0, Vector4 pr1, Vector4 pr2, Vector4 pr3) :
+		Matrix4(const Vector4& pr0, const Vector4& pr1, const Vector4& pr2, const Vector4& pr3) :
 			r0(pr0), r1(pr1), r2(pr2), r3(pr3) {}
 
 		Vector4 r0, r1, r2, r3;
 	};
 
-	struct Quat
+	// An affine transform: a Matrix4 without its last column, which is
+	// (0, 0, 0, 1) for those anyway. It's kept transposed, one row per
+	// output coordinate (x' = dot(r0, (x, y, z, 1)), and so on), which is
+	// also how the shaders take it. 48 bytes instead of 64.
+	struct Affine3x4
+	{
+		static Affine3x4 Identity()
+		{
+			return Affine3x4(Vector4(1.0f, 0.0f, 0.0f, 0.0f),
+							 Vector4(0.0f, 1.0f, 0.0f, 0.0f),
+							 Vector4(0.0f, 0.0f, 1.0f, 0.0f));
+		}
+
+		// Drops m's last column
+		static Affine3x4 FromMatrix4(const Matrix4& m);
+
+		Affine3x4() = default;
+		Affine3x4(const Vector4& pr0, const Vector4& pr1, const Vector4& pr2) :
+			r0(pr0), r1(pr1), r2(pr2) {}
+
+		Matrix4 ToMatrix4() const;
+
+		Vector3 Translation() const { return Vector3(r0.w, r1.w, r2.w); }
+		Vector3 TransformPoint(const Vector3& p) const;
+		Vector3 TransformVector(const Vector3& v) const;	// without the translation
+
+		// The transform has to be invertible, i.e. no zero scale
+		Affine3x4 Inverse() const;
+
+		Vector4 r0, r1, r2;
+	};
+
+	struct alignas(16) Quat
 	{
 		static Quat Identity()
 		{
@@ -126,7 +172,17 @@ namespace Sisu
 
 		float Magnitude() const
 		{
-			return sqrtf(pow(x, 2) + pow(y, 2) + pow(z, 2) + pow(w, 2));
+			return sqrtf(x * x + y * y + z * z + w * w);
+		}
+
+		// Back to unit length, e.g. after many products added up rounding errors
+		void Normalize()
+		{
+			auto scale = 1.0f / sqrtf(x * x + y * y + z * z + w * w);
+			x *= scale;
+			y *= scale;
+			z *= scale;
+			w *= scale;
 		}
 
 		float x, y, z, w;
@@ -137,6 +193,74 @@ namespace Sisu
 	Sisu::Vector3 operator*(const Sisu::Vector3& vec, float s);
 	Sisu::Vector3 operator*(const Sisu::Vector3& vec, const Sisu::Matrix4& m);
 	Sisu::Matrix4 operator*(const Sisu::Matrix4& a, const Sisu::Matrix4& b);
+	Sisu::Matrix4 Lerp(const Sisu::Matrix4& a, const Sisu::Matrix4& b, float t);	// element by element
+	Sisu::Affine3x4 operator*(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b);	// a, then b, as with Matrix4
+	Sisu::Affine3x4 Lerp(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b, float t);
 	Sisu::Quat operator*(const Sisu::Quat& a, const Sisu::Quat& b);
 	bool operator==(const Sisu::Quat& a, const Sisu::Quat& b);
+
+	// The plain C++ versions of the operators above, which the SIMD ones
+	// are checked against; also what the operators use without SIMD.
+	namespace Scalar
+	{
+		Sisu::Vector3 Multiply(const Sisu::Vector3& vec, const Sisu::Matrix4& m);
+		Sisu::Matrix4 Multiply(const Sisu::Matrix4& a, const Sisu::Matrix4& b);
+		Sisu::Matrix4 Lerp(const Sisu::Matrix4& a, const Sisu::Matrix4& b, float t);
+		Sisu::Affine3x4 Multiply(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b);
+		Sisu::Affine3x4 Lerp(const Sisu::Affine3x4& a, const Sisu::Affine3x4& b, float t);
+		Sisu::Vector3 TransformPoint(const Sisu::Affine3x4& m, const Sisu::Vector3& p);
+		Sisu::Vector3 TransformVector(const Sisu::Affine3x4& m, const Sisu::Vector3& v);
+		Sisu::Quat Multiply(const Sisu::Quat& a, const Sisu::Quat& b);
+	}
+
+	// The same math over whole arrays, for callers with many elements: one
+	// call instead of one per element, and 4 or 8 elements per instruction.
+	// Points, vectors and quaternions come as structures of arrays, one
+	// array per component; `out` may be the same arrays as an input.
+	namespace Stream
+	{
+		template <typename Float>
+		struct Vector3Span
+		{
+			Vector3Span(Float* px, Float* py, Float* pz) : x(px), y(py), z(pz) {}
+
+			// Writable spans pass as read-only ones
+			template <typename Other>
+			Vector3Span(const Vector3Span<Other>& other) : x(other.x), y(other.y), z(other.z) {}
+
+			Float* x;
+			Float* y;
+			Float* z;
+		};
+
+		template <typename Float>
+		struct QuatSpan
+		{
+			QuatSpan(Float* px, Float* py, Float* pz, Float* pw) : x(px), y(py), z(pz), w(pw) {}
+
+			template <typename Other>
+			QuatSpan(const QuatSpan<Other>& other) : x(other.x), y(other.y), z(other.z), w(other.w) {}
+
+			Float* x;
+			Float* y;
+			Float* z;
+			Float* w;
+		};
+
+		// out[i] = a[i] * b[i], or a[i] * b with a single b
+		void Multiply(const Sisu::Matrix4* a, const Sisu::Matrix4* b, Sisu::Matrix4* out, std::size_t count);
+		void Multiply(const Sisu::Matrix4* a, const Sisu::Matrix4& b, Sisu::Matrix4* out, std::size_t count);
+		void Multiply(const Sisu::Affine3x4* a, const Sisu::Affine3x4* b, Sisu::Affine3x4* out, std::size_t count);
+		void Multiply(const Sisu::Affine3x4* a, const Sisu::Affine3x4& b, Sisu::Affine3x4* out, std::size_t count);
+
+		void TransformPoints(const Sisu::Affine3x4& m, Vector3Span<const float> points, Vector3Span<float> out, std::size_t count);
+		void TransformVectors(const Sisu::Affine3x4& m, Vector3Span<const float> vectors, Vector3Span<float> out, std::size_t count);
+
+		void Multiply(QuatSpan<const float> a, QuatSpan<const float> b, QuatSpan<float> out, std::size_t count);
+		void Normalize(QuatSpan<float> q, std::size_t count);
+
+		// Quat::Euler for each (pitch, heading, bank) in degrees. It's in
+		// float instead of double, so expect differences around 1e-7.
+		void EulerToQuat(Vector3Span<const float> degrees, QuatSpan<float> out, std::size_t count);
+	}
 }
@@ -0,0 +1,116 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "SisuUtilities.h"
+
+#if defined(SISU_MATH_SSE)
+#include <emmintrin.h>
+#endif
+
+// Copies into write-combined memory, i.e. a mapped upload heap: the CPU
+// doesn't cache it, and only writes whole 64-byte lines at full speed, so
+// the copies go front to back with non-temporal stores, 16 bytes at a
+// time, and nothing ever reads the destination back. Without SSE, they're
+// plain memcpy. It knows nothing about D3D, so that it can be tested and
+// benchmarked on ordinary memory.
+namespace StreamingCopy
+{
+	const std::size_t Alignment = 16;
+
+	// Makes the streamed stores visible before whatever comes next, e.g.
+	// the GPU reading them
+	inline void Fence()
+	{
+#if defined(SISU_MATH_SSE)
+		_mm_sfence();
+#endif
+	}
+
+	// The destination has to be 16-byte aligned; the source doesn't. A tail
+	// of less than 16 bytes goes through memcpy.
+	inline void CopyUnfenced(void* destination, const void* source, std::size_t byteCount)
+	{
+		assert(reinterpret_cast<std::uintptr_t>(destination) % Alignment == 0);
+
+#if defined(SISU_MATH_SSE)
+		auto out = static_cast<__m128i*>(destination);
+		auto in = static_cast<const __m128i*>(source);
+		auto blockCount = byteCount / Alignment;
+
+		// A cache line per iteration, so each one fills a write-combining buffer
+		std::size_t i = 0;
+		for (; i + 4 <= blockCount; i += 4)
+		{
+			auto a = _mm_loadu_si128(in + i);
+			auto b = _mm_loadu_si128(in + i + 1);
+			auto c = _mm_loadu_si128(in + i + 2);
+			auto d = _mm_loadu_si128(in + i + 3);
+			_mm_stream_si128(out + i, a);
+			_mm_stream_si128(out + i + 1, b);
+			_mm_stream_si128(out + i + 2, c);
+			_mm_stream_si128(out + i + 3, d);
+		}
+
+		for (; i < blockCount; ++i)
+		{
+			_mm_stream_si128(out + i, _mm_loadu_si128(in + i));
+		}
+
+		auto copied = blockCount * Alignment;
+		std::memcpy(static_cast<char*>(destination) + copied, static_cast<const char*>(source) + copied, byteCount - copied);
+#else
+		std::memcpy(destination, source, byteCount);
+#endif
+	}
+
+	inline void Copy(void* destination, const void* source, std::size_t byteCount)
+	{
+		CopyUnfenced(destination, source, byteCount);
+		Fence();
+	}
+}
+
+// A run of elements in write-combined memory, `stride` bytes apart, to be
+// written once each, in order. Write-only: reading it back would be slow.
+// Fences when it goes away.
+template <typename T>
+class StreamingSpan
+{
+public:
+	StreamingSpan(unsigned char* data, std::size_t count, std::size_t stride)
+		: _data{ data }, _count{ count }, _stride{ stride }
+	{
+		assert(stride >= sizeof(T) && stride % StreamingCopy::Alignment == 0);
+	}
+
+	StreamingSpan(StreamingSpan&& other)
+		: _data{ other._data }, _count{ other._count }, _stride{ other._stride }
+	{
+		other._data = nullptr;
+	}
+
+	StreamingSpan(const StreamingSpan&) = delete;
+	StreamingSpan& operator=(const StreamingSpan&) = delete;
+	~StreamingSpan()
+	{
+		if (_data != nullptr)
+		{
+			StreamingCopy::Fence();
+		}
+	}
+
+	void Write(std::size_t i, const T& value)
+	{
+		assert(i < _count);
+		StreamingCopy::CopyUnfenced(_data + i * _stride, &value, sizeof(T));
+	}
+
+	std::size_t Size() const { return _count; }
+
+private:
+	unsigned char* _data;
+	std::size_t _count;
+	std::size_t _stride;
+};
@@ -0,0 +1,278 @@
+#include "stdafx.h"
+#include <algorithm>
+#include "TransformKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SISU_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and clang only emit AVX for functions that ask for it; MSVC doesn't need to be told
+#if defined(SISU_SIMD_X86) && defined(__GNUC__)
+#define SISU_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SISU_TARGET_AVX2
+#endif
+
+namespace
+{
+	const std::size_t MaxLanes = 8;
+
+	const Sisu::Affine3x4 IdentityTransform = Sisu::Affine3x4::Identity();
+
+	const float* Row(const Sisu::Affine3x4* parent, int row)
+	{
+		return &(parent != nullptr ? *parent : IdentityTransform).r0.x + row * 4;
+	}
+
+	float* Row(Sisu::Affine3x4* output, int row)
+	{
+		return &output->r0.x + row * 4;
+	}
+
+	// The reference for the SIMD versions below: they do exactly this, lane by
+	// lane. local[m] is row m of the 4x4 scale * rotation * translation; row i
+	// of the result takes row i of the parent through all of them.
+	void ComposeScalar(const TransformBatch& batch, std::size_t i)
+	{
+		auto x = batch.rotationX[i], y = batch.rotationY[i], z = batch.rotationZ[i], w = batch.rotationW[i];
+		auto x2 = x + x, y2 = y + y, z2 = z + z;
+		auto xx = x * x2, yy = y * y2, zz = z * z2;
+		auto xy = x * y2, xz = x * z2, yz = y * z2;
+		auto wx = w * x2, wy = w * y2, wz = w * z2;
+
+		auto sx = batch.scaleX[i], sy = batch.scaleY[i], sz = batch.scaleZ[i];
+		const float local[4][3] =
+		{
+			{ sx * (1.0f - (yy + zz)), sx * (xy + wz), sx * (xz - wy) },
+			{ sy * (xy - wz), sy * (1.0f - (xx + zz)), sy * (yz + wx) },
+			{ sz * (xz + wy), sz * (yz - wx), sz * (1.0f - (xx + yy)) },
+			{ batch.positionX[i], batch.positionY[i], batch.positionZ[i] }
+		};
+
+		for (int row = 0; row < 3; ++row)
+		{
+			auto parent = Row(batch.parents[i], row);
+			auto out = Row(batch.outputs[i], row);
+			for (int m = 0; m < 4; ++m)
+			{
+				auto value = local[m][0] * parent[0] + local[m][1] * parent[1] + local[m][2] * parent[2];
+				out[m] = m == 3 ? value + parent[3] : value;
+			}
+		}
+	}
+
+#ifdef SISU_SIMD_X86
+	void ComposeSse(const TransformBatch& batch, std::size_t i)
+	{
+		auto x = _mm_loadu_ps(batch.rotationX + i), y = _mm_loadu_ps(batch.rotationY + i);
+		auto z = _mm_loadu_ps(batch.rotationZ + i), w = _mm_loadu_ps(batch.rotationW + i);
+		auto x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+		auto xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+		auto xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+		auto wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+		auto one = _mm_set1_ps(1.0f);
+		auto sx = _mm_loadu_ps(batch.scaleX + i), sy = _mm_loadu_ps(batch.scaleY + i), sz = _mm_loadu_ps(batch.scaleZ + i);
+		const __m128 local[4][3] =
+		{
+			{ _mm_mul_ps(sx, _mm_sub_ps(one, _mm_add_ps(yy, zz))), _mm_mul_ps(sx, _mm_add_ps(xy, wz)), _mm_mul_ps(sx, _mm_sub_ps(xz, wy)) },
+			{ _mm_mul_ps(sy, _mm_sub_ps(xy, wz)), _mm_mul_ps(sy, _mm_sub_ps(one, _mm_add_ps(xx, zz))), _mm_mul_ps(sy, _mm_add_ps(yz, wx)) },
+			{ _mm_mul_ps(sz, _mm_add_ps(xz, wy)), _mm_mul_ps(sz, _mm_sub_ps(yz, wx)), _mm_mul_ps(sz, _mm_sub_ps(one, _mm_add_ps(xx, yy))) },
+			{ _mm_loadu_ps(batch.positionX + i), _mm_loadu_ps(batch.positionY + i), _mm_loadu_ps(batch.positionZ + i) }
+		};
+
+		for (int row = 0; row < 3; ++row)
+		{
+			// The parents' rows, transposed: parent[k] holds element k for all four lanes
+			__m128 parent[4];
+			for (int lane = 0; lane < 4; ++lane) { parent[lane] = _mm_loadu_ps(Row(batch.parents[i + lane], row)); }
+			_MM_TRANSPOSE4_PS(parent[0], parent[1], parent[2], parent[3]);
+
+			__m128 out[4];
+			for (int m = 0; m < 4; ++m)
+			{
+				out[m] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(local[m][0], parent[0]), _mm_mul_ps(local[m][1], parent[1])),
+									_mm_mul_ps(local[m][2], parent[2]));
+			}
+
+			out[3] = _mm_add_ps(out[3], parent[3]);
+
+			_MM_TRANSPOSE4_PS(out[0], out[1], out[2], out[3]);
+			for (int lane = 0; lane < 4; ++lane) { _mm_storeu_ps(Row(batch.outputs[i + lane], row), out[lane]); }
+		}
+	}
+
+	// _MM_TRANSPOSE4_PS, within each 128-bit half
+	SISU_TARGET_AVX2 inline void Transpose4(__m256& a, __m256& b, __m256& c, __m256& d)
+	{
+		auto ab0 = _mm256_unpacklo_ps(a, b), ab1 = _mm256_unpackhi_ps(a, b);
+		auto cd0 = _mm256_unpacklo_ps(c, d), cd1 = _mm256_unpackhi_ps(c, d);
+		a = _mm256_shuffle_ps(ab0, cd0, _MM_SHUFFLE(1, 0, 1, 0));
+		b = _mm256_shuffle_ps(ab0, cd0, _MM_SHUFFLE(3, 2, 3, 2));
+		c = _mm256_shuffle_ps(ab1, cd1, _MM_SHUFFLE(1, 0, 1, 0));
+		d = _mm256_shuffle_ps(ab1, cd1, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	// Same as ComposeSse, eight lanes wide. Matrix rows go through the
+	// halves of a register: lane l in the low half, lane l + 4 in the high one.
+	SISU_TARGET_AVX2 void ComposeAvx2(const TransformBatch& batch, std::size_t i)
+	{
+		auto x = _mm256_loadu_ps(batch.rotationX + i), y = _mm256_loadu_ps(batch.rotationY + i);
+		auto z = _mm256_loadu_ps(batch.rotationZ + i), w = _mm256_loadu_ps(batch.rotationW + i);
+		auto x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+		auto xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+		auto xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+		auto wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+		auto one = _mm256_set1_ps(1.0f);
+		auto sx = _mm256_loadu_ps(batch.scaleX + i), sy = _mm256_loadu_ps(batch.scaleY + i), sz = _mm256_loadu_ps(batch.scaleZ + i);
+		const __m256 local[4][3] =
+		{
+			{ _mm256_mul_ps(sx, _mm256_sub_ps(one, _mm256_add_ps(yy, zz))), _mm256_mul_ps(sx, _mm256_add_ps(xy, wz)), _mm256_mul_ps(sx, _mm256_sub_ps(xz, wy)) },
+			{ _mm256_mul_ps(sy, _mm256_sub_ps(xy, wz)), _mm256_mul_ps(sy, _mm256_sub_ps(one, _mm256_add_ps(xx, zz))), _mm256_mul_ps(sy, _mm256_add_ps(yz, wx)) },
+			{ _mm256_mul_ps(sz, _mm256_add_ps(xz, wy)), _mm256_mul_ps(sz, _mm256_sub_ps(yz, wx)), _mm256_mul_ps(sz, _mm256_sub_ps(one, _mm256_add_ps(xx, yy))) },
+			{ _mm256_loadu_ps(batch.positionX + i), _mm256_loadu_ps(batch.positionY + i), _mm256_loadu_ps(batch.positionZ + i) }
+		};
+
+		for (int row = 0; row < 3; ++row)
+		{
+			__m256 parent[4];
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				auto low = _mm_loadu_ps(Row(batch.parents[i + lane], row));
+				auto high = _mm_loadu_ps(Row(batch.parents[i + lane + 4], row));
+				parent[lane] = _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+			}
+
+			Transpose4(parent[0], parent[1], parent[2], parent[3]);
+
+			__m256 out[4];
+			for (int m = 0; m < 4; ++m)
+			{
+				out[m] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(local[m][0], parent[0]), _mm256_mul_ps(local[m][1], parent[1])),
+									   _mm256_mul_ps(local[m][2], parent[2]));
+			}
+
+			out[3] = _mm256_add_ps(out[3], parent[3]);
+
+			Transpose4(out[0], out[1], out[2], out[3]);
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				_mm_storeu_ps(Row(batch.outputs[i + lane], row), _mm256_castps256_ps128(out[lane]));
+				_mm_storeu_ps(Row(batch.outputs[i + lane + 4], row), _mm256_extractf128_ps(out[lane], 1));
+			}
+		}
+	}
+
+	bool CpuHasAvx2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) { return false; }
+
+		// The OS has to save the YMM registers too
+		__cpuid(info, 1);
+		auto hasOsxsaveAndAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+		if (!hasOsxsaveAndAvx || (_xgetbv(0) & 6) != 6) { return false; }
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+
+	// Full groups of `lanes` straight from the batch; the rest through a
+	// padded copy, so the last few objects go through the same lanes math.
+	template <typename Kernel>
+	void ComposeInGroups(const TransformBatch& batch, std::size_t count, std::size_t lanes, Kernel kernel)
+	{
+		auto fullCount = count - count % lanes;
+		for (std::size_t i = 0; i < fullCount; i += lanes) { kernel(batch, i); }
+		if (fullCount == count) { return; }
+
+		float values[10][MaxLanes];
+		const float* sources[10] = { batch.positionX, batch.positionY, batch.positionZ, batch.scaleX, batch.scaleY, batch.scaleZ,
+									 batch.rotationX, batch.rotationY, batch.rotationZ, batch.rotationW };
+		const float padding[10] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+		const Sisu::Affine3x4* parents[MaxLanes];
+		Sisu::Affine3x4* outputs[MaxLanes];
+		Sisu::Affine3x4 discarded;
+
+		auto rest = count - fullCount;
+		for (std::size_t lane = 0; lane < lanes; ++lane)
+		{
+			auto isUsed = lane < rest;
+			for (int component = 0; component < 10; ++component)
+			{
+				values[component][lane] = isUsed ? sources[component][fullCount + lane] : padding[component];
+			}
+
+			parents[lane] = isUsed ? batch.parents[fullCount + lane] : nullptr;
+			outputs[lane] = isUsed ? batch.outputs[fullCount + lane] : &discarded;
+		}
+
+		TransformBatch padded = { values[0], values[1], values[2], values[3], values[4], values[5],
+								  values[6], values[7], values[8], values[9], parents, outputs };
+		kernel(padded, 0);
+	}
+}
+
+namespace TransformKernel
+{
+	bool IsSupported(Kind kind)
+	{
+		switch (kind)
+		{
+		case Kind::Scalar:
+			return true;
+#ifdef SISU_SIMD_X86
+		case Kind::Sse:
+			return true;
+		case Kind::Avx2:
+		{
+			static const bool hasAvx2 = CpuHasAvx2();
+			return hasAvx2;
+		}
+#endif
+		default:
+			return false;
+		}
+	}
+
+	Kind Best()
+	{
+		return IsSupported(Kind::Avx2) ? Kind::Avx2 : IsSupported(Kind::Sse) ? Kind::Sse : Kind::Scalar;
+	}
+
+	void Compose(const TransformBatch& batch, std::size_t count)
+	{
+		static const Kind best = Best();
+		Compose(batch, count, best);
+	}
+
+	void Compose(const TransformBatch& batch, std::size_t count, Kind kind)
+	{
+		switch (kind)
+		{
+#ifdef SISU_SIMD_X86
+		case Kind::Avx2:
+			ComposeInGroups(batch, count, 8, ComposeAvx2);
+			break;
+		case Kind::Sse:
+			ComposeInGroups(batch, count, 4, ComposeSse);
+			break;
+#endif
+		default:
+			for (std::size_t i = 0; i < count; ++i) { ComposeScalar(batch, i); }
+			break;
+		}
+	}
+}
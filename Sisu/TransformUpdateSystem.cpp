@@ -1,65 +1,357 @@
 #include "stdafx.h"
+#include <algorithm>
+#include <cmath>
 #include "TransformUpdateSystem.h"
 #include "GameTimer.h"
 #include "Arena.h"
-#include "GameObject.h"
+#include "GameObjectStorage.h"
+#include "JobSystem.h"
+#include "TransformKernel.h"
 
-bool TransformUpdateSystem::Update(const GameTimer& gt, Arena<GameObject>& bricks)
+namespace
 {
-	_elapsedSinceLastUpdate += gt.DeltaTimeSeconds();
+	bool IsZero(const Sisu::Vector3& v)
+	{
+		return v.x == 0.0f && v.y == 0.0f && v.z == 0.0f;
+	}
+
+	bool IsSame(const Sisu::Vector3& a, const Sisu::Vector3& b)
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+
+	// Objects waiting for their new transform, copied out into one array per
+	// component for TransformKernel. Each one is flagged Queued until Flush().
+	class ComposeQueue
+	{
+	public:
+		static const std::size_t Capacity = 64;
+
+		ComposeQueue(ComponentPages<Sisu::Affine3x4>::View transforms, ComponentPages<Sisu::Affine3x4>::View previousTransforms,
+					 ComponentPages<std::uint8_t>::View flags) :
+			_transforms(transforms),
+			_previousTransforms(previousTransforms),
+			_flags(flags)
+		{
+		}
+
+		bool IsFull() const { return _count == Capacity; }
+
+		// A snapped object doesn't get interpolated: its previous transform is set to the new one too
+		void Push(std::size_t index, const GameObjectMotion& motion, const Sisu::Affine3x4* parentTransform, bool isSnapped)
+		{
+			_positionX[_count] = motion.localPosition.x;
+			_positionY[_count] = motion.localPosition.y;
+			_positionZ[_count] = motion.localPosition.z;
+			_scaleX[_count] = motion.localScale.x;
+			_scaleY[_count] = motion.localScale.y;
+			_scaleZ[_count] = motion.localScale.z;
+			_rotationX[_count] = motion.rotQuat.x;
+			_rotationY[_count] = motion.rotQuat.y;
+			_rotationZ[_count] = motion.rotQuat.z;
+			_rotationW[_count] = motion.rotQuat.w;
+			_parents[_count] = parentTransform;
+			_outputs[_count] = &_transforms[index];
+			_indices[_count] = index;
+			_isSnapped[_count] = isSnapped;
+			_count++;
+
+			_flags[index] = TransformFlag::WorldChanged | TransformFlag::Queued;
+		}
+
+		void Flush()
+		{
+			TransformBatch batch = { _positionX, _positionY, _positionZ, _scaleX, _scaleY, _scaleZ,
+									 _rotationX, _rotationY, _rotationZ, _rotationW, _parents, _outputs };
+			TransformKernel::Compose(batch, _count);
+
+			for (std::size_t i = 0; i < _count; ++i)
+			{
+				auto index = _indices[i];
+				if (_isSnapped[i]) { _previousTransforms[index] = _transforms[index]; }
+				_flags[index] = TransformFlag::WorldChanged;
+			}
+
+			_count = 0;
+		}
+
+	private:
+		ComponentPages<Sisu::Affine3x4>::View _transforms;
+		ComponentPages<Sisu::Affine3x4>::View _previousTransforms;
+		ComponentPages<std::uint8_t>::View _flags;
+		std::size_t _count = 0;
+
+		float _positionX[Capacity], _positionY[Capacity], _positionZ[Capacity];
+		float _scaleX[Capacity], _scaleY[Capacity], _scaleZ[Capacity];
+		float _rotationX[Capacity], _rotationY[Capacity], _rotationZ[Capacity], _rotationW[Capacity];
+		const Sisu::Affine3x4* _parents[Capacity];
+		Sisu::Affine3x4* _outputs[Capacity];
+		std::size_t _indices[Capacity];
+		bool _isSnapped[Capacity];
+	};
+}
+
+void TransformUpdateSystem::SlotRange::Add(std::size_t pfirst, std::size_t plast)
+{
+	first = IsEmpty() ? pfirst : std::min(first, pfirst);
+	last = IsEmpty() ? plast : std::max(last, plast);
+}
+
+bool TransformUpdateSystem::Update(const GameTimer& gt, GameObjectArena& bricks)
+{
+	return Update(gt.DeltaTimeSeconds(), bricks);
+}
+
+bool TransformUpdateSystem::Update(float deltaSeconds, GameObjectArena& bricks)
+{
+	_elapsedSinceLastUpdate += deltaSeconds;
 
 	auto somethingChanged = false;
+	ClearChanged(bricks.OccupiedSize());
+
+	// Whatever moved in the latest step is still on its way there
+	MarkChanged(_changedInLastStep);
 
-	while (_elapsedSinceLastUpdate > _updatePeriod)
+	std::size_t substeps = 0;
+	while (_elapsedSinceLastUpdate > _updatePeriod && substeps < _maxSubsteps)
 	{
 		_elapsedSinceLastUpdate -= _updatePeriod;
 		somethingChanged = DoUpdate(bricks) || somethingChanged;
+		substeps++;
 	}
 
-	return somethingChanged;
+	if (_elapsedSinceLastUpdate > _updatePeriod)
+	{
+		// Too far behind: the simulation slows down for this frame instead
+		_elapsedSinceLastUpdate = std::fmod(_elapsedSinceLastUpdate, _updatePeriod);
+	}
+
+	return somethingChanged || !_changed.IsEmpty();
 }
 
-bool TransformUpdateSystem::DoUpdate(Arena<GameObject>& bricks)
+bool TransformUpdateSystem::DoUpdate(GameObjectArena& bricks)
 {
-	static int updateCount = 0;
-
 	auto somethingChanged = false;
-	_bricksToUpdate.clear();
-	_bricksToUpdateIndex = 0;
-	for (auto& brick : bricks)
+	if (&bricks != _updateOrderArena || bricks.StructureVersion() != _updateOrderVersion)
+	{
+		// Objects got added, removed or moved, so whatever shows them has
+		// to start over anyway
+		RebuildUpdateOrder(bricks);
+		ClearChanged(bricks.OccupiedSize());
+		for (std::size_t index = 0; index < _changedSlots.Size(); ++index) { _changedSlots.Set(index); }
+		_changed.Add(0, _changedSlots.Size());
+		somethingChanged = true;
+	}
+
+	auto& storage = bricks.GetStorage();
+	_changedInStep.clear();
+	if (_jobs != nullptr && _updateOrder.size() > TaskSize) { UpdateInParallel(storage, _changedInStep); }
+	else { UpdateRange(storage, OrderRange{ 0, _updateOrder.size() }, _changedInStep); }
+
+	MarkChanged(_changedInStep);
+	std::swap(_changedInLastStep, _changedInStep);
+	_stepCount++;
+	return somethingChanged || !_changedInLastStep.empty();
+}
+
+// Only the bits that are set get reset, then the bitmap gets fit to the
+// arena, which only changes size along with its structure
+void TransformUpdateSystem::ClearChanged(std::size_t slotCount)
+{
+	for (auto index = _changedSlots.NextSet(_changed.first, _changed.last); index < _changed.last;
+		 index = _changedSlots.NextSet(index + 1, _changed.last))
+	{
+		_changedSlots.Reset(index);
+	}
+
+	if (slotCount < _changedSlots.Size()) { _changedSlots.Truncate(slotCount); }
+	while (_changedSlots.Size() < slotCount) { _changedSlots.PushBack(false); }
+	_changed = SlotRange();
+}
+
+// Slots past the arena's end were removed since
+void TransformUpdateSystem::MarkChanged(const std::vector<std::size_t>& slots)
+{
+	for (auto index : slots)
+	{
+		if (index >= _changedSlots.Size()) { continue; }
+
+		_changedSlots.Set(index);
+		_changed.Add(index);
+	}
+}
+
+// Only objects that move, were marked dirty, or whose parent's transform
+// changed get recomputed; for the rest, this is a couple of compares.
+// Objects that were marked dirty snap to their new transform, e.g. when
+// they're dragged, or new, rather than get interpolated.
+void TransformUpdateSystem::UpdateRange(GameObjectStorage& storage, OrderRange range, std::vector<std::size_t>& changed) const
+{
+	// Straight on the components: this only touches the hot ones
+	auto transforms = storage.Transforms();
+	auto previousTransforms = storage.PreviousTransforms();
+	auto motions = storage.Motion();
+	auto spins = storage.Spin();
+	auto flags = storage.TransformFlags();
+
+	ComposeQueue queue(transforms, previousTransforms, flags);
+	for (auto position = range.begin; position < range.end; ++position)
 	{
-		if (brick.isRoot)
+		const auto& entry = _updateOrder[position];
+		auto& motion = motions[entry.index];
+		auto& flag = flags[entry.index];
+
+		// Otherwise the previous transform is the current one already
+		if ((flag & TransformFlag::WorldChanged) != 0) { previousTransforms[entry.index] = transforms[entry.index]; }
+
+		auto isSnapped = (flag & TransformFlag::LocalDirty) != 0;
+		auto isDirty = isSnapped;
+		if (!IsZero(motion.velocityPerSec))
 		{
-			_bricksToUpdate.push_back(&brick);
+			auto delta = motion.velocityPerSec * _updatePeriod;
+			motion.localPosition += delta;
+			isDirty = true;
 		}
+
+		if (!IsZero(motion.eulerRotPerSec))
+		{
+			// The Euler conversion is all trig, and the rate hardly ever changes
+			auto& spin = spins[entry.index];
+			if (!IsSame(spin.eulerRotPerSec, motion.eulerRotPerSec) || spin.stepSeconds != _updatePeriod)
+			{
+				spin.stepRotation = Sisu::Quat::Euler(motion.eulerRotPerSec * _updatePeriod);
+				spin.eulerRotPerSec = motion.eulerRotPerSec;
+				spin.stepSeconds = _updatePeriod;
+			}
+
+			motion.rotQuat = spin.stepRotation * motion.rotQuat;
+
+			// Otherwise the rounding errors of all those products add up,
+			// and the rotation starts to scale too; spread out over the steps
+			if ((_stepCount + entry.index) % RenormalizePeriod == 0) { motion.rotQuat.Normalize(); }
+
+			isDirty = true;
+		}
+
+		// TODO update scale maybe
+
+		// The parent is earlier in the order, so its flags are already this tick's
+		auto hasParent = entry.parentIndex != NoParent;
+		auto parentFlags = hasParent ? flags[entry.parentIndex] : 0;
+		if ((parentFlags & TransformFlag::WorldChanged) != 0) { isDirty = true; }
+
+		if (!isDirty)
+		{
+			flag = 0;
+			continue;
+		}
+
+		// A kid needs its parent's new transform, so it can't be in the same batch
+		if ((parentFlags & TransformFlag::Queued) != 0 || queue.IsFull()) { queue.Flush(); }
+
+		queue.Push(entry.index, motion, hasParent ? &transforms[entry.parentIndex] : nullptr, isSnapped);
+		changed.push_back(entry.index);
 	}
 
-	while (_bricksToUpdateIndex < _bricksToUpdate.size())
+	queue.Flush();
+}
+
+// Each task collects its slots in a list of its own; the lists are kept
+// around, so they don't get allocated again every step
+void TransformUpdateSystem::UpdateInParallel(GameObjectStorage& storage, std::vector<std::size_t>& changed)
+{
+	auto runTasks = [&](std::size_t taskCount, auto rangeOf)
+	{
+		if (_taskResults.size() < taskCount) { _taskResults.resize(taskCount); }
+		_jobs->ParallelFor(taskCount, [&](std::size_t task)
+		{
+			_taskResults[task].clear();
+			UpdateRange(storage, rangeOf(task), _taskResults[task]);
+		});
+
+		for (std::size_t task = 0; task < taskCount; ++task)
+		{
+			changed.insert(changed.end(), _taskResults[task].begin(), _taskResults[task].end());
+		}
+	};
+
+	runTasks(_subtreeBatches.size(), [&](std::size_t task) { return _subtreeBatches[task]; });
+
+	for (const auto& level : _wideLevels)
 	{
-		auto brick = _bricksToUpdate[_bricksToUpdateIndex];
-		auto delta = brick->velocityPerSec * _updatePeriod;
-		brick->localPosition += delta;
+		auto taskCount = (level.end - level.begin + TaskSize - 1) / TaskSize;
+		if (taskCount <= 1)
+		{
+			UpdateRange(storage, level, changed);
+			continue;
+		}
 
-		auto deltaRot = brick->eulerRotPerSec * _updatePeriod;
-		auto rotq = Sisu::Quat::Euler(deltaRot);
-		brick->rotQuat = rotq * brick->rotQuat;
+		runTasks(taskCount, [&](std::size_t task)
+		{
+			auto begin = level.begin + task * TaskSize;
+			return OrderRange{ begin, std::min(begin + std::size_t(TaskSize), level.end) };
+		});
+	}
+}
 
-		// TODO update scale maybe
+void TransformUpdateSystem::RebuildUpdateOrder(const GameObjectArena& bricks)
+{
+	auto hierarchy = bricks.GetStorage().Hierarchy();
 
-		auto parentTransform = brick->isRoot ? nullptr : &bricks[brick->parentIndex].transform;
-		brick->RefreshTransform(parentTransform);
+	_updateOrder.clear();
+	_subtreeBatches.clear();
+	_wideLevels.clear();
 
-		if (brick->hasChildren)
+	std::vector<std::size_t> roots;
+	bricks.ForEachLiveRange([&](std::size_t first, std::size_t last)
+	{
+		for (auto index = first; index < last; ++index)
 		{
-			for (int i = brick->childrenStartIndex; i <= brick->childrenEndIndex; ++i)
+			if (hierarchy[index].isRoot) { roots.push_back(index); }
+		}
+	});
+
+	std::vector<OrderRange> levels;
+	for (auto root : roots)
+	{
+		auto subtreeBegin = _updateOrder.size();
+		_updateOrder.push_back(UpdateEntry{ root, NoParent });
+
+		// Breadth-first, one level at a time; the order doubles as the queue
+		levels.clear();
+		for (auto levelBegin = subtreeBegin; levelBegin < _updateOrder.size(); )
+		{
+			auto levelEnd = _updateOrder.size();
+			levels.push_back(OrderRange{ levelBegin, levelEnd });
+
+			for (auto position = levelBegin; position < levelEnd; ++position)
 			{
-				_bricksToUpdate.push_back(&(bricks[i]));
+				auto index = _updateOrder[position].index;
+				const auto& node = hierarchy[index];
+				if (!node.hasChildren) { continue; }
+
+				for (auto i = node.childrenStartIndex; i <= node.childrenEndIndex; ++i)
+				{
+					_updateOrder.push_back(UpdateEntry{ i, index });
+				}
 			}
+
+			levelBegin = levelEnd;
 		}
 
-		_bricksToUpdateIndex++;
-		somethingChanged = true;
+		if (_updateOrder.size() - subtreeBegin > TaskSize)
+		{
+			_wideLevels.insert(_wideLevels.end(), levels.begin(), levels.end());
+			continue;
+		}
+
+		// Batch up neighbouring small subtrees, up to about a task's worth
+		auto canExtend = !_subtreeBatches.empty() && _subtreeBatches.back().end == subtreeBegin
+						 && _subtreeBatches.back().end - _subtreeBatches.back().begin < TaskSize;
+		if (canExtend) { _subtreeBatches.back().end = _updateOrder.size(); }
+		else { _subtreeBatches.push_back(OrderRange{ subtreeBegin, _updateOrder.size() }); }
 	}
 
-	return somethingChanged;
-}
\ No newline at end of file
+	_updateOrderArena = &bricks;
+	_updateOrderVersion = bricks.StructureVersion();
+}
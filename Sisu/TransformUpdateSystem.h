@@ -1,23 +1,116 @@
 #pragma once
+#include <utility>
 #include <vector>
+#include "GameObjectStorage.h"
+#include "OccupancyBitmap.h"
 
-template <typename T> class Arena;
-class GameObject;
 class GameTimer;
+class JobSystem;
 
 class TransformUpdateSystem
 {
 public:
-	bool Update(const GameTimer& gt, Arena<GameObject>& bricks);
+	// Runs as many fixed steps as the time since the last call covers, but at
+	// most MaxSubsteps. Returns whether anything to draw changed: a transform,
+	// the interpolation between the last two steps, or the objects themselves.
+	bool Update(const GameTimer& gt, GameObjectArena& bricks);
+	bool Update(float deltaSeconds, GameObjectArena& bricks);
+
+	// A single fixed step, regardless of the timer, e.g. for benchmarks.
+	bool DoUpdate(GameObjectArena& bricks);
+
+	// Slots to draw differently after the last Update(), one bit each: the
+	// ones whose transform changed in its steps, or in the step before,
+	// since they're still being interpolated. Every slot, if the arena's
+	// structure changed.
+	const OccupancyBitmap& ChangedSlots() const { return _changedSlots; }
+
+	// Where ChangedSlots() has bits set, as [first, last); empty if nowhere.
+	std::pair<std::size_t, std::size_t> ChangedRange() const { return std::make_pair(_changed.first, _changed.last); }
+
+	// How far between the last two steps the current time is, in [0, 1]. The
+	// objects are drawn at Lerp(previous transform, transform, alpha), i.e.
+	// one step behind, so that they move smoothly at any frame rate.
+	float InterpolationAlpha() const { return _elapsedSinceLastUpdate / _updatePeriod; }
+
+	// The fixed step, in seconds
+	void SetUpdatePeriod(float seconds) { _updatePeriod = seconds; }
+
+	// After a hitch (a window drag, a long load), at most this many steps
+	// run in one Update(), and the rest of the time is dropped. Otherwise the
+	// steps could take longer than the time they cover, and never catch up.
+	void SetMaxSubsteps(std::size_t count) { _maxSubsteps = count; }
+
+	// Spreads the update over the threads of `jobs`; null (the default)
+	// updates on the calling thread. The results are the same either way,
+	// bit for bit: every object still gets computed from the same inputs.
+	void SetJobSystem(JobSystem* jobs) { _jobs = jobs; }
 
 private:
-	bool DoUpdate(Arena<GameObject>& bricks);
+	static const std::size_t NoParent = static_cast<std::size_t>(-1);
+
+	// Roughly how many objects one task updates
+	static const std::size_t TaskSize = 2048;
+
+	// A spinning object's rotation gets renormalized every this many steps
+	static const std::size_t RenormalizePeriod = 64;
+
+	struct UpdateEntry
+	{
+		std::size_t index;
+		std::size_t parentIndex;	// NoParent for roots
+	};
+
+	// [begin, end) in _updateOrder
+	struct OrderRange
+	{
+		std::size_t begin;
+		std::size_t end;
+	};
+
+	struct SlotRange
+	{
+		std::size_t first = 0;
+		std::size_t last = 0;
+
+		bool IsEmpty() const { return first == last; }
+		void Add(std::size_t index) { Add(index, index + 1); }
+		void Add(std::size_t pfirst, std::size_t plast);
+	};
+
+	void RebuildUpdateOrder(const GameObjectArena& bricks);
+
+	// Both append the slots they changed to `changed`
+	void UpdateRange(GameObjectStorage& storage, OrderRange range, std::vector<std::size_t>& changed) const;
+	void UpdateInParallel(GameObjectStorage& storage, std::vector<std::size_t>& changed);
+
+	void ClearChanged(std::size_t slotCount);
+	void MarkChanged(const std::vector<std::size_t>& slots);
 
 private:
-	std::vector<GameObject*> _bricksToUpdate;
-	std::size_t _bricksToUpdateIndex = 0;
+	// Root by root, each subtree breadth-first, so every parent comes before
+	// its kids, and a tick is a single sweep. Only rebuilt when the arena's
+	// structure changes.
+	std::vector<UpdateEntry> _updateOrder;
+	const GameObjectArena* _updateOrderArena = nullptr;
+	std::size_t _updateOrderVersion = 0;
+
+	// How the order splits up for the parallel update: subtrees don't
+	// depend on each other, so small ones get batched into tasks. Big ones
+	// go level by level instead; a level only depends on the ones above.
+	std::vector<OrderRange> _subtreeBatches;
+	std::vector<OrderRange> _wideLevels;
+	std::vector<std::vector<std::size_t>> _taskResults;
+	JobSystem* _jobs = nullptr;
+
+	OccupancyBitmap _changedSlots;
+	SlotRange _changed;								// around the bits set in _changedSlots
+	std::vector<std::size_t> _changedInLastStep;
+	std::vector<std::size_t> _changedInStep;		// the step that's running
 
+	std::size_t _stepCount = 0;
 	float _elapsedSinceLastUpdate = 0.0f;
 	float _updatePeriod = 0.016f;
+	std::size_t _maxSubsteps = 5;
 
 };
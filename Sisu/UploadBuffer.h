@@ -1,13 +1,14 @@
 #pragma once
 #include "d3dUtil.h"
 #include <WindowsX.h>
+#include "StreamingCopy.h"
 
 template <typename T>
 class UploadBuffer
 {
 public:
 	UploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer)
-		: _isConstantBuffer{ isConstantBuffer }
+		: _elementCount{ elementCount }, _isConstantBuffer{ isConstantBuffer }
 	{
 		_elementByteSize = _isConstantBuffer ? 
 								d3dUtil::CalcConstantBufferByteSize(sizeof(T)) // b/c CB needs to be 256 byte aligned
@@ -48,10 +49,39 @@ public:
 		memcpy(&_mappedData[elementIndex * _elementByteSize], &data, sizeof(T));
 	}
 
+	// Copies data[0, count) to the elements from firstElement on, streamed
+	// (see StreamingCopy): in one go where the elements are packed, one by
+	// one in a constant buffer, where they're padded to 256 bytes.
+	void CopyRange(UINT firstElement, const T* data, UINT count)
+	{
+		if (_elementByteSize == sizeof(T))
+		{
+			assert(firstElement + count <= _elementCount);
+			StreamingCopy::Copy(&_mappedData[firstElement * _elementByteSize], data, count * sizeof(T));
+			return;
+		}
+
+		auto span = MapForWrite(firstElement, count);
+		for (UINT i = 0; i < count; ++i)
+		{
+			span.Write(i, data[i]);
+		}
+	}
+
+	// The elements from firstElement on, to write as they're made, with no
+	// copy in between. Write them in order, and let the span go before the
+	// frame is submitted.
+	StreamingSpan<T> MapForWrite(UINT firstElement, UINT count)
+	{
+		assert(firstElement + count <= _elementCount);
+		return StreamingSpan<T>(&_mappedData[firstElement * _elementByteSize], count, _elementByteSize);
+	}
+
 private:
 	Microsoft::WRL::ComPtr<ID3D12Resource> _uploadBuffer;
 	BYTE* _mappedData = nullptr;
 
 	UINT _elementByteSize = 0;
+	UINT _elementCount = 0;
 	bool _isConstantBuffer = false;
 };
@@ -5,17 +5,23 @@
 
 #pragma once
 
+// Guarded, so that the platform independent sources (arena, game objects,
+// math) also build elsewhere, e.g. for the benchmarks.
+#ifdef _WIN32
 #include "targetver.h"
 
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 // Windows Header Files
 #include <windows.h>
+#endif
 
 // C RunTime Header Files
 #include <stdlib.h>
-#include <malloc.h>
 #include <memory.h>
+#ifdef _WIN32
+#include <malloc.h>
 #include <tchar.h>
+#endif
 
 
 // reference additional headers your program requires here
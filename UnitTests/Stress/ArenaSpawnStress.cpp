@@ -0,0 +1,118 @@
+// Stress test for ConcurrentSpawner: many threads spawning and despawning
+// at once, meant to run under ThreadSanitizer. Standalone, not part of the
+// test project; on Linux:
+//
+//	g++ -std=c++14 -O1 -g -fsanitize=thread -pthread -I../../Sisu ArenaSpawnStress.cpp -o spawnstress
+//	./spawnstress [rounds]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+#include "ConcurrentSpawner.h"
+
+namespace
+{
+	std::atomic<long> alive{ 0 };
+
+	struct Brick
+	{
+		Brick(std::size_t pthread, int pserial) : thread(pthread), serial(pserial) { alive++; }
+		Brick(const Brick& other) : thread(other.thread), serial(other.serial) { alive++; }
+		~Brick() { alive--; }
+
+		std::size_t thread;
+		int serial;
+	};
+
+	const std::size_t ThreadCount = 8;
+
+	template <typename Storage>
+	bool RunRounds(const char* name, int rounds)
+	{
+		Arena<Brick, Storage> arena;
+		ConcurrentSpawner<Brick, Storage> spawner(ThreadCount, 32, 16);
+		std::mt19937 rng(1234);
+
+		for (int round = 0; round < rounds; ++round)
+		{
+			// Items that are live now, split between the threads for despawning
+			std::vector<std::vector<std::size_t>> victims(ThreadCount);
+			arena.ForEachLiveRun([&](Brick* first, Brick* last, std::size_t firstIndex)
+			{
+				for (auto index = firstIndex; index < firstIndex + (last - first); ++index)
+				{
+					if (rng() % 3 == 0) { victims[rng() % ThreadCount].push_back(index); }
+				}
+			});
+
+			auto sharedSlots = 64 + rng() % 256;
+			spawner.Open(arena, sharedSlots);
+
+			std::vector<std::size_t> spawnCounts(ThreadCount, 0);
+			std::vector<std::thread> workers;
+			for (std::size_t t = 0; t < ThreadCount; ++t)
+			{
+				auto wanted = rng() % 96;
+				workers.emplace_back([&, t, wanted]()
+				{
+					long checksum = 0;
+					for (std::size_t i = 0; i < wanted; ++i)
+					{
+						auto index = spawner.Spawn(arena, t, t, static_cast<int>(i));
+						if (index == spawner.None) { break; }
+
+						spawnCounts[t]++;
+						if (i % 7 == 3) { spawner.Despawn(t, index); }
+
+						// Reading live items while others spawn is allowed
+						if (!victims[t].empty()) { checksum += arena[victims[t][i % victims[t].size()]].serial; }
+					}
+
+					for (auto index : victims[t]) { spawner.Despawn(t, index); }
+					(void)checksum;
+				});
+			}
+
+			for (auto& worker : workers) { worker.join(); }
+
+			auto before = arena.ItemCount();
+			spawner.Close(arena);
+
+			std::size_t spawned = 0, despawned = 0;
+			for (std::size_t t = 0; t < ThreadCount; ++t)
+			{
+				spawned += spawnCounts[t];
+				despawned += (spawnCounts[t] + 3) / 7 + victims[t].size();
+			}
+
+			std::size_t counted = 0;
+			for (auto& brick : arena) { counted++; if (brick.thread >= ThreadCount) { return false; } }
+
+			if (arena.ItemCount() != before + spawned - despawned || counted != arena.ItemCount()
+				|| alive != static_cast<long>(arena.ItemCount()))
+			{
+				std::printf("%s: round %d: expected %zu items, got %zu (%zu iterated, %ld alive)\n", name, round,
+							before + spawned - despawned, arena.ItemCount(), counted, alive.load());
+				return false;
+			}
+
+			if (round % 16 == 15) { arena.TrimEnd(); }
+		}
+
+		std::printf("%s: %d rounds, %zu items left, %zu slots\n", name, rounds, arena.ItemCount(), arena.OccupiedSize());
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	auto rounds = argc > 1 ? std::atoi(argv[1]) : 200;
+
+	auto ok = RunRounds<ContiguousStorage<Brick>>("contiguous", rounds);
+	ok &= RunRounds<PagedStorage<Brick, 6>>("paged", rounds);
+
+	return ok ? 0 : 1;
+}
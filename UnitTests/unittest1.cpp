@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 #include "../Sisu/Arena.h"
+#include "../Sisu/ConcurrentSpawner.h"
+#include <thread>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -12,6 +14,23 @@ namespace UnitTests
 		float x, y;
 	};
 
+	// No default constructor; counts copies, and instances that are alive.
+	struct Tracked
+	{
+		Tracked(int pvalue) : value(pvalue) { alive++; }
+		Tracked(const Tracked& other) : value(other.value) { alive++; copies++; }
+		Tracked(Tracked&& other) : value(other.value) { alive++; }
+		~Tracked() { alive--; }
+		Tracked& operator=(const Tracked&) = delete;
+
+		int value;
+		static int alive;
+		static int copies;
+	};
+
+	int Tracked::alive = 0;
+	int Tracked::copies = 0;
+
 	TEST_CLASS(ArenaTests)
 	{
 	public:
@@ -197,6 +216,26 @@ namespace UnitTests
 			Assert::IsTrue(a.OccupiedSize() == 50 && newIndex == 48);
 		}
 
+		TEST_METHOD(GapsCoalesce)
+		{
+			Arena<int> a(20);
+			for (int i = 0; i < 20; ++i) { a.AddAnywhere(i); }
+
+			a.RemoveAt(4, 2);
+			a.RemoveAt(8, 2);
+			a.RemoveAt(6, 2);	// 0 .. 3, _, _, _, _, _, _, 10 .. 19
+
+			// The three removals should have merged into a single gap of 6
+			Assert::IsTrue(a.GetStartIndexForGap(6, 15) == 4);
+
+			std::vector<int> vec{ 99, 99 };
+			auto newIndex = a.AddAnywhere(std::begin(vec), std::end(vec));
+			Assert::IsTrue(newIndex == 4);	// 0 .. 3, 99, 99, _, _, _, _, 10 .. 19
+
+			Assert::IsTrue(a.GetStartIndexForGap(4, 0) == 6);
+			Assert::IsTrue(a.GetStartIndexForGap(5, 0) == 20);
+		}
+
 		TEST_METHOD(Clear)
 		{
 			Arena<int> a(50);
@@ -290,6 +329,243 @@ namespace UnitTests
 			}
 		}
 
+		TEST_METHOD(LiveRuns)
+		{
+			Arena<int> a(200);
+			for (int i = 0; i < 200; ++i) { a.AddAnywhere(i); }
+			a.RemoveAt(0, 3);
+			a.RemoveAt(60, 70);		// run spanning a whole 64-bit word
+			a.RemoveAt(199);
+
+			std::vector<std::size_t> runs;
+			a.ForEachLiveRun([&](int* first, int* last, std::size_t firstIndex)
+			{
+				Assert::IsTrue(*first == (int) firstIndex);
+				runs.push_back(firstIndex);
+				runs.push_back(firstIndex + (last - first));
+			});
+
+			std::vector<std::size_t> expected{ 3, 60, 130, 199 };
+			Assert::IsTrue(runs == expected);
+
+			auto count = 0;
+			for (auto& item : a) { count++; }
+			Assert::IsTrue(count == 126 && a.ItemCount() == 126);
+		}
+
+		TEST_METHOD(Handles)
+		{
+			Arena<int> a(10);
+			for (int i = 0; i < 10; ++i) { a.AddAnywhere(i); }
+
+			auto handle = a.HandleAt(3);
+			Assert::IsTrue(a.IsValid(handle) && *a.TryGet(handle) == 3);
+
+			a.Relocate(3, 10);
+			std::size_t index;
+			Assert::IsTrue(a.TryGetIndex(handle, OUT index) && index == 10);
+			Assert::IsTrue(*a.TryGet(handle) == 3);
+			Assert::IsTrue(a.CanAddItemAt(3) && a.ItemCount() == 10);
+
+			// Removing the item invalidates the handle, even though
+			// both the slot and the handle id get reused.
+			a.RemoveAt(10);
+			Assert::IsFalse(a.IsValid(handle));
+			Assert::IsTrue(a.TryGet(handle) == nullptr);
+
+			auto reused = a.AddAnywhere(123);
+			auto newHandle = a.HandleAt(reused);
+			Assert::IsTrue(newHandle.id == handle.id && newHandle != handle);
+			Assert::IsFalse(a.IsValid(handle));
+			Assert::IsTrue(*a.TryGet(newHandle) == 123);
+
+			Assert::IsFalse(a.IsValid(ArenaHandle()));
+
+			a.Clear();
+			Assert::IsFalse(a.IsValid(newHandle));
+		}
+
+		TEST_METHOD(PagedStorage)
+		{
+			Arena<int, ::PagedStorage<int, 2>> a;	// 4 items per page
+			for (int i = 0; i < 6; ++i) { a.AddAnywhere(i); }
+
+			auto first = &a[0];
+			for (int i = 6; i < 100; ++i) { a.AddAnywhere(i); }
+			Assert::IsTrue(first == &a[0] && a[0] == 0 && a[99] == 99);
+
+			// Runs never cross a page boundary, since pages aren't adjacent in memory
+			a.RemoveAt(1);
+			std::vector<std::size_t> runs;
+			a.ForEachLiveRun([&](int* first, int* last, std::size_t firstIndex)
+			{
+				if (firstIndex < 12)
+				{
+					runs.push_back(firstIndex);
+					runs.push_back(firstIndex + (last - first));
+				}
+			});
+
+			std::vector<std::size_t> expected{ 0, 1, 2, 4, 4, 8, 8, 12 };
+			Assert::IsTrue(runs == expected);
+
+			auto index = 0;
+			for (auto& item : a) { if (index == 1) { index++; } Assert::IsTrue(item == index++); }
+			Assert::IsTrue(index == 100);
+		}
+
+		TEST_METHOD(EmplaceAndMove)
+		{
+			Tracked::alive = 0;
+			Tracked::copies = 0;
+			{
+				Arena<Tracked> a(4);	// so that adding more has to move everything
+				for (int i = 0; i < 10; ++i) { a.EmplaceAnywhere(i); }
+				a.RemoveAt(2, 3);
+				Assert::IsTrue(Tracked::alive == 7);
+
+				std::vector<Tracked> kids{ 20, 30, 40 };
+				Tracked::copies = 0;
+				Assert::IsTrue(a.AddAnywhere(std::make_move_iterator(kids.begin()), std::make_move_iterator(kids.end())) == 2);
+				a.AddAt(10, Tracked(50));
+				a.EmplaceAt(3, 99);		// overwrites 30
+				a.Relocate(0, 11);
+				Assert::IsTrue(Tracked::copies == 0);
+
+				std::vector<int> expected{ 1, 20, 99, 40, 5, 6, 7, 8, 9, 50, 0 };
+				auto index = 0;
+				for (auto& item : a) { Assert::IsTrue(item.value == expected[index++]); }
+				Assert::IsTrue(Tracked::alive == 11 + 3);
+
+				Arena<Tracked> b(1);
+				b.EmplaceAnywhere(7);
+				b.AddAnywhere(b[0]);	// a live item, while the arena has to grow
+				Assert::IsTrue(Tracked::copies == 1 && b[1].value == 7);
+			}
+
+			Assert::IsTrue(Tracked::alive == 0);
+		}
+
+		TEST_METHOD(Batches)
+		{
+			Arena<int> a;
+			for (int i = 0; i < 20; ++i) { a.AddAnywhere(i); }
+
+			a.BeginBatch();
+			a.RemoveAt(2, 6);
+			a.RemoveAt(12, 2);
+			a.AddAt(4, 99);				// 0, 1, _, _, 99, _, _, _, 8, 9, 10, 11, _, _, 14, ...
+			a.RemoveAt(19);
+
+			// Lookups in the middle of a batch still see the current state
+			Assert::IsTrue(a.GetStartIndexForGap(3, 6) == 5);
+			a.AddAt(5, 98);
+			a.RemoveAt(0);
+			a.CommitBatch();
+
+			Assert::IsTrue(a.GetStartIndexForGap(2, 0) == 2);
+			Assert::IsTrue(a.GetStartIndexForGap(2, 7) == 6);
+			Assert::IsTrue(a.AddAnywhere(97) == 19);
+			Assert::IsTrue(a.AddAnywhere(96) == 0);
+			Assert::IsTrue(a.ItemCount() == 14);
+		}
+
+		TEST_METHOD(ConcurrentSpawns)
+		{
+			Arena<int> a;
+			for (int i = 0; i < 100; ++i) { a.AddAnywhere(-1); }
+			a.RemoveAt(10, 20);
+
+			// 4 threads with 8 slots each, the rest comes from the shared slots
+			ConcurrentSpawner<int> spawner(4, 8, 4);
+			spawner.Open(a, 60);
+
+			std::vector<std::thread> workers;
+			for (std::size_t t = 0; t < 4; ++t)
+			{
+				workers.emplace_back([&, t]()
+				{
+					for (int i = 0; i < 20; ++i)
+					{
+						auto index = spawner.Spawn(a, t, int(t));
+						if (i % 5 == 0) { spawner.Despawn(t, index); }
+					}
+
+					spawner.Despawn(t, 50 + t);
+				});
+			}
+
+			for (auto& worker : workers) { worker.join(); }
+			spawner.Close(a);
+
+			Assert::IsTrue(a.ItemCount() == 80 + 4 * 20 - 4 * 4 - 4);
+
+			std::vector<int> counts(4, 0);
+			for (auto& item : a) { if (item >= 0) { counts[item]++; } }
+			for (auto count : counts) { Assert::IsTrue(count == 16); }
+
+			// Leftover reserved slots are free again
+			a.TrimEnd();
+			Assert::IsTrue(a.GetStartIndexForGap(1, 0) != 0 && a.OccupiedSize() <= 100 + 4 * 20);
+		}
+
+		TEST_METHOD(Stats)
+		{
+			Arena<int> a(10);
+			for (int i = 0; i < 10; ++i) { a.AddAnywhere(i); }
+			a.RemoveAt(1, 2);
+			a.RemoveAt(5);
+			a.RemoveAt(9);						// 0, _, _, 3, 4, _, 6, 7, 8, _
+			a.Relocate(8, 9);					// 0, _, _, 3, 4, _, 6, 7, _, 8
+
+			auto stats = a.GetStats();
+			Assert::IsTrue(stats.liveCount == 6 && stats.occupiedSize == 10 && stats.highWaterMark == 10);
+			Assert::IsTrue(stats.gapCount == 3 && stats.largestGap == 2 && stats.freeCount == 4);
+			Assert::IsTrue(stats.fragmentation == 0.5f);
+			Assert::IsTrue(stats.relocationCount == 1 && stats.structuralOpCount == 10 + 4 + 1);
+
+			a.ResetFrameCounters();
+			a.RemoveAt(9);
+			a.TrimEnd();
+			a.AddAnywhere(5);
+
+			stats = a.GetStats();
+			Assert::IsTrue(stats.occupiedSize == 8 && stats.highWaterMark == 10 && stats.structuralOpCount == 2);
+			Assert::IsTrue(stats.gapCount == 1 && stats.fragmentation == 0.0f);
+		}
+
+		TEST_METHOD(StructureVersion)
+		{
+			Arena<int> a;
+			auto version = a.StructureVersion();
+			auto changed = [&]()
+			{
+				auto isNew = a.StructureVersion() != version;
+				version = a.StructureVersion();
+				return isNew;
+			};
+
+			a.AddAnywhere(1);
+			a.AddAnywhere(2);
+			Assert::IsTrue(changed());
+			a.Relocate(0, 2);
+			Assert::IsTrue(changed());
+			a.AddAt(1, 3);					// overwrite
+			Assert::IsTrue(changed());
+			a.RemoveAt(1);
+			Assert::IsTrue(changed());
+
+			// Reads, gap lookups and trimming leave the items where they are
+			a[2] = 4;
+			a.GetStartIndexForGap(2, 0);
+			a.TrimEnd();
+			a.GetStats();
+			Assert::IsTrue(!changed());
+
+			a.Clear();
+			Assert::IsTrue(changed());
+		}
+
 		TEST_METHOD(RangeForAndVectorAdd)
 		{
 			Arena<int> a;
@@ -2,6 +2,8 @@
 #include "CppUnitTest.h"
 #include "../Sisu/Arena.h"
 #include "../Sisu/GameObject.h"
+#include "../Sisu/GameObjectStorage.h"
+#include "../Sisu/HierarchyCompactor.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -69,6 +71,23 @@ namespace UnitTests
 			Assert::IsTrue(a[freshChild].parentIndex == 3);
 		}
 		
+		TEST_METHOD(HandlesSurviveRelocation)
+		{
+			Arena<GameObject> a;
+			auto parentIndex = GameObject::AddToArena(a, GameObject());
+			auto firstChild = a.HandleAt(GameObject::AddChild(a, parentIndex, GameObject()));
+			auto secondChild = a.HandleAt(GameObject::AddChild(a, parentIndex, GameObject()));
+
+			// Blocks the slot after the kids, so the next one relocates them all
+			GameObject::AddToArena(a, GameObject());
+			GameObject::AddChild(a, parentIndex, GameObject());
+
+			std::size_t firstIndex, secondIndex;
+			Assert::IsTrue(a.TryGetIndex(firstChild, OUT firstIndex) && a.TryGetIndex(secondChild, OUT secondIndex));
+			Assert::IsTrue(firstIndex == a[parentIndex].childrenStartIndex && secondIndex == firstIndex + 1);
+			Assert::IsTrue(a.TryGet(firstChild)->parentIndex == parentIndex);
+		}
+
 		TEST_METHOD(AddAndRelocateChildren)
 		{
 			Arena<GameObject> a;
@@ -143,6 +162,46 @@ namespace UnitTests
 			Assert::IsTrue(a[newPaIndex].parentIndex == grandParentIndex);
 		}
 
+		TEST_METHOD(Compaction)
+		{
+			Arena<GameObject> a;
+			auto grandParentIndex = GameObject::AddToArena(a, GameObject());
+			auto parentIndex = GameObject::AddChild(a, grandParentIndex, GameObject());
+			GameObject::AddChild(a, parentIndex, GameObject());
+			auto otherRootIndex = GameObject::AddToArena(a, GameObject());
+			GameObject::AddChild(a, grandParentIndex, GameObject());
+
+			// grandpa, ___, child, otherRoot, parent, newParent => with a
+			// tiny budget per step, this still has to end up breadth-first:
+			// grandpa, otherRoot, parent, newParent, child
+
+			auto grandParent = a.HandleAt(grandParentIndex);
+			auto child = a.HandleAt(2);
+			auto otherRoot = a.HandleAt(otherRootIndex);
+
+			HierarchyCompactor compactor;
+			compactor.Begin(a);
+			auto steps = 0;
+			while (!compactor.Step(a, 1)) { steps++; }
+
+			Assert::IsTrue(steps > 0);
+			Assert::IsTrue(a.OccupiedSize() == 5 && a.ItemCount() == 5);
+			Assert::IsTrue(a[0].isRoot && a[1].isRoot);
+			Assert::IsTrue(a[0].childrenStartIndex == 2 && a[0].childrenEndIndex == 3);
+			Assert::IsTrue(a[2].parentIndex == 0 && a[3].parentIndex == 0);
+			Assert::IsTrue(a[2].hasChildren && a[2].childrenStartIndex == 4 && a[2].childrenEndIndex == 4);
+			Assert::IsTrue(a[4].parentIndex == 2);
+
+			auto remap = compactor.BuildRemap(a);
+			Assert::IsTrue(remap[grandParentIndex] == 0 && remap[otherRootIndex] == 1 && remap[2] == 4);
+			Assert::IsTrue(remap[1] == HierarchyCompactor::NotMapped);
+			Assert::IsTrue(a.TryGet(child) == &a[4] && a.TryGet(otherRoot) == &a[1] && a.TryGet(grandParent) == &a[0]);
+
+			// Already compact, so nothing moves
+			remap = HierarchyCompactor::Compact(a);
+			for (std::size_t i = 0; i < remap.size(); ++i) { Assert::IsTrue(remap[i] == i); }
+		}
+
 		TEST_METHOD(AddChildren)
 		{
 			Arena<GameObject> a;
@@ -179,5 +238,116 @@ namespace UnitTests
 			Assert::IsTrue(a[parentIndex].hasChildren);
 			Assert::IsTrue(a[parentIndex].childrenStartIndex == firstChildIndex && a[parentIndex].childrenEndIndex == firstChildIndex + 5);
 		}
+
+		TEST_METHOD(ComponentStorage)
+		{
+			// The same edits on a plain arena and on a component-split one
+			// have to give the same objects at the same indices.
+			Arena<GameObject> aos;
+			GameObjectArena soa;
+
+			auto check = [&]()
+			{
+				Assert::IsTrue(aos.OccupiedSize() == soa.OccupiedSize() && aos.ItemCount() == soa.ItemCount());
+				for (std::size_t i = 0; i < aos.OccupiedSize(); ++i)
+				{
+					Assert::IsTrue(aos.CanAddItemAt(i) == soa.CanAddItemAt(i));
+					if (aos.CanAddItemAt(i)) { continue; }
+
+					GameObject go = soa[i];
+					Assert::IsTrue(go.localPosition.x == aos[i].localPosition.x && go.color.g == aos[i].color.g);
+					Assert::IsTrue(go.isRoot == aos[i].isRoot && go.parentIndex == aos[i].parentIndex);
+					Assert::IsTrue(go.hasChildren == aos[i].hasChildren);
+					if (go.hasChildren)
+					{
+						Assert::IsTrue(go.childrenStartIndex == aos[i].childrenStartIndex);
+						Assert::IsTrue(go.childrenEndIndex == aos[i].childrenEndIndex);
+					}
+				}
+			};
+
+			auto make = [](float id)
+			{
+				GameObject go;
+				go.localPosition = Sisu::Vector3(id, 0.0f, 0.0f);
+				go.color = Sisu::Color(0.0f, id, 0.0f, 1.0f);
+				return go;
+			};
+
+			std::vector<std::size_t> parents;
+			for (int i = 0; i < 8; ++i)
+			{
+				parents.push_back(GameObject::AddToArena(aos, make(float(i))));
+				Assert::IsTrue(GameObject::AddToArena(soa, make(float(i))) == parents.back());
+			}
+
+			// Round robin, so families keep relocating
+			for (int round = 0; round < 4; ++round)
+			{
+				for (std::size_t p = 0; p < parents.size(); ++p)
+				{
+					if (p == 1 || p == 5) { continue; }
+
+					auto id = float(100 + round * 10 + p);
+					auto index = GameObject::AddChild(aos, parents[p], make(id));
+					Assert::IsTrue(GameObject::EmplaceChild(soa, parents[p], make(id)) == index);
+				}
+			}
+
+			std::vector<GameObject> kids{ make(500.0f), make(501.0f), make(502.0f) };
+			auto first = GameObject::AddChildren(aos, parents[3], kids.begin(), kids.end());
+			Assert::IsTrue(GameObject::AddChildren(soa, parents[3], kids.begin(), kids.end()) == first);
+			check();
+
+			// Written through the proxy, read back from the component arrays
+			auto&& kid = soa[first];
+			kid.velocityPerSec = Sisu::Vector3(1.0f, 2.0f, 3.0f);
+			kid.isVisible = false;
+			aos[first].velocityPerSec = Sisu::Vector3(1.0f, 2.0f, 3.0f);
+			Assert::IsTrue(soa.GetStorage().Motion()[first].velocityPerSec.y == 2.0f);
+			Assert::IsTrue(!soa.GetStorage().Cold()[first].isVisible);
+			Assert::IsTrue(soa.GetStorage().Hierarchy()[first].parentIndex == parents[3]);
+
+			// New objects start out dirty, until the transform update has seen them
+			Assert::IsTrue(soa.GetStorage().TransformFlags()[first] == TransformFlag::LocalDirty);
+			soa.GetStorage().TransformFlags()[first] = 0;
+			kid.MarkTransformDirty();
+			Assert::IsTrue(soa.GetStorage().TransformFlags()[first] == TransformFlag::LocalDirty);
+
+			// Lone roots only, so that no kid gets orphaned
+			for (auto index : { parents[1], parents[5] })
+			{
+				aos.RemoveAt(index);
+				soa.RemoveAt(index);
+			}
+
+			HierarchyCompactor::Compact(aos);
+			HierarchyCompactor::Compact(soa);
+			check();
+
+			std::size_t visited = 0;
+			soa.ForEachLiveRange([&](std::size_t from, std::size_t to) { visited += to - from; });
+			Assert::IsTrue(visited == soa.ItemCount());
+		}
+
+		// Growing adds pages, and leaves the components already there alone
+		TEST_METHOD(ComponentStorageGrowsInPages)
+		{
+			GameObjectArena arena;
+			auto first = GameObject::AddToArena(arena, GameObject());
+			auto&& ref = arena[first];
+			ref.localPosition = Sisu::Vector3(1.0f, 2.0f, 3.0f);
+			const auto* motion = &arena.GetStorage().Motion()[first];
+
+			for (int i = 0; i < 3000; ++i) { GameObject::AddToArena(arena, GameObject()); }
+
+			Assert::IsTrue(&arena.GetStorage().Motion()[first] == motion);
+			Assert::IsTrue(ref.localPosition.y == 2.0f);
+
+			auto pageSize = ComponentPages<GameObjectMotion>::PageSize;
+			Assert::IsTrue(arena.GetStorage().ContiguousEnd(0, 3001) == pageSize);
+			Assert::IsTrue(arena.GetStorage().ContiguousEnd(pageSize, 3001) == 2 * pageSize);
+			Assert::IsTrue(arena.GetStorage().ContiguousEnd(2 * pageSize + 5, 3001) == 3001);
+		}
 	};
 }
\ No newline at end of file
@@ -61,5 +61,48 @@ namespace UnitTests
 			auto res = a * b;
 			Assert::IsTrue(res.r0.x == 2.0 && res.r1.y == 2.0);
 		}
+
+		TEST_METHOD(AffineMatchesMatrix4)
+		{
+			auto ma = Sisu::Matrix4::FromQuat(Sisu::Quat::Euler(10.0f, 20.0f, 30.0f));
+			ma.r0.x *= 2.0f;
+			ma.r3 = Sisu::Vector4(1.0f, -2.0f, 3.0f, 1.0f);
+			auto mb = Sisu::Matrix4::FromQuat(Sisu::Quat::Euler(-40.0f, 5.0f, 0.0f));
+			mb.r3 = Sisu::Vector4(0.5f, 0.0f, -4.0f, 1.0f);
+
+			auto a = Sisu::Affine3x4::FromMatrix4(ma);
+			auto b = Sisu::Affine3x4::FromMatrix4(mb);
+			auto expected = ma * mb;
+			auto product = (a * b).ToMatrix4();
+
+			auto e = &expected.r0.x;
+			auto p = &product.r0.x;
+			for (int i = 0; i < 16; ++i) { Assert::IsTrue(Sisu::Approx(e[i], p[i], 1e-5f)); }
+
+			// Points go through like row vectors through the 4x4
+			auto point = Sisu::Vector3(1.0f, 2.0f, 3.0f);
+			auto moved = a.TransformPoint(point);
+			auto expectedPoint = point * ma;
+			Assert::IsTrue(Sisu::Approx(moved.x, expectedPoint.x + ma.r3.x, 1e-5f));
+			Assert::IsTrue(Sisu::Approx(moved.y, expectedPoint.y + ma.r3.y, 1e-5f));
+			Assert::IsTrue(Sisu::Approx(moved.z, expectedPoint.z + ma.r3.z, 1e-5f));
+		}
+
+		TEST_METHOD(AffineInverse)
+		{
+			auto m = Sisu::Matrix4::FromQuat(Sisu::Quat::Euler(30.0f, -60.0f, 15.0f));
+			m.r1.x *= 3.0f;
+			m.r1.y *= 3.0f;
+			m.r1.z *= 3.0f;
+			m.r3 = Sisu::Vector4(4.0f, 5.0f, -6.0f, 1.0f);
+
+			auto a = Sisu::Affine3x4::FromMatrix4(m);
+			auto identity = (a * a.Inverse()).ToMatrix4();
+			auto expected = Sisu::Matrix4::Identity();
+
+			auto e = &expected.r0.x;
+			auto p = &identity.r0.x;
+			for (int i = 0; i < 16; ++i) { Assert::IsTrue(Sisu::Approx(e[i], p[i], 1e-5f)); }
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,332 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "../Sisu/GameObject.cpp"
+#include "../Sisu/GameTimer.cpp"
+#include "../Sisu/TransformKernel.cpp"
+#include "../Sisu/TransformUpdateSystem.cpp"
+#include "../Sisu/JobSystem.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	// Flat families, one subtree that's too big for a single task, and
+	// a few long chains; some of it moves, some doesn't.
+	void MakeMixedScene(GameObjectArena& arena)
+	{
+		auto make = [](std::size_t serial)
+		{
+			GameObject go;
+			go.localPosition = Sisu::Vector3(float(serial % 5), 1.0f, -0.5f);
+			go.localScale = Sisu::Vector3(1.0f, 0.5f + float(serial % 3), 1.0f);
+			go.velocityPerSec = serial % 4 == 0 ? Sisu::Vector3(0.25f, 0.0f, 1.0f) : Sisu::Vector3::Zero();
+			go.eulerRotPerSec = serial % 3 == 0 ? Sisu::Vector3(10.0f, 45.0f, 0.0f) : Sisu::Vector3::Zero();
+			return go;
+		};
+
+		std::size_t serial = 0;
+		std::vector<GameObject> kids;
+		for (int family = 0; family < 300; ++family)
+		{
+			auto root = GameObject::AddToArena(arena, make(serial++));
+			kids.clear();
+			for (int i = 0; i < 7; ++i) { kids.push_back(make(serial++)); }
+			GameObject::AddChildren(arena, root, kids.begin(), kids.end());
+		}
+
+		// 1 + 40 + 40 * 100 objects
+		auto wideRoot = GameObject::AddToArena(arena, make(serial++));
+		kids.assign(40, make(serial++));
+		auto first = GameObject::AddChildren(arena, wideRoot, kids.begin(), kids.end());
+		for (std::size_t i = 0; i < 40; ++i)
+		{
+			kids.clear();
+			for (int j = 0; j < 100; ++j) { kids.push_back(make(serial++)); }
+			GameObject::AddChildren(arena, first + i, kids.begin(), kids.end());
+		}
+
+		for (int chain = 0; chain < 20; ++chain)
+		{
+			auto parent = GameObject::AddToArena(arena, make(serial++));
+			for (int depth = 0; depth < 30; ++depth) { parent = GameObject::AddChild(arena, parent, make(serial++)); }
+		}
+	}
+
+	std::size_t CountSet(const OccupancyBitmap& bits)
+	{
+		std::size_t count = 0;
+		for (auto index = bits.NextSet(0, bits.Size()); index < bits.Size(); index = bits.NextSet(index + 1, bits.Size())) { count++; }
+		return count;
+	}
+
+	TEST_CLASS(TransformUpdateTests)
+	{
+	public:
+		TEST_METHOD(ParallelMatchesSerial)
+		{
+			GameObjectArena serialArena, parallelArena;
+			MakeMixedScene(serialArena);
+			MakeMixedScene(parallelArena);
+
+			JobSystem jobs(4);
+			TransformUpdateSystem serial, parallel;
+			parallel.SetJobSystem(&jobs);
+
+			for (int tick = 0; tick < 10; ++tick)
+			{
+				if (tick == 5)
+				{
+					// Dirty a subtree by hand, in both
+					serialArena[0].localPosition.x += 1.0f;
+					serialArena[0].MarkTransformDirty();
+					parallelArena[0].localPosition.x += 1.0f;
+					parallelArena[0].MarkTransformDirty();
+				}
+
+				Assert::IsTrue(serial.DoUpdate(serialArena) == parallel.DoUpdate(parallelArena));
+
+				// Bit for bit
+				const auto& serialStorage = serialArena.GetStorage();
+				const auto& parallelStorage = parallelArena.GetStorage();
+				for (std::size_t i = 0; i < serialArena.OccupiedSize(); ++i)
+				{
+					Assert::IsTrue(std::memcmp(&serialStorage.Transforms()[i], &parallelStorage.Transforms()[i], sizeof(Sisu::Affine3x4)) == 0);
+					Assert::IsTrue(serialStorage.TransformFlags()[i] == parallelStorage.TransformFlags()[i]);
+				}
+			}
+		}
+
+		TEST_METHOD(StaticObjectsAreSkipped)
+		{
+			GameObjectArena arena;
+			auto parent = GameObject::AddToArena(arena, GameObject());
+			auto kid = GameObject::AddChild(arena, parent, GameObject());
+			auto other = GameObject::AddToArena(arena, GameObject());
+
+			TransformUpdateSystem system;
+			Assert::IsTrue(system.DoUpdate(arena));		// everything's new
+			Assert::IsTrue(!system.DoUpdate(arena));
+
+			// Moving the parent moves the kid, but not the other root
+			arena[parent].localPosition = Sisu::Vector3(0.0f, 2.0f, 0.0f);
+			arena[parent].MarkTransformDirty();
+			Assert::IsTrue(system.DoUpdate(arena));
+			Assert::IsTrue(arena[kid].transform.r1.w == 2.0f);
+			Assert::IsTrue(arena.GetStorage().TransformFlags()[kid] == TransformFlag::WorldChanged);
+			Assert::IsTrue(arena.GetStorage().TransformFlags()[other] == 0);
+
+			// Removing something counts as a change too
+			arena.RemoveAt(other);
+			Assert::IsTrue(system.DoUpdate(arena));
+			Assert::IsTrue(!system.DoUpdate(arena));
+		}
+
+		TEST_METHOD(SpinningStaysUnitLength)
+		{
+			GameObjectArena arena;
+			GameObject go;
+			go.eulerRotPerSec = Sisu::Vector3(33.0f, 45.0f, 7.0f);
+			auto index = GameObject::AddToArena(arena, go);
+
+			TransformUpdateSystem system;
+			for (int step = 0; step < 20000; ++step) { system.DoUpdate(arena); }
+			Assert::IsTrue(std::fabs(Sisu::Quat(arena[index].rotQuat).Magnitude() - 1.0f) < 1e-5f);
+
+			// A new rate, or a new step, takes effect right away
+			Sisu::Quat before = arena[index].rotQuat;
+			arena[index].eulerRotPerSec = Sisu::Vector3(0.0f, 90.0f, 0.0f);
+			system.SetUpdatePeriod(0.5f);
+			system.DoUpdate(arena);
+			Assert::IsTrue(Sisu::Quat(arena[index].rotQuat) == Sisu::Quat::Euler(0.0f, 45.0f, 0.0f) * before);
+		}
+
+		TEST_METHOD(SubstepsAreCapped)
+		{
+			GameObjectArena arena;
+			GameObject go;
+			go.velocityPerSec = Sisu::Vector3(1.0f, 0.0f, 0.0f);
+			auto index = GameObject::AddToArena(arena, go);
+
+			TransformUpdateSystem system;
+			system.SetUpdatePeriod(0.125f);
+			system.SetMaxSubsteps(3);
+
+			// A 10 second hitch only gets three steps, and the rest is dropped
+			Assert::IsTrue(system.Update(10.0f, arena));
+			Assert::IsTrue(arena[index].localPosition.x == 0.375f);
+			Assert::IsTrue(system.InterpolationAlpha() >= 0.0f && system.InterpolationAlpha() <= 1.0f);
+
+			Assert::IsTrue(system.Update(0.2f, arena));
+			Assert::IsTrue(arena[index].localPosition.x == 0.5f);
+		}
+
+		TEST_METHOD(InterpolatesBetweenSteps)
+		{
+			GameObjectArena arena;
+			GameObject go;
+			go.velocityPerSec = Sisu::Vector3(2.0f, 0.0f, 0.0f);
+			auto mover = GameObject::AddToArena(arena, go);
+			auto dragged = GameObject::AddToArena(arena, GameObject());
+
+			TransformUpdateSystem system;
+			system.SetUpdatePeriod(0.25f);
+			Assert::IsTrue(system.Update(0.375f, arena));
+			Assert::IsTrue(system.Update(0.25f, arena));
+			Assert::IsTrue(system.InterpolationAlpha() == 0.5f);
+
+			// Drawn halfway between the last two steps
+			const auto& storage = arena.GetStorage();
+			auto drawn = Sisu::Lerp(storage.PreviousTransforms()[mover], storage.Transforms()[mover], system.InterpolationAlpha());
+			Assert::IsTrue(storage.PreviousTransforms()[mover].r0.w == 0.5f);
+			Assert::IsTrue(drawn.r0.w == 0.75f);
+
+			// No step this time, but what's drawn still moves
+			Assert::IsTrue(system.Update(0.0625f, arena));
+			Assert::IsTrue(system.ChangedRange() == std::make_pair(mover, mover + 1));
+			Assert::IsTrue(system.ChangedSlots().Test(mover) && !system.ChangedSlots().Test(dragged));
+
+			// Moved from outside: it snaps there
+			arena[dragged].localPosition = Sisu::Vector3(5.0f, 0.0f, 0.0f);
+			arena[dragged].MarkTransformDirty();
+			system.Update(0.25f, arena);
+			Assert::IsTrue(storage.PreviousTransforms()[dragged].r0.w == 5.0f);
+			Assert::IsTrue(storage.Transforms()[dragged].r0.w == 5.0f);
+		}
+
+		// Two movers at opposite ends of a lot of static objects: just those
+		// two slots, not everything in between, on one thread or on four
+		TEST_METHOD(ChangedSlotsAreJustTheMovers)
+		{
+			JobSystem jobs(4);
+			for (auto pool : { &jobs, static_cast<JobSystem*>(nullptr) })
+			{
+				GameObjectArena arena;
+				for (int i = 0; i < 10000; ++i) { GameObject::AddToArena(arena, GameObject()); }
+				arena[0].velocityPerSec = Sisu::Vector3(1.0f, 0.0f, 0.0f);
+				arena[9999].velocityPerSec = Sisu::Vector3(1.0f, 0.0f, 0.0f);
+
+				TransformUpdateSystem system;
+				system.SetJobSystem(pool);
+				system.SetUpdatePeriod(0.25f);
+				system.Update(0.375f, arena);
+				Assert::IsTrue(CountSet(system.ChangedSlots()) == 10000);		// everything's new
+				system.Update(0.25f, arena);
+				Assert::IsTrue(CountSet(system.ChangedSlots()) == 10000);		// and was in the step before
+
+				system.Update(0.25f, arena);
+				Assert::IsTrue(CountSet(system.ChangedSlots()) == 2);
+				Assert::IsTrue(system.ChangedSlots().Test(0) && system.ChangedSlots().Test(9999));
+
+				// Still drawn between the last two steps, and then not anymore
+				arena[0].velocityPerSec = Sisu::Vector3::Zero();
+				arena[9999].velocityPerSec = Sisu::Vector3::Zero();
+				system.Update(0.25f, arena);
+				Assert::IsTrue(CountSet(system.ChangedSlots()) == 2);
+				system.Update(0.25f, arena);
+				Assert::IsTrue(CountSet(system.ChangedSlots()) == 0);
+				Assert::IsTrue(system.ChangedRange().first == system.ChangedRange().second);
+			}
+		}
+
+		TEST_METHOD(JobSystemRunsEveryTaskOnce)
+		{
+			JobSystem jobs(3);
+			Assert::IsTrue(jobs.ThreadCount() == 3);
+
+			for (std::size_t taskCount : { 0, 1, 2, 7, 1000 })
+			{
+				std::vector<std::atomic<int>> runs(taskCount);
+				for (auto& run : runs) { run = 0; }
+
+				jobs.ParallelFor(taskCount, [&](std::size_t task) { runs[task]++; });
+				for (auto& run : runs) { Assert::IsTrue(run == 1); }
+			}
+		}
+	};
+
+	TEST_CLASS(TransformKernelTests)
+	{
+	public:
+		// Random local transforms, every other one under a random parent
+		struct Inputs
+		{
+			std::vector<float> values[10];
+			std::vector<Sisu::Affine3x4> parentTransforms;
+			std::vector<const Sisu::Affine3x4*> parents;
+
+			explicit Inputs(std::size_t count) : parentTransforms(count), parents(count)
+			{
+				std::mt19937 random(1234);
+				std::uniform_real_distribution<float> position(-100.0f, 100.0f), scale(0.1f, 4.0f), angle(-180.0f, 180.0f);
+
+				for (std::size_t i = 0; i < count; ++i)
+				{
+					auto rotation = Sisu::Quat::Euler(angle(random), angle(random), angle(random));
+					float object[10] = { position(random), position(random), position(random), scale(random), scale(random), scale(random),
+										 rotation.x, rotation.y, rotation.z, rotation.w };
+					for (int component = 0; component < 10; ++component) { values[component].push_back(object[component]); }
+
+					auto parentRotation = Sisu::Quat::Euler(angle(random), angle(random), angle(random));
+					parentTransforms[i] = GameObject::ComputeTransform(Sisu::Vector3(scale(random), scale(random), scale(random)), parentRotation,
+																	   Sisu::Vector3(position(random), position(random), position(random)), nullptr);
+					parents[i] = i % 2 == 0 ? &parentTransforms[i] : nullptr;
+				}
+			}
+
+			TransformBatch Batch(std::size_t first, Sisu::Affine3x4* const* outputs) const
+			{
+				return TransformBatch{ &values[0][first], &values[1][first], &values[2][first], &values[3][first], &values[4][first],
+									   &values[5][first], &values[6][first], &values[7][first], &values[8][first], &values[9][first],
+									   &parents[first], outputs };
+			}
+		};
+
+		TEST_METHOD(KernelsMatchComputeTransform)
+		{
+			// Not a multiple of 4 or 8, so the last few go through the padded group
+			const std::size_t count = 301;
+			Inputs inputs(count);
+
+			std::vector<Sisu::Affine3x4> results(count);
+			std::vector<Sisu::Affine3x4*> outputs;
+			for (auto& result : results) { outputs.push_back(&result); }
+
+			for (auto kind : { TransformKernel::Kind::Scalar, TransformKernel::Kind::Sse, TransformKernel::Kind::Avx2 })
+			{
+				if (!TransformKernel::IsSupported(kind)) { continue; }
+
+				TransformKernel::Compose(inputs.Batch(0, outputs.data()), count, kind);
+				for (std::size_t i = 0; i < count; ++i)
+				{
+					const auto& v = inputs.values;
+					auto expected = GameObject::ComputeTransform(Sisu::Vector3(v[3][i], v[4][i], v[5][i]), Sisu::Quat(v[6][i], v[7][i], v[8][i], v[9][i]),
+																 Sisu::Vector3(v[0][i], v[1][i], v[2][i]), inputs.parents[i]);
+
+					auto actualValues = &results[i].r0.x;
+					auto expectedValues = &expected.r0.x;
+					for (int element = 0; element < 12; ++element)
+					{
+						auto tolerance = 1e-5f * std::max(1.0f, std::fabs(expectedValues[element]));
+						Assert::IsTrue(std::fabs(actualValues[element] - expectedValues[element]) <= tolerance);
+					}
+				}
+
+				// Batched any other way, it's the same, bit for bit
+				std::vector<Sisu::Affine3x4> oneByOne(count);
+				for (std::size_t i = 0; i < count; ++i)
+				{
+					auto output = &oneByOne[i];
+					TransformKernel::Compose(inputs.Batch(i, &output), 1, kind);
+				}
+
+				Assert::IsTrue(std::memcmp(results.data(), oneByOne.data(), count * sizeof(Sisu::Affine3x4)) == 0);
+			}
+		}
+	};
+}
@@ -0,0 +1,286 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+#include "../Sisu/SisuUtilities.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	// Small operands, so that cancellation can't blow up the rounding
+	// differences between versions
+	struct RandomMath
+	{
+		float Next(float low = -2.0f, float high = 2.0f) { return std::uniform_real_distribution<float>(low, high)(random); }
+
+		Sisu::Vector3 Vector3() { return Sisu::Vector3(Next(), Next(), Next()); }
+		Sisu::Vector4 Vector4() { return Sisu::Vector4(Next(), Next(), Next(), Next()); }
+		Sisu::Matrix4 Matrix4() { return Sisu::Matrix4(Vector4(), Vector4(), Vector4(), Vector4()); }
+		Sisu::Affine3x4 Affine3x4() { return Sisu::Affine3x4(Vector4(), Vector4(), Vector4()); }
+		Sisu::Quat Quat() { return Sisu::Quat::Euler(Next(-180.0f, 180.0f), Next(-180.0f, 180.0f), Next(-180.0f, 180.0f)); }
+
+		std::mt19937 random{ 19 };
+	};
+
+	// Relative to the larger of the two, or absolute near zero
+	template <typename T>
+	void AssertClose(const T& expectedValue, const T& actualValue, float tolerance = 1e-5f)
+	{
+		auto expected = reinterpret_cast<const float*>(&expectedValue);
+		auto actual = reinterpret_cast<const float*>(&actualValue);
+		for (std::size_t i = 0; i < sizeof(T) / sizeof(float); ++i)
+		{
+			auto scale = std::fmax(1.0f, std::fmax(std::fabs(expected[i]), std::fabs(actual[i])));
+			Assert::IsTrue(Sisu::Approx(expected[i] / scale, actual[i] / scale, tolerance));
+		}
+	}
+
+	// The operators (SIMD, when the build has it) against Sisu::Scalar,
+	// over a spread of random inputs. Only the order of the additions may
+	// differ, so a relative 1e-5 is plenty.
+	TEST_CLASS(MathTests)
+	{
+	public:
+		TEST_METHOD(StorageIsAligned)
+		{
+			Assert::IsTrue(alignof(Sisu::Vector4) == 16 && sizeof(Sisu::Vector4) == 16);
+			Assert::IsTrue(alignof(Sisu::Quat) == 16 && sizeof(Sisu::Quat) == 16);
+			Assert::IsTrue(alignof(Sisu::Matrix4) == 16 && sizeof(Sisu::Matrix4) == 64);
+			Assert::IsTrue(alignof(Sisu::Affine3x4) == 16 && sizeof(Sisu::Affine3x4) == 48);
+			Assert::IsTrue(sizeof(Sisu::Vector3) == 12);
+		}
+
+		TEST_METHOD(Matrix4MulMatchesScalar)
+		{
+			for (int i = 0; i < Runs; ++i)
+			{
+				auto a = _random.Matrix4();
+				auto b = _random.Matrix4();
+				AssertClose(Sisu::Scalar::Multiply(a, b), a * b);
+			}
+		}
+
+		TEST_METHOD(Vector3MulMatchesScalar)
+		{
+			for (int i = 0; i < Runs; ++i)
+			{
+				auto v = _random.Vector3();
+				auto m = _random.Matrix4();
+				AssertClose(Sisu::Scalar::Multiply(v, m), v * m);
+			}
+		}
+
+		TEST_METHOD(AffineMulMatchesScalar)
+		{
+			for (int i = 0; i < Runs; ++i)
+			{
+				auto a = _random.Affine3x4();
+				auto b = _random.Affine3x4();
+				AssertClose(Sisu::Scalar::Multiply(a, b), a * b);
+			}
+		}
+
+		TEST_METHOD(TransformPointMatchesScalar)
+		{
+			for (int i = 0; i < Runs; ++i)
+			{
+				auto m = _random.Affine3x4();
+				auto p = _random.Vector3();
+				AssertClose(Sisu::Scalar::TransformPoint(m, p), m.TransformPoint(p));
+				AssertClose(Sisu::Scalar::TransformVector(m, p), m.TransformVector(p));
+			}
+		}
+
+		TEST_METHOD(LerpMatchesScalar)
+		{
+			for (int i = 0; i < Runs; ++i)
+			{
+				auto t = _random.Next(0.0f, 1.0f);
+				auto ma = _random.Matrix4();
+				auto mb = _random.Matrix4();
+				AssertClose(Sisu::Scalar::Lerp(ma, mb, t), Sisu::Lerp(ma, mb, t));
+
+				auto aa = _random.Affine3x4();
+				auto ab = _random.Affine3x4();
+				AssertClose(Sisu::Scalar::Lerp(aa, ab, t), Sisu::Lerp(aa, ab, t));
+			}
+		}
+
+		TEST_METHOD(QuatMulMatchesScalar)
+		{
+			for (int i = 0; i < Runs; ++i)
+			{
+				auto a = _random.Quat();
+				auto b = _random.Quat();
+				AssertClose(Sisu::Scalar::Multiply(a, b), a * b);
+			}
+		}
+
+		// Magnitude and FromQuat square by multiplying now, not with pow
+		TEST_METHOD(FromQuatMatchesDouble)
+		{
+			for (int i = 0; i < Runs; ++i)
+			{
+				auto q = _random.Quat();
+				double x = q.x, y = q.y, z = q.z, w = q.w;
+				Assert::IsTrue(Sisu::Approx(q.Magnitude(), float(std::sqrt(x * x + y * y + z * z + w * w)), 1e-6f));
+
+				auto m = Sisu::Matrix4::FromQuat(q);
+				double expected[] = { 1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y),
+									  2 * (x * y - w * z), 1 - 2 * (x * x + z * z), 2 * (y * z + w * x),
+									  2 * (x * z + w * y), 2 * (y * z - w * x), 1 - 2 * (x * x + y * y) };
+				const Sisu::Vector4* rows[] = { &m.r0, &m.r1, &m.r2 };
+				for (int r = 0; r < 3; ++r)
+				{
+					Assert::IsTrue(Sisu::Approx(rows[r]->x, float(expected[r * 3 + 0]), 1e-5f));
+					Assert::IsTrue(Sisu::Approx(rows[r]->y, float(expected[r * 3 + 1]), 1e-5f));
+					Assert::IsTrue(Sisu::Approx(rows[r]->z, float(expected[r * 3 + 2]), 1e-5f));
+				}
+			}
+		}
+
+	private:
+		static const int Runs = 1000;
+
+
+		RandomMath _random;
+	};
+
+	// The batch versions against the per-element operators. 37 elements,
+	// so that every lane width gets some, and so do the leftovers.
+	TEST_CLASS(StreamMathTests)
+	{
+	public:
+		TEST_METHOD(MatricesMatchOperators)
+		{
+			std::vector<Sisu::Matrix4> ma, mb, mout(Count);
+			std::vector<Sisu::Affine3x4> aa, ab, aout(Count);
+			for (std::size_t i = 0; i < Count; ++i)
+			{
+				ma.push_back(_random.Matrix4());
+				mb.push_back(_random.Matrix4());
+				aa.push_back(_random.Affine3x4());
+				ab.push_back(_random.Affine3x4());
+			}
+
+			Sisu::Stream::Multiply(ma.data(), mb.data(), mout.data(), Count);
+			for (std::size_t i = 0; i < Count; ++i) { AssertClose(ma[i] * mb[i], mout[i]); }
+
+			Sisu::Stream::Multiply(ma.data(), mb[0], mout.data(), Count);
+			for (std::size_t i = 0; i < Count; ++i) { AssertClose(ma[i] * mb[0], mout[i]); }
+
+			Sisu::Stream::Multiply(aa.data(), ab.data(), aout.data(), Count);
+			for (std::size_t i = 0; i < Count; ++i) { AssertClose(aa[i] * ab[i], aout[i]); }
+
+			Sisu::Stream::Multiply(aa.data(), ab[0], aout.data(), Count);
+			for (std::size_t i = 0; i < Count; ++i) { AssertClose(aa[i] * ab[0], aout[i]); }
+
+			// In place
+			auto expected = aa[5] * ab[0];
+			Sisu::Stream::Multiply(aa.data(), ab[0], aa.data(), Count);
+			AssertClose(expected, aa[5]);
+		}
+
+		TEST_METHOD(TransformsMatchAffine)
+		{
+			auto m = _random.Affine3x4();
+			std::vector<float> x, y, z, ox(Count), oy(Count), oz(Count);
+			for (std::size_t i = 0; i < Count; ++i)
+			{
+				x.push_back(_random.Next());
+				y.push_back(_random.Next());
+				z.push_back(_random.Next());
+			}
+
+			Sisu::Stream::Vector3Span<const float> in(x.data(), y.data(), z.data());
+			Sisu::Stream::Vector3Span<float> out(ox.data(), oy.data(), oz.data());
+
+			Sisu::Stream::TransformPoints(m, in, out, Count);
+			for (std::size_t i = 0; i < Count; ++i)
+			{
+				AssertClose(m.TransformPoint(Sisu::Vector3(x[i], y[i], z[i])), Sisu::Vector3(ox[i], oy[i], oz[i]));
+			}
+
+			Sisu::Stream::TransformVectors(m, in, out, Count);
+			for (std::size_t i = 0; i < Count; ++i)
+			{
+				AssertClose(m.TransformVector(Sisu::Vector3(x[i], y[i], z[i])), Sisu::Vector3(ox[i], oy[i], oz[i]));
+			}
+		}
+
+		TEST_METHOD(QuatsMatchOperators)
+		{
+			std::vector<float> a[4], b[4], out[4];
+			std::vector<Sisu::Quat> qa, qb;
+			for (std::size_t i = 0; i < Count; ++i)
+			{
+				qa.push_back(_random.Quat());
+				qb.push_back(_random.Quat());
+
+				// Off unit length, for Normalize to fix
+				qa.back().x *= 1.5f;
+				Push(a, qa.back());
+				Push(b, qb.back());
+			}
+
+			for (auto& component : out) { component.resize(Count); }
+			Sisu::Stream::Multiply(Span(a), Span(b), Span(out), Count);
+			for (std::size_t i = 0; i < Count; ++i) { AssertClose(qa[i] * qb[i], At(out, i)); }
+
+			Sisu::Stream::Normalize(Span(a), Count);
+			for (std::size_t i = 0; i < Count; ++i)
+			{
+				qa[i].Normalize();
+				AssertClose(qa[i], At(a, i));
+			}
+		}
+
+		TEST_METHOD(EulerMatchesQuatEuler)
+		{
+			std::vector<float> degrees[3], out[4];
+			for (auto& component : out) { component.resize(Count * 10); }
+			for (std::size_t i = 0; i < Count * 10; ++i)
+			{
+				for (auto& component : degrees) { component.push_back(_random.Next(-720.0f, 720.0f)); }
+			}
+
+			// Whole and quarter turns hit the edges of the sine's quadrants
+			degrees[0][0] = 90.0f;
+			degrees[1][1] = -180.0f;
+			degrees[2][2] = 360.0f;
+
+			Sisu::Stream::EulerToQuat(Sisu::Stream::Vector3Span<const float>(degrees[0].data(), degrees[1].data(), degrees[2].data()),
+									  Span(out), Count * 10);
+			for (std::size_t i = 0; i < Count * 10; ++i)
+			{
+				AssertClose(Sisu::Quat::Euler(degrees[0][i], degrees[1][i], degrees[2][i]), At(out, i), 1e-6f);
+			}
+		}
+
+	private:
+		static const std::size_t Count = 37;
+
+		static void Push(std::vector<float> (&components)[4], const Sisu::Quat& q)
+		{
+			components[0].push_back(q.x);
+			components[1].push_back(q.y);
+			components[2].push_back(q.z);
+			components[3].push_back(q.w);
+		}
+
+		static Sisu::Quat At(const std::vector<float> (&components)[4], std::size_t i)
+		{
+			return Sisu::Quat(components[0][i], components[1][i], components[2][i], components[3][i]);
+		}
+
+		static Sisu::Stream::QuatSpan<float> Span(std::vector<float> (&components)[4])
+		{
+			return Sisu::Stream::QuatSpan<float>(components[0].data(), components[1].data(), components[2].data(), components[3].data());
+		}
+
+		RandomMath _random;
+	};
+}
@@ -0,0 +1,525 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include "../Sisu/FrustumCulling.cpp"
+#include "../Sisu/InstancePacking.h"
+#include "../Sisu/StreamingCopy.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+	// A camera at the origin looking down +z, built the way
+	// XMMatrixPerspectiveFovLH builds its projection: 90 degrees vertically,
+	// square, near at 1 and far at 100. The frustum is then the pyramid
+	// |x| <= z, |y| <= z, for z from 1 to 100.
+	Sisu::Matrix4 Projection()
+	{
+		const float nearZ = 1.0f, farZ = 100.0f;
+		auto q = farZ / (farZ - nearZ);
+		return Sisu::Matrix4(Sisu::Vector4(1.0f, 0.0f, 0.0f, 0.0f),
+							 Sisu::Vector4(0.0f, 1.0f, 0.0f, 0.0f),
+							 Sisu::Vector4(0.0f, 0.0f, q, 1.0f),
+							 Sisu::Vector4(0.0f, 0.0f, -q * nearZ, 0.0f));
+	}
+
+	TEST_CLASS(FrustumCullingTests)
+	{
+	public:
+		TEST_METHOD(PlanesMatchProjection)
+		{
+			auto frustum = Frustum::FromViewProjection(Projection());
+
+			Assert::IsTrue(frustum.Contains(Sisu::Vector3(0.0f, 0.0f, 10.0f)));
+			Assert::IsTrue(frustum.Contains(Sisu::Vector3(4.9f, -4.9f, 5.0f)));
+			Assert::IsTrue(frustum.Contains(Sisu::Vector3(0.0f, 0.0f, 99.0f)));
+
+			Assert::IsFalse(frustum.Contains(Sisu::Vector3(5.1f, 0.0f, 5.0f)));
+			Assert::IsFalse(frustum.Contains(Sisu::Vector3(-5.1f, 0.0f, 5.0f)));
+			Assert::IsFalse(frustum.Contains(Sisu::Vector3(0.0f, 5.1f, 5.0f)));
+			Assert::IsFalse(frustum.Contains(Sisu::Vector3(0.0f, -5.1f, 5.0f)));
+			Assert::IsFalse(frustum.Contains(Sisu::Vector3(0.0f, 0.0f, 0.9f)));
+			Assert::IsFalse(frustum.Contains(Sisu::Vector3(0.0f, 0.0f, 101.0f)));
+			Assert::IsFalse(frustum.Contains(Sisu::Vector3(0.0f, 0.0f, -10.0f)));
+
+			// Normalized, so the distance to the near plane is in world units
+			const auto& nearPlane = frustum.planes[Frustum::Near];
+			Assert::IsTrue(Sisu::Approx(nearPlane.z * 3.0f + nearPlane.w, 2.0f, 1e-5f));
+		}
+
+		// The SIMD versions against the per-box test, over a grid of boxes
+		// all around the camera. 37 of them per row, so that the leftovers
+		// after 4 or 8 lanes get tested too.
+		TEST_METHOD(CullMatchesPerBoxTest)
+		{
+			auto frustum = Frustum::FromViewProjection(Projection());
+			WorldBounds bounds;
+			for (int z = -2; z < 12; ++z)
+			{
+				for (int x = -18; x < 19; ++x)
+				{
+					bounds.Add(Sisu::Vector3(x * 1.5f, 0.7f * z, z * 10.0f), Sisu::Vector3(0.5f, 0.25f + 0.1f * (x & 3), 0.5f));
+				}
+			}
+
+			std::vector<std::uint32_t> visible;
+			FrustumCulling::Cull(frustum, bounds, visible);
+
+			std::vector<std::uint32_t> expected;
+			for (std::uint32_t i = 0; i < bounds.Size(); ++i)
+			{
+				if (IsInside(frustum, bounds, i))
+				{
+					expected.push_back(i);
+				}
+			}
+
+			Assert::IsTrue(expected == visible);
+			Assert::IsTrue(visible.size() > 0 && visible.size() < bounds.Size());
+		}
+
+		TEST_METHOD(CullKeepsStraddlingBoxes)
+		{
+			auto frustum = Frustum::FromViewProjection(Projection());
+			WorldBounds bounds;
+			bounds.Add(Sisu::Vector3(0.0f, 0.0f, 10.0f), Sisu::Vector3(0.5f, 0.5f, 0.5f));		// inside
+			bounds.Add(Sisu::Vector3(10.5f, 0.0f, 10.0f), Sisu::Vector3(1.0f, 1.0f, 1.0f));	// across the right plane
+			bounds.Add(Sisu::Vector3(0.0f, 0.0f, 0.5f), Sisu::Vector3(1.0f, 1.0f, 1.0f));		// across the near plane
+			bounds.Add(Sisu::Vector3(20.0f, 0.0f, 10.0f), Sisu::Vector3(1.0f, 1.0f, 1.0f));	// right of it
+			bounds.Add(Sisu::Vector3(0.0f, 0.0f, -5.0f), Sisu::Vector3(1.0f, 1.0f, 1.0f));		// behind the camera
+			bounds.Add(Sisu::Vector3(0.0f, 0.0f, 150.0f), Sisu::Vector3(1.0f, 1.0f, 1.0f));	// past the far plane
+
+			std::vector<std::uint32_t> visible;
+			FrustumCulling::Cull(frustum, bounds, visible);
+
+			Assert::IsTrue(visible == std::vector<std::uint32_t>{ 0, 1, 2 });
+		}
+
+		// Appends to what's already there, for one list over several calls
+		TEST_METHOD(CullAppends)
+		{
+			auto frustum = Frustum::FromViewProjection(Projection());
+			WorldBounds bounds;
+			bounds.Add(Sisu::Vector3(0.0f, 0.0f, 10.0f), Sisu::Vector3(0.5f, 0.5f, 0.5f));
+
+			std::vector<std::uint32_t> visible{ 7 };
+			FrustumCulling::Cull(frustum, bounds, visible);
+
+			Assert::IsTrue(visible == std::vector<std::uint32_t>{ 7, 0 });
+		}
+
+		TEST_METHOD(TransformedUnitCubeBounds)
+		{
+			// Scaled by (2, 1, 1), turned 45 degrees about z, moved to (1, 2, 3)
+			auto c = std::sqrt(0.5f);
+			Sisu::Affine3x4 transform(Sisu::Vector4(2.0f * c, -c, 0.0f, 1.0f),
+									  Sisu::Vector4(2.0f * c, c, 0.0f, 2.0f),
+									  Sisu::Vector4(0.0f, 0.0f, 1.0f, 3.0f));
+
+			WorldBounds bounds;
+			bounds.AddTransformedUnitCube(transform);
+
+			Assert::IsTrue(bounds.Size() == 1);
+			Assert::IsTrue(Sisu::Approx(bounds.centerX[0], 1.0f) && Sisu::Approx(bounds.centerY[0], 2.0f) && Sisu::Approx(bounds.centerZ[0], 3.0f));
+			Assert::IsTrue(Sisu::Approx(bounds.extentX[0], 1.5f * c, 1e-6f));
+			Assert::IsTrue(Sisu::Approx(bounds.extentY[0], 1.5f * c, 1e-6f));
+			Assert::IsTrue(Sisu::Approx(bounds.extentZ[0], 0.5f, 1e-6f));
+
+			// Every corner of the cube is in the box
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				Sisu::Vector3 local((corner & 1) ? 0.5f : -0.5f, (corner & 2) ? 0.5f : -0.5f, (corner & 4) ? 0.5f : -0.5f);
+				auto p = transform.TransformPoint(local);
+				Assert::IsTrue(std::fabs(p.x - bounds.centerX[0]) <= bounds.extentX[0] + 1e-5f);
+				Assert::IsTrue(std::fabs(p.y - bounds.centerY[0]) <= bounds.extentY[0] + 1e-5f);
+				Assert::IsTrue(std::fabs(p.z - bounds.centerZ[0]) <= bounds.extentZ[0] + 1e-5f);
+			}
+		}
+	};
+
+	TEST_CLASS(InstancePackingTests)
+	{
+	public:
+		TEST_METHOD(LayoutPutsCamerasOneAfterAnother)
+		{
+			std::vector<std::vector<std::uint32_t>> visible{ { 0, 1, 2 }, {}, { 4 }, { 1, 3 } };
+			std::vector<InstanceRange> ranges;
+
+			Assert::IsTrue(InstancePacking::Layout(visible, 100, ranges) == 6);
+			Assert::IsTrue(ranges.size() == 4);
+			Assert::IsTrue(ranges[0].first == 0 && ranges[0].count == 3);
+			Assert::IsTrue(ranges[1].first == 3 && ranges[1].count == 0);
+			Assert::IsTrue(ranges[2].first == 3 && ranges[2].count == 1);
+			Assert::IsTrue(ranges[3].first == 4 && ranges[3].count == 2);
+		}
+
+		TEST_METHOD(LayoutCutsOffAtCapacity)
+		{
+			std::vector<std::vector<std::uint32_t>> visible{ { 0, 1, 2 }, { 0, 1, 2 }, { 0 } };
+			std::vector<InstanceRange> ranges;
+
+			Assert::IsTrue(InstancePacking::Layout(visible, 4, ranges) == 4);
+			Assert::IsTrue(ranges[0].first == 0 && ranges[0].count == 3);
+			Assert::IsTrue(ranges[1].first == 3 && ranges[1].count == 1);
+			Assert::IsTrue(ranges[2].first == 4 && ranges[2].count == 0);
+
+			// And what didn't fit gets counted
+			std::vector<int> instances{ 10, 11, 12 };
+			PackedInstances<int> packed;
+			packed.Pack(instances, visible, 4);
+			Assert::IsTrue(packed.Size() == 4 && packed.TruncatedCount() == 3);
+			packed.Pack(instances, visible, 100);
+			Assert::IsTrue(packed.Size() == 7 && packed.TruncatedCount() == 0);
+		}
+
+		// Culled, laid out and packed the way BrickRenderer does it, into a
+		// vector instead of an upload buffer: every camera's range holds
+		// exactly the instances in its frustum
+		TEST_METHOD(PackedRangesHoldWhatEachCameraSees)
+		{
+			std::vector<int> instances;
+			WorldBounds bounds;
+			for (int i = 0; i < 40; ++i)
+			{
+				instances.push_back(100 + i);
+				bounds.Add(Sisu::Vector3(i - 20.0f, 0.0f, 10.0f), Sisu::Vector3(0.5f, 0.5f, 0.5f));
+			}
+
+			// Looking down +z from the origin, and the same moved 10 to the
+			// left and to the right; and a camera that isn't active
+			std::vector<Sisu::Matrix4> viewProjections;
+			for (float x : { 0.0f, -10.0f, 10.0f })
+			{
+				auto view = Sisu::Matrix4::Identity();
+				view.r3.x = -x;
+				viewProjections.push_back(view * Projection());
+			}
+
+			std::vector<std::vector<std::uint32_t>> visibleByCamera(viewProjections.size() + 1);
+			for (std::size_t camera = 0; camera < viewProjections.size(); ++camera)
+			{
+				FrustumCulling::Cull(Frustum::FromViewProjection(viewProjections[camera]), bounds, visibleByCamera[camera]);
+			}
+
+			std::vector<InstanceRange> ranges;
+			auto used = InstancePacking::Layout(visibleByCamera, 1000, ranges);
+
+			std::vector<int> buffer(used, -1);
+			std::uint32_t expectedSlot = 0;
+			InstancePacking::Pack(instances, visibleByCamera, ranges, [&](std::uint32_t slot, int instance)
+			{
+				Assert::IsTrue(slot == expectedSlot++);
+				buffer[slot] = instance;
+			});
+			Assert::IsTrue(expectedSlot == used);
+
+			for (std::size_t camera = 0; camera < viewProjections.size(); ++camera)
+			{
+				auto frustum = Frustum::FromViewProjection(viewProjections[camera]);
+				std::vector<int> expected;
+				for (std::uint32_t i = 0; i < bounds.Size(); ++i)
+				{
+					if (IsInside(frustum, bounds, i))
+					{
+						expected.push_back(instances[i]);
+					}
+				}
+
+				const auto& range = ranges[camera];
+				Assert::IsTrue(expected.size() > 0 && expected.size() < instances.size());
+				Assert::IsTrue(expected == std::vector<int>(buffer.begin() + range.first, buffer.begin() + range.first + range.count));
+			}
+
+			Assert::IsTrue(ranges.back().count == 0);
+
+			// The middle camera sees x from -10 to 10, give or take a box
+			Assert::IsTrue(ranges[0].count >= 21 && ranges[0].count <= 23);
+		}
+
+		TEST_METHOD(RepackingVersionsOnlyChangedSlots)
+		{
+			std::vector<int> instances{ 10, 11, 12, 13 };
+			std::vector<std::vector<std::uint32_t>> visible{ { 0, 1, 2 }, { 1, 3 } };
+			PackedInstances<int> packed;
+			Assert::IsTrue(packed.Version() == 0);
+
+			Assert::IsTrue(packed.Pack(instances, visible, 100) == 5);
+			Assert::IsTrue(packed.Version() == 1 && packed.Size() == 5);
+			Assert::IsTrue(Changed(packed, 0) == std::vector<std::uint32_t>{ 0, 1, 2, 3, 4 });
+
+			// Nothing new: same version
+			Assert::IsTrue(packed.Pack(instances, visible, 100) == 0);
+			Assert::IsTrue(packed.Version() == 1);
+			Assert::IsTrue(Changed(packed, 1).empty());
+
+			// Instance 1 is in both cameras' ranges
+			instances[1] = 21;
+			Assert::IsTrue(packed.Pack(instances, visible, 100) == 2);
+			Assert::IsTrue(packed.Version() == 2);
+			Assert::IsTrue(Changed(packed, 1) == std::vector<std::uint32_t>{ 1, 3 });
+			Assert::IsTrue(Runs(packed, 1).size() == 2);
+			Assert::IsTrue(Changed(packed, 0).size() == 5);
+			Assert::IsTrue(Runs(packed, 0).size() == 1);
+
+			// Fewer, then more again: the slots past the shorter size have
+			// to be written, even where they hold the same as before
+			visible[0] = { 0 };
+			Assert::IsTrue(packed.Pack(instances, visible, 100) == 1);		// 10, 21, 13: only slot 2 changed
+			Assert::IsTrue(packed.Ranges()[1].first == 1 && packed.Size() == 3);
+			visible[0] = { 0, 1, 2 };
+			Assert::IsTrue(packed.Pack(instances, visible, 100) == 3);		// 10, 21, 12, 21, 13 again
+			Assert::IsTrue(Changed(packed, 3) == std::vector<std::uint32_t>{ 2, 3, 4 });
+			Assert::IsTrue(Runs(packed, 3) == (std::vector<std::pair<std::uint32_t, std::uint32_t>>{ { 2, 3 } }));
+		}
+
+		// Three frame resources, taking turns: each copies what changed
+		// since it last caught up, and then holds the packed instances
+		TEST_METHOD(FrameResourcesCatchUp)
+		{
+			std::vector<int> instances;
+			for (int i = 0; i < 50; ++i) { instances.push_back(i); }
+			std::vector<std::vector<std::uint32_t>> visible(2);
+			for (std::uint32_t i = 0; i < 50; ++i)
+			{
+				visible[0].push_back(i);
+				if (i % 2 == 0) { visible[1].push_back(i); }
+			}
+
+			PackedInstances<int> packed;
+			std::vector<int> buffers[3];
+			std::uint64_t versions[3] = {};
+			std::size_t uploaded[12] = {};
+			for (int frame = 0; frame < 12; ++frame)
+			{
+				// One instance changes on frame 5, and another on frame 6
+				if (frame == 5) { instances[7] = 107; }
+				if (frame == 6) { instances[8] = 108; }
+				packed.Pack(instances, visible, 1000);
+
+				auto& buffer = buffers[frame % 3];
+				buffer.resize(packed.Size(), -1);
+				uploaded[frame] = packed.CopyChangedSince(versions[frame % 3], [&](std::uint32_t firstSlot, const int* slots, std::uint32_t count)
+				{
+					std::copy(slots, slots + count, buffer.begin() + firstSlot);
+				});
+				versions[frame % 3] = packed.Version();
+
+				Assert::IsTrue(buffer == Expected(instances, visible));
+			}
+
+			Assert::IsTrue(uploaded[0] == 75 && uploaded[1] == 75 && uploaded[2] == 75);
+			Assert::IsTrue(uploaded[3] == 0 && uploaded[4] == 0);
+			Assert::IsTrue(uploaded[5] == 1);		// instance 7, odd, so in the first range only
+			Assert::IsTrue(uploaded[6] == 3);		// and 8, in both
+			Assert::IsTrue(uploaded[7] == 3);		// the third frame resource, still at frame 4's
+			Assert::IsTrue(uploaded[8] == 2 && uploaded[9] == 0);
+		}
+
+		// Live ranges with gaps, a few chunks long, on 4 threads and on
+		// none: the same as a serial loop either way
+		TEST_METHOD(ChunkedGatherMatchesSerialLoop)
+		{
+			LiveRanges arena{ { { 0, 3000 }, { 3500, 3501 }, { 4000, 6100 } } };
+			auto isIncluded = [](std::size_t index) { return index % 3 != 0 && index % 7 != 0; };
+
+			std::vector<std::size_t> expected;
+			for (const auto& range : arena.ranges)
+			{
+				for (auto index = range.first; index < range.second; ++index)
+				{
+					if (isIncluded(index)) { expected.push_back(index); }
+				}
+			}
+
+			JobSystem jobs(4);
+			for (auto pool : { &jobs, static_cast<JobSystem*>(nullptr) })
+			{
+				ChunkedGather gather;
+				auto count = gather.Count(pool, arena, isIncluded);
+				Assert::IsTrue(count == expected.size());
+
+				std::vector<std::size_t> gathered(count, 0);
+				std::vector<std::atomic<int>> writes(count);
+				gather.Write(pool, isIncluded, [&](std::uint32_t slot, std::size_t index)
+				{
+					gathered[slot] = index;
+					writes[slot]++;
+				});
+
+				Assert::IsTrue(gathered == expected);
+				for (const auto& write : writes) { Assert::IsTrue(write == 1); }
+			}
+		}
+
+		// Only the given items that were included get written, each to the
+		// slot the full gather gave it
+		TEST_METHOD(ChunkedGatherRewritesGivenItems)
+		{
+			LiveRanges arena{ { { 0, 3000 }, { 3500, 3501 }, { 4000, 6100 } } };
+			auto isIncluded = [](std::size_t index) { return index % 3 != 0 && index % 7 != 0; };
+
+			JobSystem jobs(4);
+			for (auto pool : { &jobs, static_cast<JobSystem*>(nullptr) })
+			{
+				ChunkedGather gather;
+				auto count = gather.Count(pool, arena, isIncluded);
+				std::vector<std::size_t> gathered(count, 0);
+				gather.Write(pool, isIncluded, [&](std::uint32_t slot, std::size_t index) { gathered[slot] = index; });
+
+				// Far apart, not included (3, 3200), past the end, and every one
+				std::vector<std::size_t> all(6100);
+				for (std::size_t i = 0; i < all.size(); ++i) { all[i] = i; }
+				for (const auto& indices : { std::vector<std::size_t>{ 1, 3, 3200, 3500, 6099, 7000 }, std::vector<std::size_t>(), all })
+				{
+					std::vector<std::atomic<int>> writes(count);
+					std::vector<std::uint32_t> slots;
+					gather.WriteItems(pool, indices, slots, [&](std::uint32_t slot, std::size_t index)
+					{
+						Assert::IsTrue(gathered[slot] == index);
+						writes[slot]++;
+					});
+
+					std::vector<std::uint32_t> expected;
+					for (auto index : indices)
+					{
+						auto it = std::lower_bound(gathered.begin(), gathered.end(), index);
+						if (it != gathered.end() && *it == index) { expected.push_back(static_cast<std::uint32_t>(it - gathered.begin())); }
+					}
+
+					Assert::IsTrue(slots == expected);
+					for (std::size_t slot = 0; slot < count; ++slot)
+					{
+						auto isExpected = std::binary_search(expected.begin(), expected.end(), std::uint32_t(slot));
+						Assert::IsTrue(writes[slot] == (isExpected ? 1 : 0));
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(RepackComparesOnlyTheGivenInstances)
+		{
+			std::vector<int> instances{ 10, 11, 12, 13, 14 };
+			std::vector<std::vector<std::uint32_t>> visible{ { 0, 1, 2, 4 }, { 2, 3, 4 } };
+			PackedInstances<int> packed;
+			packed.Pack(instances, visible, 100);
+			auto version = packed.Version();
+
+			// 2 is in both ranges; 4 changes too, but isn't given
+			instances[2] = 22;
+			instances[4] = 24;
+			Assert::IsTrue(packed.Repack(instances, visible, std::vector<std::uint32_t>{ 1, 2 }) == 2);
+			Assert::IsTrue(packed.Version() == version + 1);
+			Assert::IsTrue(Changed(packed, version) == std::vector<std::uint32_t>{ 2, 4 });
+
+			// 3 is only in the second range
+			Assert::IsTrue(packed.Repack(instances, visible, std::vector<std::uint32_t>{ 3, 4 }) == 2);
+			Assert::IsTrue(Changed(packed, version + 1) == std::vector<std::uint32_t>{ 3, 6 });
+			Assert::IsTrue(Changed(packed, 0).size() == 7);
+
+			// Nothing given changed: same version
+			Assert::IsTrue(packed.Repack(instances, visible, std::vector<std::uint32_t>{ 0, 1, 2, 3, 4 }) == 0);
+			Assert::IsTrue(packed.Version() == version + 2);
+		}
+
+	private:
+		// What ChunkedGather needs of an arena
+		struct LiveRanges
+		{
+			template <typename Visitor>
+			void ForEachLiveRange(Visitor visit) const
+			{
+				for (const auto& range : ranges) { visit(range.first, range.second); }
+			}
+
+			std::vector<std::pair<std::size_t, std::size_t>> ranges;
+		};
+
+		// (first slot, count) of each run CopyChangedSince copies
+		static std::vector<std::pair<std::uint32_t, std::uint32_t>> Runs(const PackedInstances<int>& packed, std::uint64_t version)
+		{
+			std::vector<std::pair<std::uint32_t, std::uint32_t>> runs;
+			packed.CopyChangedSince(version, [&](std::uint32_t firstSlot, const int*, std::uint32_t count) { runs.emplace_back(firstSlot, count); });
+			return runs;
+		}
+
+		static std::vector<std::uint32_t> Changed(const PackedInstances<int>& packed, std::uint64_t version)
+		{
+			std::vector<std::uint32_t> slots;
+			for (const auto& run : Runs(packed, version))
+			{
+				for (auto slot = run.first; slot < run.first + run.second; ++slot) { slots.push_back(slot); }
+			}
+
+			return slots;
+		}
+
+		static std::vector<int> Expected(const std::vector<int>& instances, const std::vector<std::vector<std::uint32_t>>& visibleByCamera)
+		{
+			std::vector<int> expected;
+			for (const auto& visible : visibleByCamera)
+			{
+				for (auto index : visible) { expected.push_back(instances[index]); }
+			}
+
+			return expected;
+		}
+	};
+
+	TEST_CLASS(StreamingCopyTests)
+	{
+	public:
+		// Every length around the 16 and 64 byte steps, from a source that
+		// isn't aligned: the same bytes as memcpy, and nothing past them
+		TEST_METHOD(CopyMatchesMemcpy)
+		{
+			unsigned char source[200];
+			for (int i = 0; i < 200; ++i) { source[i] = static_cast<unsigned char>(i * 7 + 1); }
+
+			for (std::size_t byteCount = 0; byteCount <= 160; ++byteCount)
+			{
+				alignas(16) unsigned char streamed[192];
+				alignas(16) unsigned char copied[192];
+				std::memset(streamed, 0xCD, sizeof(streamed));
+				std::memset(copied, 0xCD, sizeof(copied));
+
+				StreamingCopy::Copy(streamed, source + 3, byteCount);
+				std::memcpy(copied, source + 3, byteCount);
+
+				Assert::IsTrue(std::memcmp(streamed, copied, sizeof(streamed)) == 0);
+			}
+		}
+
+		// Elements 80 bytes long, 256 apart, as in a constant buffer
+		TEST_METHOD(SpanWritesEachElementAtItsStride)
+		{
+			struct Element { float values[20]; };
+			alignas(16) unsigned char buffer[3 * 256];
+			std::memset(buffer, 0xCD, sizeof(buffer));
+
+			{
+				StreamingSpan<Element> span(buffer, 3, 256);
+				Assert::IsTrue(span.Size() == 3);
+				for (int i = 0; i < 3; ++i)
+				{
+					Element element;
+					std::fill(element.values, element.values + 20, float(i + 1));
+					span.Write(i, element);
+				}
+			}
+
+			for (int i = 0; i < 3; ++i)
+			{
+				Element element;
+				std::memcpy(&element, buffer + i * 256, sizeof(Element));
+				Assert::IsTrue(std::all_of(element.values, element.values + 20, [i](float value) { return value == float(i + 1); }));
+				Assert::IsTrue(std::all_of(buffer + i * 256 + sizeof(Element), buffer + (i + 1) * 256, [](unsigned char b) { return b == 0xCD; }));
+			}
+		}
+	};
+}